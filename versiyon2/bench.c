@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "image_resize.h"
+
+// Resize kernel micro-benchmark. Sweeps source sizes, scale ratios, channel
+// counts and kernels, and prints one JSON document with median / p99 time,
+// throughput in output megapixels per second and effective memory
+// bandwidth (source + destination bytes per second), so runs from two
+// commits can be diffed directly.
+//
+// Build: gcc -O2 -o resize_bench bench.c image_resize.c image_resize16.c image_resize_f32.c
+//        image_planar.c image_filter.c image_fastpath.c resize_kernels.c resize_trace.c -lm -pthread
+
+// Source sizes, VGA to 100 MP
+static const struct {
+    int width;
+    int height;
+    const char* name;
+} sizes[] = {
+    {640, 480, "vga"},
+    {1280, 720, "720p"},
+    {1920, 1080, "1080p"},
+    {3840, 2160, "4k"},
+    {6000, 4000, "24mp"},
+    {8192, 6144, "50mp"},
+    {10000, 10000, "100mp"}
+};
+
+// main.c's demo ratios
+static const struct {
+    int num;
+    int denom;
+} scales[] = {
+    {1, 2}, {1, 4}, {3, 4}, {2, 1}
+};
+
+static const int channel_counts[] = { 1, 3, 4 };
+
+typedef enum {
+    BENCH_Q16_BILINEAR,
+    BENCH_NEAREST,
+    BENCH_F32_BILINEAR,
+    BENCH_KERNEL_COUNT
+} BenchKernel;
+
+static const char* const kernel_names[BENCH_KERNEL_COUNT] = { "q16_bilinear", "nearest", "f32_bilinear" };
+static const char* const isa_names[] = { "scalar", "sse2", "ssse3", "avx2", "native" };
+
+typedef struct {
+    int warmup;
+    int repeats;
+    double max_mpix;        // largest source size, in megapixels
+    double max_mb;          // skip cases whose source + destination exceed this
+    int kernel;             // -1 for all
+    int channels;           // 0 for all
+    ResizeIsa isa;
+    const char* output;
+} BenchOptions;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double* sorted, int count, double p) {
+    int rank = (int)(p / 100.0 * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+// Time one resize; the output allocation is part of the call, as for any user
+static double time_resize(BenchKernel kernel, const Image* src, const ImageF32* src_f32, int num, int denom) {
+    double start = now_seconds();
+    if (kernel == BENCH_F32_BILINEAR) {
+        ImageF32* out = resize_image_f32(src_f32, num, denom);
+        double elapsed = now_seconds() - start;
+        if (!out) return -1.0;
+        free_image_f32(out);
+        return elapsed;
+    }
+
+    Image* out = kernel == BENCH_NEAREST ? resize_image_nearest(src, num, denom) : resize_image_fixed(src, num, denom);
+    double elapsed = now_seconds() - start;
+    if (!out) return -1.0;
+    free_image(out);
+    return elapsed;
+}
+
+// Float copy of an 8-bit image in [0, 1]
+static ImageF32* to_f32(const Image* src) {
+    size_t count = (size_t)src->width * src->height * src->channels;
+    float* data = (float*)malloc(count * sizeof(float));
+    ImageF32* img = create_image_f32(src->width, src->height, src->channels);
+    if (!data || !img) {
+        free(data);
+        if (img) free_image_f32(img);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        data[i] = ((const uint8_t*)src->data)[i] / 255.0f;
+    }
+    image_f32_from_interleaved(img, data);
+    free(data);
+    return img;
+}
+
+static int parse_options(int argc, char* argv[], BenchOptions* opt) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--warmup") == 0 && value) {
+            opt->warmup = atoi(value);
+        } else if (strcmp(arg, "--repeats") == 0 && value) {
+            opt->repeats = atoi(value);
+        } else if (strcmp(arg, "--max-mpix") == 0 && value) {
+            opt->max_mpix = atof(value);
+        } else if (strcmp(arg, "--max-mb") == 0 && value) {
+            opt->max_mb = atof(value);
+        } else if (strcmp(arg, "--channels") == 0 && value) {
+            opt->channels = atoi(value);
+        } else if (strcmp(arg, "--kernel") == 0 && value) {
+            opt->kernel = -2;
+            for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+                if (strcmp(value, kernel_names[k]) == 0) opt->kernel = k;
+            }
+            if (opt->kernel == -2) return 0;
+        } else if (strcmp(arg, "--isa") == 0 && value) {
+            int found = 0;
+            for (int k = 0; k <= RESIZE_ISA_NATIVE; k++) {
+                if (strcmp(value, isa_names[k]) == 0) {
+                    opt->isa = (ResizeIsa)k;
+                    found = 1;
+                }
+            }
+            if (!found) return 0;
+        } else if (strcmp(arg, "--output") == 0 && value) {
+            opt->output = value;
+        } else {
+            return 0;
+        }
+        i++;
+    }
+    return opt->warmup >= 0 && opt->repeats >= 1;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opt = { 2, 7, 25.0, 4096.0, -1, 0, RESIZE_ISA_NATIVE, NULL };
+    if (!parse_options(argc, argv, &opt)) {
+        fprintf(stderr,
+                "usage: %s [--warmup N] [--repeats N] [--max-mpix MP] [--max-mb MB] [--channels N]\n"
+                "          [--kernel q16_bilinear|nearest|f32_bilinear] [--isa scalar|sse2|ssse3|avx2|native]\n"
+                "          [--output FILE]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* out = opt.output ? fopen(opt.output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Cannot open %s\n", opt.output);
+        return 1;
+    }
+
+    resize_set_isa_limit(opt.isa);
+    double* samples = (double*)malloc((size_t)opt.repeats * sizeof(double));
+    if (!samples) return 1;
+
+    fprintf(out, "{\n  \"benchmark\": \"resize_kernels\",\n  \"isa\": \"%s\",\n", isa_names[opt.isa]);
+    fprintf(out, "  \"warmup\": %d,\n  \"repeats\": %d,\n  \"results\": [", opt.warmup, opt.repeats);
+
+    int first = 1;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double src_mpix = (double)sizes[s].width * sizes[s].height / 1e6;
+        if (src_mpix > opt.max_mpix) continue;
+
+        for (size_t c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]); c++) {
+            int channels = channel_counts[c];
+            if (opt.channels && opt.channels != channels) continue;
+
+            Image* src = create_test_pattern(sizes[s].width, sizes[s].height, channels);
+            ImageF32* src_f32 = NULL;
+            if (!src) {
+                fprintf(stderr, "Out of memory for %s x%d\n", sizes[s].name, channels);
+                continue;
+            }
+
+            for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+                if (opt.kernel >= 0 && opt.kernel != k) continue;
+                int sample_bytes = k == BENCH_F32_BILINEAR ? (int)sizeof(float) : 1;
+                if (k == BENCH_F32_BILINEAR && !src_f32) {
+                    src_f32 = to_f32(src);
+                    if (!src_f32) continue;
+                }
+
+                for (size_t r = 0; r < sizeof(scales) / sizeof(scales[0]); r++) {
+                    int num = scales[r].num;
+                    int denom = scales[r].denom;
+                    int dst_width = sizes[s].width * num / denom;
+                    int dst_height = sizes[s].height * num / denom;
+                    double src_bytes = (double)sizes[s].width * sizes[s].height * channels * sample_bytes;
+                    double dst_bytes = (double)dst_width * dst_height * channels * sample_bytes;
+                    if ((src_bytes + dst_bytes) / (1024.0 * 1024.0) > opt.max_mb) continue;
+
+                    int ok = 1;
+                    for (int i = 0; i < opt.warmup && ok; i++) {
+                        ok = time_resize((BenchKernel)k, src, src_f32, num, denom) >= 0.0;
+                    }
+                    for (int i = 0; i < opt.repeats && ok; i++) {
+                        samples[i] = time_resize((BenchKernel)k, src, src_f32, num, denom);
+                        ok = samples[i] >= 0.0;
+                    }
+                    if (!ok) {
+                        fprintf(stderr, "Resize failed: %s %s x%d %d/%d\n", kernel_names[k], sizes[s].name,
+                                channels, num, denom);
+                        continue;
+                    }
+
+                    qsort(samples, opt.repeats, sizeof(double), compare_doubles);
+                    double median = opt.repeats % 2 ? samples[opt.repeats / 2]
+                                                    : 0.5 * (samples[opt.repeats / 2 - 1] + samples[opt.repeats / 2]);
+                    double p99 = percentile(samples, opt.repeats, 99.0);
+
+                    fprintf(out, "%s\n    {\"kernel\": \"%s\", \"size\": \"%s\", \"src_width\": %d, \"src_height\": %d, "
+                            "\"channels\": %d, \"scale\": \"%d/%d\", \"dst_width\": %d, \"dst_height\": %d, "
+                            "\"median_ms\": %.4f, \"p99_ms\": %.4f, \"min_ms\": %.4f, "
+                            "\"mpix_per_s\": %.2f, \"gb_per_s\": %.3f}",
+                            first ? "" : ",", kernel_names[k], sizes[s].name, sizes[s].width, sizes[s].height,
+                            channels, num, denom, dst_width, dst_height, median * 1e3, p99 * 1e3, samples[0] * 1e3,
+                            (double)dst_width * dst_height / median / 1e6, (src_bytes + dst_bytes) / median / 1e9);
+                    fflush(out);
+                    first = 0;
+                }
+            }
+
+            if (src_f32) free_image_f32(src_f32);
+            free_image(src);
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    free(samples);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,328 @@
+#include "resize_internal.h"
+#include "fixed_point.h"
+#include "resize_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Exact integer ratio between input and output size (2x, 3x or 4x on both axes)
+int integer_scale_factor(int in_width, int in_height, int out_width, int out_height, int* upscale) {
+    for (int k = 2; k <= 4; k++) {
+        if (in_width == out_width * k && in_height == out_height * k) {
+            *upscale = 0;
+            return k;
+        }
+        if (out_width == in_width * k && out_height == in_height * k) {
+            *upscale = 1;
+            return k;
+        }
+    }
+    return 0;
+}
+
+// Vertical Q16 lerp of two rows. (diff * dy) >> 16 is done in 16-bit lanes:
+// mulhi treats dy as signed, and for dy >= 0x8000 the missing
+// diff * 0x10000 term adds exactly diff.
+void blend_rows_fixed(const int16_t* top, const int16_t* bottom, int32_t dy, uint8_t* out, int count) {
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i vdy = _mm_set1_epi16((int16_t)dy);
+    int high = dy >= 0x8000;
+    int sse2 = resize_isa_allows(RESIZE_ISA_SSE2);
+    for (; sse2 && i + 16 <= count; i += 16) {
+        __m128i t0 = _mm_loadu_si128((const __m128i*)(top + i));
+        __m128i t1 = _mm_loadu_si128((const __m128i*)(top + i + 8));
+        __m128i d0 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(bottom + i)), t0);
+        __m128i d1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(bottom + i + 8)), t1);
+        __m128i m0 = _mm_mulhi_epi16(d0, vdy);
+        __m128i m1 = _mm_mulhi_epi16(d1, vdy);
+        if (high) {
+            m0 = _mm_add_epi16(m0, d0);
+            m1 = _mm_add_epi16(m1, d1);
+        }
+        __m128i v = _mm_packus_epi16(_mm_add_epi16(t0, m0), _mm_add_epi16(t1, m1));
+        _mm_storeu_si128((__m128i*)(out + i), v);
+    }
+#endif
+    for (; i < count; i++) {
+        int32_t value = top[i] + fixed_mult(bottom[i] - top[i], dy);
+        out[i] = value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+    }
+}
+
+// Sum `factor` consecutive source rows column by column into 16-bit sums
+static void sum_rows(const uint8_t* src, size_t stride, int factor, uint16_t* sums, int count) {
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    int sse2 = resize_isa_allows(RESIZE_ISA_SSE2);
+    for (; sse2 && i + 16 <= count; i += 16) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        for (int r = 0; r < factor; r++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + r * stride + i));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+        _mm_storeu_si128((__m128i*)(sums + i), lo);
+        _mm_storeu_si128((__m128i*)(sums + i + 8), hi);
+    }
+#endif
+    for (; i < count; i++) {
+        uint16_t sum = 0;
+        for (int r = 0; r < factor; r++) {
+            sum += src[r * stride + i];
+        }
+        sums[i] = sum;
+    }
+}
+
+// Add k neighbouring pixels of a column-sum row per channel and divide with
+// rounding. Always inlined so each (channels, factor) pair below gets its
+// own loop with constant trip counts and a constant divisor.
+static inline __attribute__((always_inline))
+void reduce_columns_n(const uint16_t* sums, uint8_t* out, int out_width, const int channels, const int factor) {
+    const int area = factor * factor;
+    int x = 0;
+#if defined(__SSE2__)
+    // 2x2 RGBA: two output pixels per step from four column sums
+    if (channels == 4 && factor == 2 && resize_isa_allows(RESIZE_ISA_SSE2)) {
+        __m128i round = _mm_set1_epi16(2);
+        for (; x + 4 <= out_width; x += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(sums + x * 8));
+            __m128i b = _mm_loadu_si128((const __m128i*)(sums + x * 8 + 8));
+            __m128i c = _mm_loadu_si128((const __m128i*)(sums + x * 8 + 16));
+            __m128i d = _mm_loadu_si128((const __m128i*)(sums + x * 8 + 24));
+            __m128i ab = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+            __m128i cd = _mm_add_epi16(_mm_unpacklo_epi64(c, d), _mm_unpackhi_epi64(c, d));
+            ab = _mm_srli_epi16(_mm_add_epi16(ab, round), 2);
+            cd = _mm_srli_epi16(_mm_add_epi16(cd, round), 2);
+            _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(ab, cd));
+        }
+    }
+#endif
+    for (; x < out_width; x++) {
+        const uint16_t* s = sums + (size_t)x * factor * channels;
+        for (int c = 0; c < channels; c++) {
+            int sum = 0;
+            for (int i = 0; i < factor; i++) {
+                sum += s[i * channels + c];
+            }
+            out[x * channels + c] = (uint8_t)((sum + area / 2) / area);
+        }
+    }
+}
+
+static void reduce_columns(const uint16_t* sums, uint8_t* out, int out_width, int channels, int factor) {
+#define REDUCE_CASE(ch, k) case (ch) * 8 + (k): reduce_columns_n(sums, out, out_width, ch, k); break;
+    switch (channels * 8 + factor) {
+        REDUCE_CASE(1, 2) REDUCE_CASE(1, 3) REDUCE_CASE(1, 4)
+        REDUCE_CASE(2, 2) REDUCE_CASE(2, 3) REDUCE_CASE(2, 4)
+        REDUCE_CASE(3, 2) REDUCE_CASE(3, 3) REDUCE_CASE(3, 4)
+        REDUCE_CASE(4, 2) REDUCE_CASE(4, 3) REDUCE_CASE(4, 4)
+    }
+#undef REDUCE_CASE
+}
+
+// k x k box average for exact 1/2, 1/3 and 1/4 downscales. Columns of k
+// rows are summed with SIMD first, then k neighbouring pixels are added per
+// channel. Rounding is exact, (sum + k*k/2) / (k*k), rather than chained
+// pavgb, which would bias the 4x4 case upwards.
+Image* resize_box_down(const Image* input, int factor) {
+    int out_width = input->width / factor;
+    int out_height = input->height / factor;
+    int channels = input->channels;
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    Image* output = create_image(out_width, out_height, channels);
+    if (!output) return NULL;
+
+    uint16_t* sums = (uint16_t*)malloc((size_t)input->width * channels * sizeof(uint16_t));
+    if (!sums) {
+        free_image(output);
+        return NULL;
+    }
+
+    box_down_rows(input, output, factor, 0, out_height, sums);
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    free(sums);
+    return output;
+}
+
+// Output rows [y_begin, y_end) of a k x k box downscale; sums holds one
+// source row of samples
+void box_down_rows(const Image* input, Image* output, int factor, int y_begin, int y_end, uint16_t* sums) {
+    int channels = input->channels;
+    size_t in_stride = (size_t)input->width * channels;
+    const uint8_t* src = (const uint8_t*)input->data;
+    uint8_t* dst = (uint8_t*)output->data;
+    for (int y = y_begin; y < y_end; y++) {
+        sum_rows(src + (size_t)y * factor * in_stride, in_stride, factor, sums, (int)in_stride);
+        reduce_columns(sums, dst + (size_t)y * output->width * channels, output->width, channels, factor);
+    }
+}
+
+// Horizontal lerp of one interleaved source row through the plan's column tables
+static void upsample_row(const uint8_t* src, const ResizePlan* plan, int channels, int16_t* out) {
+    for (int x = 0; x < plan->out_width; x++) {
+        const uint8_t* p0 = src + plan->x0[x] * channels;
+        const uint8_t* p1 = src + plan->x1[x] * channels;
+        int32_t dx = plan->dx[x];
+        for (int c = 0; c < channels; c++) {
+            *out++ = (int16_t)(p0[c] + fixed_mult(p1[c] - p0[c], dx));
+        }
+    }
+}
+
+// Bilinear for exact 2x, 3x and 4x upscales. Each source row is upsampled
+// horizontally once into a 16-bit row; every output row is then a SIMD blend
+// of two such rows. Coordinates come from the same centre-aligned plan as
+// the generic kernels, and for 1, 2 and 4 channels the nested lerps round
+// exactly like them, just without re-filtering each source row k times. The
+// RGB kernel uses the expanded formula instead, which rounds differently,
+// so callers keep 3-channel images off this path.
+Image* resize_bilinear_up(const Image* input, int factor) {
+    int out_width = input->width * factor;
+    int out_height = input->height * factor;
+    int channels = input->channels;
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    Image* output = create_image(out_width, out_height, channels);
+    if (!output) return NULL;
+
+    int16_t* rows = (int16_t*)malloc(2 * (size_t)out_width * channels * sizeof(int16_t));
+    ResizePlan plan;
+    if (!rows || !resize_plan_init(&plan, input->width, input->height, out_width, out_height,
+                                   channels, KERNEL_BILINEAR)) {
+        free(rows);
+        free_image(output);
+        return NULL;
+    }
+
+    bilinear_up_rows(input, output, &plan, 0, out_height, rows);
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    resize_plan_free(&plan);
+    free(rows);
+    return output;
+}
+
+// Output rows [y_begin, y_end) of an integer-ratio bilinear upscale; rows
+// holds two upsampled rows of 16-bit samples. The row cache starts empty,
+// so any split into ranges gives the same bytes.
+void bilinear_up_rows(const Image* input, Image* output, const ResizePlan* plan, int y_begin, int y_end,
+                      int16_t* rows) {
+    int channels = input->channels;
+    size_t row_count = (size_t)output->width * channels;
+    int16_t* top = rows;
+    int16_t* bottom = rows + row_count;
+    int top_row = -1;
+    int bottom_row = -1;
+
+    size_t in_stride = (size_t)input->width * channels;
+    const uint8_t* src = (const uint8_t*)input->data;
+    uint8_t* dst = (uint8_t*)output->data;
+
+    for (int y = y_begin; y < y_end; y++) {
+        int32_t y0 = plan->y0[y];
+        int32_t y1 = plan->y1[y];
+
+        // Moving down one source row: the old bottom row becomes the top
+        if (bottom_row == y0 && top_row != y0) {
+            int16_t* t = top;
+            top = bottom;
+            bottom = t;
+            top_row = y0;
+            bottom_row = -1;
+        }
+        if (top_row != y0) {
+            upsample_row(src + y0 * in_stride, plan, channels, top);
+            top_row = y0;
+        }
+        if (bottom_row != y1) {
+            upsample_row(src + y1 * in_stride, plan, channels, bottom);
+            bottom_row = y1;
+        }
+
+        blend_rows_fixed(top, bottom, plan->dy[y], dst + (size_t)y * row_count, (int)row_count);
+    }
+}
+
+// Nearest neighbour for exact integer ratios: every k-th pixel of every k-th
+// row on the way down, k-fold pixel and row replication on the way up
+Image* resize_nearest_integer(const Image* input, int factor, int upscale) {
+    int channels = input->channels;
+    int out_width = upscale ? input->width * factor : input->width / factor;
+    int out_height = upscale ? input->height * factor : input->height / factor;
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    Image* output = create_image(out_width, out_height, channels);
+    if (!output) return NULL;
+
+    size_t in_stride = (size_t)input->width * channels;
+    size_t out_stride = (size_t)out_width * channels;
+    const uint8_t* src = (const uint8_t*)input->data;
+    uint8_t* dst = (uint8_t*)output->data;
+
+    if (!upscale) {
+        for (int y = 0; y < out_height; y++) {
+            const uint8_t* in = src + (size_t)y * factor * in_stride;
+            uint8_t* out = dst + (size_t)y * out_stride;
+            if (channels == 4) {
+                const PixelRGBA* in_px = (const PixelRGBA*)in;
+                PixelRGBA* out_px = (PixelRGBA*)out;
+                for (int x = 0; x < out_width; x++) {
+                    out_px[x] = in_px[x * factor];
+                }
+            } else {
+                for (int x = 0; x < out_width; x++) {
+                    memcpy(out + x * channels, in + (size_t)x * factor * channels, channels);
+                }
+            }
+        }
+        TRACE_SPAN_END(span);
+        TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+        TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+        return output;
+    }
+
+    for (int y = 0; y < input->height; y++) {
+        const uint8_t* in = src + (size_t)y * in_stride;
+        uint8_t* out = dst + (size_t)y * factor * out_stride;
+        if (channels == 4) {
+            const PixelRGBA* in_px = (const PixelRGBA*)in;
+            PixelRGBA* out_px = (PixelRGBA*)out;
+            for (int x = 0; x < input->width; x++) {
+                for (int f = 0; f < factor; f++) {
+                    *out_px++ = in_px[x];
+                }
+            }
+        } else {
+            uint8_t* o = out;
+            for (int x = 0; x < input->width; x++) {
+                for (int f = 0; f < factor; f++) {
+                    memcpy(o, in + x * channels, channels);
+                    o += channels;
+                }
+            }
+        }
+
+        // Replicate the finished row k - 1 times
+        for (int f = 1; f < factor; f++) {
+            memcpy(out + f * out_stride, out, out_stride);
+        }
+    }
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    return output;
+}
@@ -0,0 +1,275 @@
+#include "image_resize.h"
+#include "resize_internal.h"
+#include "resize_trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Filter coefficients are Q14: 1.0 == 1 << FILTER_SHIFT
+#define FILTER_SHIFT 14
+#define FILTER_ONE (1 << FILTER_SHIFT)
+
+// Taps are stored in groups of 8 so the SIMD loops never need a tail
+#define FILTER_TAP_GROUP 8
+
+// Per-axis coefficient table: output pixel o uses count[o] Q14 weights
+// starting at source index start[o]; rows are `taps` long, zero-padded
+typedef struct {
+    int* start;
+    int* count;
+    int16_t* coeffs;
+    int taps;
+} FilterTable;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static double sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+// Mitchell-Netravali family of cubics: (B, C) = (0, 1/2) is Catmull-Rom,
+// (1/3, 1/3) is Mitchell
+static double cubic_bc(double x, double b, double c) {
+    x = fabs(x);
+    if (x < 1.0) {
+        return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6.0;
+    }
+    if (x < 2.0) {
+        return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6.0;
+    }
+    return 0.0;
+}
+
+// Filter kernel value at distance x (in source pixels at 1:1 scale)
+static double filter_kernel(ResizeFilter filter, double x) {
+    switch (filter) {
+        case FILTER_CATMULL_ROM: return cubic_bc(x, 0.0, 0.5);
+        case FILTER_MITCHELL:    return cubic_bc(x, 1.0 / 3.0, 1.0 / 3.0);
+        case FILTER_LANCZOS2:    return fabs(x) < 2.0 ? sinc(x) * sinc(x / 2.0) : 0.0;
+        case FILTER_LANCZOS3:    return fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+    return 0.0;
+}
+
+// Kernel radius at 1:1 scale
+static double filter_radius(ResizeFilter filter) {
+    return filter == FILTER_LANCZOS3 ? 3.0 : 2.0;
+}
+
+static void free_filter_table(FilterTable* table) {
+    free(table->start);
+    free(table->count);
+    free(table->coeffs);
+}
+
+// Build the Q14 table for one axis. Sampling is centre-aligned; on
+// downscale the kernel is stretched by in/out so it low-passes properly.
+// Taps that fall outside the image are dropped and the rest renormalised,
+// and rounding error is pushed onto the largest tap so each row sums to
+// exactly FILTER_ONE (flat areas stay flat).
+static int build_filter_table(ResizeFilter filter, int in_size, int out_size, FilterTable* table) {
+    double scale = (double)in_size / out_size;
+    double filter_scale = scale > 1.0 ? scale : 1.0;
+    double support = filter_radius(filter) * filter_scale;
+
+    int taps = (int)ceil(support) * 2 + 1;
+    taps = (taps + FILTER_TAP_GROUP - 1) / FILTER_TAP_GROUP * FILTER_TAP_GROUP;
+
+    table->taps = taps;
+    table->start = (int*)malloc((size_t)out_size * sizeof(int));
+    table->count = (int*)malloc((size_t)out_size * sizeof(int));
+    table->coeffs = (int16_t*)calloc((size_t)out_size * taps, sizeof(int16_t));
+    double* weights = (double*)malloc((size_t)taps * sizeof(double));
+    if (!table->start || !table->count || !table->coeffs || !weights) {
+        free(weights);
+        free_filter_table(table);
+        return 0;
+    }
+
+    for (int o = 0; o < out_size; o++) {
+        double center = (o + 0.5) * scale - 0.5;
+        int first = (int)ceil(center - support);
+        int last = (int)floor(center + support);
+        if (first < 0) first = 0;
+        if (last > in_size - 1) last = in_size - 1;
+        if (last - first + 1 > taps) last = first + taps - 1;
+
+        double sum = 0.0;
+        int count = last - first + 1;
+        for (int i = 0; i < count; i++) {
+            weights[i] = filter_kernel(filter, (first + i - center) / filter_scale);
+            sum += weights[i];
+        }
+
+        int16_t* coeffs = table->coeffs + (size_t)o * taps;
+        int total = 0;
+        int largest = 0;
+        for (int i = 0; i < count; i++) {
+            coeffs[i] = (int16_t)lround(sum != 0.0 ? weights[i] / sum * FILTER_ONE : 0.0);
+            total += coeffs[i];
+            if (abs(coeffs[i]) > abs(coeffs[largest])) largest = i;
+        }
+        if (sum == 0.0) {
+            coeffs[0] = 0;
+            total = 0;
+        }
+        coeffs[largest] += FILTER_ONE - total;
+
+        table->start[o] = first;
+        table->count[o] = count;
+    }
+
+    free(weights);
+    return 1;
+}
+
+// Round a Q14 accumulator back to a byte
+static inline uint8_t filter_round(int32_t acc) {
+    acc = (acc + (1 << (FILTER_SHIFT - 1))) >> FILTER_SHIFT;
+    if (acc < 0) return 0;
+    if (acc > 255) return 255;
+    return (uint8_t)acc;
+}
+
+// Horizontal pass over one row. The row is read from a zero-padded copy so
+// whole tap groups can be loaded without checking the image edge.
+static void filter_row_horizontal(const uint8_t* row, const FilterTable* table, uint8_t* out, int out_width) {
+    int taps = table->taps;
+    int x = 0;
+#if defined(__SSE2__)
+    int sse2 = resize_isa_allows(RESIZE_ISA_SSE2);
+    for (; sse2 && x < out_width; x++) {
+        const uint8_t* src = row + table->start[x];
+        const int16_t* coeffs = table->coeffs + (size_t)x * taps;
+        __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for (int t = 0; t < taps; t += FILTER_TAP_GROUP) {
+            __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + t)), zero);
+            __m128i weights = _mm_loadu_si128((const __m128i*)(coeffs + t));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(pixels, weights));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[x] = filter_round(_mm_cvtsi128_si32(acc));
+    }
+#endif
+    for (; x < out_width; x++) {
+        const uint8_t* src = row + table->start[x];
+        const int16_t* coeffs = table->coeffs + (size_t)x * taps;
+        int32_t acc = 0;
+        for (int t = 0; t < taps; t++) {
+            acc += src[t] * coeffs[t];
+        }
+        out[x] = filter_round(acc);
+    }
+}
+
+// Vertical pass producing one output row from the horizontally filtered
+// plane. Two source rows are interleaved per madd, 8 output pixels per step.
+static void filter_row_vertical(const uint8_t* plane, int stride, int first, const int16_t* coeffs, int count,
+                                uint8_t* out, int width) {
+    int x = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    int sse2 = resize_isa_allows(RESIZE_ISA_SSE2);
+    for (; sse2 && x + 8 <= width; x += 8) {
+        __m128i acc_lo = _mm_setzero_si128();
+        __m128i acc_hi = _mm_setzero_si128();
+        for (int t = 0; t < count; t += 2) {
+            const uint8_t* r0 = plane + (size_t)(first + t) * stride + x;
+            const uint8_t* r1 = r0 + stride;
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)r0), zero);
+            __m128i b = t + 1 < count ? _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)r1), zero) : zero;
+            __m128i w = _mm_set1_epi32((int32_t)(((uint32_t)(uint16_t)coeffs[t + 1] << 16) | (uint16_t)coeffs[t]));
+            acc_lo = _mm_add_epi32(acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            acc_hi = _mm_add_epi32(acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        __m128i half = _mm_set1_epi32(1 << (FILTER_SHIFT - 1));
+        acc_lo = _mm_srai_epi32(_mm_add_epi32(acc_lo, half), FILTER_SHIFT);
+        acc_hi = _mm_srai_epi32(_mm_add_epi32(acc_hi, half), FILTER_SHIFT);
+        __m128i packed = _mm_packs_epi32(acc_lo, acc_hi);
+        _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(packed, packed));
+    }
+#endif
+    for (; x < width; x++) {
+        int32_t acc = 0;
+        for (int t = 0; t < count; t++) {
+            acc += plane[(size_t)(first + t) * stride + x] * coeffs[t];
+        }
+        out[x] = filter_round(acc);
+    }
+}
+
+// Separable resize of a planar image with a Catmull-Rom, Mitchell or
+// Lanczos kernel in Q14 integer arithmetic: a horizontal pass into an 8-bit
+// intermediate plane, then a vertical pass into the output.
+PlanarImage* resize_planar_filter(const PlanarImage* input, int32_t scale_num, int32_t scale_denom, ResizeFilter filter) {
+    if (!input || !input->planes[0] || scale_num <= 0 || scale_denom <= 0) {
+        return NULL;
+    }
+
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    PlanarImage* output = create_planar_image(out_width, out_height, input->channels);
+    PlanarImage* temp = create_planar_image(out_width, input->height, 1);
+    FilterTable horizontal = { NULL, NULL, NULL, 0 };
+    FilterTable vertical = { NULL, NULL, NULL, 0 };
+    uint8_t* padded = NULL;
+    if (!output || !temp ||
+        !build_filter_table(filter, input->width, out_width, &horizontal) ||
+        !build_filter_table(filter, input->height, out_height, &vertical) ||
+        !(padded = (uint8_t*)calloc((size_t)input->width + horizontal.taps, 1))) {
+        free_filter_table(&horizontal);
+        free_filter_table(&vertical);
+        free_planar_image(temp);
+        free_planar_image(output);
+        return NULL;
+    }
+
+    for (int c = 0; c < input->channels; c++) {
+        for (int y = 0; y < input->height; y++) {
+            memcpy(padded, input->planes[c] + (size_t)y * input->stride, input->width);
+            filter_row_horizontal(padded, &horizontal, temp->planes[0] + (size_t)y * temp->stride, out_width);
+        }
+        for (int y = 0; y < out_height; y++) {
+            filter_row_vertical(temp->planes[0], temp->stride, vertical.start[y],
+                                vertical.coeffs + (size_t)y * vertical.taps, vertical.count[y],
+                                output->planes[c] + (size_t)y * output->stride, out_width);
+        }
+    }
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    free(padded);
+    free_filter_table(&horizontal);
+    free_filter_table(&vertical);
+    free_planar_image(temp);
+    return output;
+}
+
+// Separable filter resize of an interleaved image (via the planar layout)
+Image* resize_image_filter(const Image* input, int32_t scale_num, int32_t scale_denom, ResizeFilter filter) {
+    PlanarImage* planar = image_to_planar(input);
+    if (!planar) return NULL;
+
+    PlanarImage* resized = resize_planar_filter(planar, scale_num, scale_denom, filter);
+    free_planar_image(planar);
+    if (!resized) return NULL;
+
+    Image* output = planar_to_image(resized);
+    free_planar_image(resized);
+    return output;
+}
@@ -0,0 +1,576 @@
+#define _GNU_SOURCE
+#include "image_resize.h"
+#include "resize_trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+// EncodedBuffer alignment, enough for O_DIRECT on common block devices
+#define ENCODED_ALIGN 4096
+
+// write_file (write_encoded_file with direct set) bypasses the page cache
+// from this size on; smaller files are cheaper to write buffered
+#define DIRECT_MIN_BYTES (1 << 20)
+
+// Sample formats load_encoded can decode to
+typedef enum {
+    LOAD_8_BIT,
+    LOAD_16_BIT,
+    LOAD_FLOAT
+} LoadKind;
+
+// Encoded file in memory: mapped when it is a regular file, read to the end
+// otherwise (pipes, character devices)
+typedef struct {
+    unsigned char* bytes;
+    size_t len;
+    int mapped;
+} EncodedFile;
+
+static int read_encoded(const char* filename, EncodedFile* file) {
+    memset(file, 0, sizeof(*file));
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* bytes = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (bytes == MAP_FAILED) return 0;
+        // The decoders walk the file front to back: read ahead aggressively
+        // and drop pages behind
+        madvise(bytes, (size_t)st.st_size, MADV_SEQUENTIAL);
+        file->bytes = (unsigned char*)bytes;
+        file->len = (size_t)st.st_size;
+        file->mapped = 1;
+        return 1;
+    }
+
+    size_t capacity = 1 << 16;
+    file->bytes = (unsigned char*)malloc(capacity);
+    while (file->bytes) {
+        if (file->len == capacity) {
+            unsigned char* grown = (unsigned char*)realloc(file->bytes, capacity * 2);
+            if (!grown) break;
+            file->bytes = grown;
+            capacity *= 2;
+        }
+        ssize_t got = read(fd, file->bytes + file->len, capacity - file->len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            close(fd);
+            if (got == 0) return 1;
+            free(file->bytes);
+            file->bytes = NULL;
+            return 0;
+        }
+        file->len += (size_t)got;
+    }
+    close(fd);
+    free(file->bytes);
+    file->bytes = NULL;
+    return 0;
+}
+
+static void release_encoded(EncodedFile* file) {
+    if (file->mapped) {
+        munmap(file->bytes, file->len);
+    } else {
+        free(file->bytes);
+    }
+}
+
+// Decode a file from memory instead of through stb_image's stdio reader,
+// which refills a 128-byte buffer with one fread after another. Files that
+// cannot be read that way (or are too big for stb_image's int lengths) go
+// through stb_image's own loader, which also reports the error.
+static void* load_encoded(const char* filename, LoadKind kind, int* width, int* height, int* channels) {
+    EncodedFile file;
+    if (!read_encoded(filename, &file)) {
+        file.bytes = NULL;
+    } else if (file.len > INT_MAX) {
+        release_encoded(&file);
+        file.bytes = NULL;
+    }
+
+    void* data = NULL;
+    int len = (int)file.len;
+    switch (kind) {
+    case LOAD_8_BIT:
+        data = file.bytes ? stbi_load_from_memory(file.bytes, len, width, height, channels, 0)
+                          : stbi_load(filename, width, height, channels, 0);
+        break;
+    case LOAD_16_BIT:
+        data = file.bytes ? stbi_load_16_from_memory(file.bytes, len, width, height, channels, 0)
+                          : stbi_load_16(filename, width, height, channels, 0);
+        break;
+    case LOAD_FLOAT:
+        data = file.bytes ? stbi_loadf_from_memory(file.bytes, len, width, height, channels, 0)
+                          : stbi_loadf(filename, width, height, channels, 0);
+        break;
+    }
+    if (file.bytes) release_encoded(&file);
+    return data;
+}
+
+// Load an image from file using stb_image
+Image* load_image(const char* filename) {
+    int width, height, channels;
+    TRACE_SPAN_BEGIN(decode, TRACE_STAGE_DECODE);
+    unsigned char* data = (unsigned char*)load_encoded(filename, LOAD_8_BIT, &width, &height, &channels);
+    TRACE_SPAN_END(decode);
+
+    if (!data) {
+        printf("Error loading image: %s\n", filename);
+        return NULL;
+    }
+
+    printf("Loaded image: %s (%dx%d, %d channels)\n", filename, width, height, channels);
+
+    // Create our image structure
+    TRACE_SPAN_BEGIN(copy, TRACE_STAGE_COPY);
+    Image* img = create_image(width, height, channels);
+    if (!img) {
+        stbi_image_free(data);
+        return NULL;
+    }
+
+    // Copy the data (gray, gray+alpha, RGB and RGBA are all kept as-is)
+    memcpy(img->data, data, (size_t)width * height * channels);
+
+    // Free stb image data
+    stbi_image_free(data);
+    TRACE_SPAN_END(copy);
+    TRACE_COUNT(TRACE_BYTES_DECODED, (size_t)width * height * channels);
+
+    return img;
+}
+
+static int encode_png(const unsigned char* rows, int width, int height, int channels, int bit_depth,
+                      EncodedBuffer* out, PipelineTimes* times);
+static int write_file(const unsigned char* bytes, size_t len, const char* filename, int direct);
+
+// Save an image to PNG file (same bytes as stb_image_write's PNG writer, but
+// with filtering, deflate and the write as separately traced stages)
+int save_image(const Image* img, const char* filename) {
+    if (!img || !img->data) {
+        printf("Invalid image data\n");
+        return 0;
+    }
+
+    EncodedBuffer png = { NULL, 0, 0 };
+    int result = encode_png((const unsigned char*)img->data, img->width, img->height, img->channels, 8, &png,
+                            NULL) &&
+                 write_file(png.bytes, png.len, filename, 0);
+    free(png.bytes);
+
+    if (result) {
+        printf("Saved image: %s (%dx%d, %d channels)\n", filename, img->width, img->height, img->channels);
+    } else {
+        printf("Error saving image: %s\n", filename);
+    }
+
+    return result;
+}
+
+// Check whether a file holds 16 bits per channel (e.g. a 16-bit PNG)
+int image_is_16_bit(const char* filename) {
+    return stbi_is_16_bit(filename);
+}
+
+// Load an image with 16 bits per channel; 8-bit files are widened by stb_image
+Image16* load_image16(const char* filename) {
+    int width, height, channels;
+    TRACE_SPAN_BEGIN(decode, TRACE_STAGE_DECODE);
+    stbi_us* data = (stbi_us*)load_encoded(filename, LOAD_16_BIT, &width, &height, &channels);
+    TRACE_SPAN_END(decode);
+
+    if (!data) {
+        printf("Error loading image: %s\n", filename);
+        return NULL;
+    }
+
+    printf("Loaded 16-bit image: %s (%dx%d, %d channels)\n", filename, width, height, channels);
+
+    TRACE_SPAN_BEGIN(copy, TRACE_STAGE_COPY);
+    Image16* img = create_image16(width, height, channels);
+    if (!img) {
+        stbi_image_free(data);
+        return NULL;
+    }
+
+    memcpy(img->data, data, (size_t)width * height * channels * sizeof(PixelGray16));
+
+    stbi_image_free(data);
+    TRACE_SPAN_END(copy);
+    TRACE_COUNT(TRACE_BYTES_DECODED, (size_t)width * height * channels * sizeof(PixelGray16));
+
+    return img;
+}
+
+// Append one PNG chunk (length, tag, payload, CRC) to out
+static unsigned char* write_png_chunk(unsigned char* out, const char* tag, const unsigned char* payload, int len) {
+    stbiw__wp32(out, len);
+    stbiw__wptag(out, tag);
+    if (len > 0) {
+        memcpy(out, payload, len);
+        out += len;
+    }
+    stbiw__wpcrc(&out, len);
+    return out;
+}
+
+static double io_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Make room for len bytes; the old contents are not kept. Allocations are
+// aligned so a buffer can be written with O_DIRECT.
+static int encoded_reserve(EncodedBuffer* buffer, size_t len) {
+    if (buffer->bytes && buffer->capacity >= len) return 1;
+    size_t capacity = (len + ENCODED_ALIGN - 1) / ENCODED_ALIGN * ENCODED_ALIGN;
+    void* bytes;
+    if (posix_memalign(&bytes, ENCODED_ALIGN, capacity ? capacity : ENCODED_ALIGN) != 0) return 0;
+    free(buffer->bytes);
+    buffer->bytes = (unsigned char*)bytes;
+    buffer->capacity = capacity;
+    buffer->len = 0;
+    return 1;
+}
+
+// Encode big-endian rows of samples as PNG in memory, in the same stages as
+// stb_image_write (per-row filter choice by smallest sum of absolute
+// residuals, deflate, chunk assembly) and with byte-identical 8-bit output.
+// Keeping the stages here lets 16-bit depth through and lets each stage be
+// timed when times is not NULL.
+static int encode_png(const unsigned char* rows, int width, int height, int channels, int bit_depth,
+                      EncodedBuffer* out, PipelineTimes* times) {
+    static const int color_type[5] = { -1, 0, 4, 2, 6 };
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+    int bpp = channels * bit_depth / 8;     // bytes per pixel, also the filter distance
+    int row_bytes = width * bpp;
+    double start = io_now();
+    TRACE_SPAN_BEGIN(filter_span, TRACE_STAGE_PNG_FILTER);
+
+    unsigned char* filtered = (unsigned char*)malloc((size_t)(row_bytes + 1) * height);
+    signed char* line = (signed char*)malloc(row_bytes);
+    if (!filtered || !line) {
+        free(filtered);
+        free(line);
+        return 0;
+    }
+
+    for (int y = 0; y < height; y++) {
+        int best_filter = 0;
+        int best_value = 0x7fffffff;
+        for (int filter = 0; filter < 5; filter++) {
+            stbiw__encode_png_line((unsigned char*)rows, row_bytes, width, height, y, bpp, filter, line);
+            int estimate = 0;
+            for (int i = 0; i < row_bytes; i++) {
+                estimate += abs(line[i]);
+            }
+            if (estimate < best_value) {
+                best_value = estimate;
+                best_filter = filter;
+            }
+        }
+        stbiw__encode_png_line((unsigned char*)rows, row_bytes, width, height, y, bpp, best_filter, line);
+        filtered[(size_t)y * (row_bytes + 1)] = (unsigned char)best_filter;
+        memcpy(filtered + (size_t)y * (row_bytes + 1) + 1, line, row_bytes);
+    }
+    free(line);
+    TRACE_SPAN_END(filter_span);
+
+    double filtered_at = io_now();
+    TRACE_SPAN_BEGIN(deflate_span, TRACE_STAGE_DEFLATE);
+    int zlen;
+    unsigned char* zlib = stbi_zlib_compress(filtered, (row_bytes + 1) * height, &zlen, stbi_write_png_compression_level);
+    free(filtered);
+    if (!zlib) return 0;
+
+    unsigned char header[13];
+    unsigned char* h = header;
+    stbiw__wp32(h, width);
+    stbiw__wp32(h, height);
+    *h++ = (unsigned char)bit_depth;
+    *h++ = (unsigned char)color_type[channels];
+    *h++ = 0;                               // compression
+    *h++ = 0;                               // filter method
+    *h++ = 0;                               // no interlace
+
+    // Assembled straight into the caller's buffer: no further copy before
+    // the bytes reach a file or socket
+    if (!encoded_reserve(out, (size_t)8 + 12 + 13 + 12 + zlen + 12)) {
+        STBIW_FREE(zlib);
+        return 0;
+    }
+
+    unsigned char* o = out->bytes;
+    memcpy(o, signature, 8);
+    o += 8;
+    o = write_png_chunk(o, "IHDR", header, 13);
+    o = write_png_chunk(o, "IDAT", zlib, zlen);
+    o = write_png_chunk(o, "IEND", NULL, 0);
+    out->len = (size_t)(o - out->bytes);
+    STBIW_FREE(zlib);
+    TRACE_SPAN_END(deflate_span);
+
+    // Chunk assembly (mostly the CRC over the compressed data) counts as deflate
+    if (times) {
+        times->filter += filtered_at - start;
+        times->deflate += io_now() - filtered_at;
+    }
+    return 1;
+}
+
+// Encode a 16-bit image as PNG in memory. stb_image_write only emits 8-bit
+// PNGs, so the rows are byte-swapped to big endian and go through encode_png.
+static int encode_png16(const Image16* img, EncodedBuffer* out) {
+    size_t count = (size_t)img->width * img->height * img->channels;
+    unsigned char* swapped = (unsigned char*)malloc(count * 2);
+    if (!swapped) return 0;
+
+    const PixelGray16* src = (const PixelGray16*)img->data;
+    for (size_t i = 0; i < count; i++) {
+        swapped[2 * i] = (unsigned char)(src[i] >> 8);
+        swapped[2 * i + 1] = (unsigned char)(src[i] & 0xFF);
+    }
+
+    int result = encode_png(swapped, img->width, img->height, img->channels, 16, out, NULL);
+    free(swapped);
+    return result;
+}
+
+static void clear_direct(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+}
+
+// Write an encoded file with one pwrite (more only if the kernel writes
+// less), without a copy through stdio buffers; returns 1 on success. With
+// direct set, the block-aligned part of a large aligned buffer bypasses the
+// page cache and the tail goes through it; file systems without O_DIRECT
+// (tmpfs) or with stricter alignment get a buffered write.
+static int write_file(const unsigned char* bytes, size_t len, const char* filename, int direct) {
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_WRITE);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = -1;
+    size_t direct_end = 0;
+    if (direct && len >= DIRECT_MIN_BYTES && (uintptr_t)bytes % ENCODED_ALIGN == 0) {
+        fd = open(filename, flags | O_DIRECT, 0666);
+        if (fd >= 0) direct_end = len / ENCODED_ALIGN * ENCODED_ALIGN;
+    }
+    if (fd < 0) fd = open(filename, flags, 0666);
+
+    int result = fd >= 0;
+    size_t done = 0;
+    while (result && done < len) {
+        if (direct_end && done >= direct_end) {
+            clear_direct(fd);
+            direct_end = 0;
+        }
+        size_t end = direct_end ? direct_end : len;
+        ssize_t put = pwrite(fd, bytes + done, end - done, (off_t)done);
+        if (put < 0 && errno == EINTR) continue;
+        if (put < 0 && errno == EINVAL && direct_end) {
+            clear_direct(fd);
+            direct_end = 0;
+            continue;
+        }
+        if (put <= 0) {
+            result = 0;
+        } else {
+            done += (size_t)put;
+        }
+    }
+    if (fd >= 0 && close(fd) != 0) result = 0;
+    TRACE_SPAN_END(span);
+    if (result) TRACE_COUNT(TRACE_BYTES_WRITTEN, len);
+    return result;
+}
+
+// Save a 16-bit image as a 16-bit PNG
+int save_image16(const Image16* img, const char* filename) {
+    if (!img || !img->data) {
+        printf("Invalid image data\n");
+        return 0;
+    }
+
+    EncodedBuffer png = { NULL, 0, 0 };
+    int result = encode_png16(img, &png) && write_file(png.bytes, png.len, filename, 0);
+    free(png.bytes);
+
+    if (result) {
+        printf("Saved 16-bit image: %s (%dx%d, %d channels)\n", filename, img->width, img->height, img->channels);
+    } else {
+        printf("Error saving image: %s\n", filename);
+    }
+
+    return result;
+}
+
+// Quiet load_image that adds the stb decode and the copy into the Image to
+// times (which may be NULL)
+Image* load_image_timed(const char* filename, PipelineTimes* times) {
+    int width, height, channels;
+    double start = io_now();
+    TRACE_SPAN_BEGIN(decode, TRACE_STAGE_DECODE);
+    unsigned char* data = (unsigned char*)load_encoded(filename, LOAD_8_BIT, &width, &height, &channels);
+    TRACE_SPAN_END(decode);
+    double decoded_at = io_now();
+    if (!data) return NULL;
+
+    TRACE_SPAN_BEGIN(copy, TRACE_STAGE_COPY);
+    Image* img = create_image(width, height, channels);
+    if (img) {
+        memcpy(img->data, data, (size_t)width * height * channels);
+        TRACE_COUNT(TRACE_BYTES_DECODED, (size_t)width * height * channels);
+    }
+    stbi_image_free(data);
+    TRACE_SPAN_END(copy);
+
+    if (times) {
+        times->decode += decoded_at - start;
+        times->copy += io_now() - decoded_at;
+    }
+    return img;
+}
+
+// Quiet load of an encoded image already in memory
+Image* load_image_from_memory(const unsigned char* bytes, size_t len) {
+    if (len > 0x7fffffff) return NULL;
+    int width, height, channels;
+    TRACE_SPAN_BEGIN(decode, TRACE_STAGE_DECODE);
+    unsigned char* data = stbi_load_from_memory(bytes, (int)len, &width, &height, &channels, 0);
+    TRACE_SPAN_END(decode);
+    if (!data) return NULL;
+
+    TRACE_SPAN_BEGIN(copy, TRACE_STAGE_COPY);
+    Image* img = create_image(width, height, channels);
+    if (img) {
+        memcpy(img->data, data, (size_t)width * height * channels);
+        TRACE_COUNT(TRACE_BYTES_DECODED, (size_t)width * height * channels);
+    }
+    stbi_image_free(data);
+    TRACE_SPAN_END(copy);
+    return img;
+}
+
+// PNG bytes save_image would write, in a malloc'd buffer
+unsigned char* encode_image_png(const Image* img, int* out_len) {
+    EncodedBuffer png = { NULL, 0, 0 };
+    if (!encode_image_png_into(img, &png) || png.len > INT_MAX) {
+        free(png.bytes);
+        return NULL;
+    }
+    *out_len = (int)png.len;
+    return png.bytes;
+}
+
+// Reusing one buffer across images saves the allocation and the page
+// faults of a fresh one each time
+int encode_image_png_into(const Image* img, EncodedBuffer* buffer) {
+    if (!img || !img->data) return 0;
+    return encode_png((const unsigned char*)img->data, img->width, img->height, img->channels, 8, buffer, NULL);
+}
+
+int write_encoded_file(const EncodedBuffer* buffer, const char* filename, int direct) {
+    return write_file(buffer->bytes, buffer->len, filename, direct);
+}
+
+// Quiet save_image that adds PNG filtering, deflate and the file write to
+// times (which may be NULL); the file is byte-identical to save_image's
+int save_image_timed(const Image* img, const char* filename, PipelineTimes* times) {
+    if (!img || !img->data) return 0;
+
+    EncodedBuffer png = { NULL, 0, 0 };
+    if (!encode_png((const unsigned char*)img->data, img->width, img->height, img->channels, 8, &png, times)) {
+        free(png.bytes);
+        return 0;
+    }
+
+    double start = io_now();
+    int result = write_file(png.bytes, png.len, filename, 0);
+    if (times) times->write += io_now() - start;
+
+    free(png.bytes);
+    return result;
+}
+
+// Check whether a file holds floating-point data (Radiance .hdr)
+int image_is_hdr(const char* filename) {
+    return stbi_is_hdr(filename);
+}
+
+// Load an image as linear float planes. HDR files are read as-is; 8-bit
+// files are linearised by stb_image's LDR-to-HDR gamma
+ImageF32* load_image_f32(const char* filename) {
+    int width, height, channels;
+    TRACE_SPAN_BEGIN(decode, TRACE_STAGE_DECODE);
+    float* data = (float*)load_encoded(filename, LOAD_FLOAT, &width, &height, &channels);
+    TRACE_SPAN_END(decode);
+
+    if (!data) {
+        printf("Error loading image: %s\n", filename);
+        return NULL;
+    }
+
+    printf("Loaded float image: %s (%dx%d, %d channels)\n", filename, width, height, channels);
+
+    TRACE_SPAN_BEGIN(copy, TRACE_STAGE_COPY);
+    ImageF32* img = create_image_f32(width, height, channels);
+    if (!img) {
+        stbi_image_free(data);
+        return NULL;
+    }
+
+    image_f32_from_interleaved(img, data);
+
+    stbi_image_free(data);
+    TRACE_SPAN_END(copy);
+    TRACE_COUNT(TRACE_BYTES_DECODED, (size_t)width * height * channels * sizeof(float));
+
+    return img;
+}
+
+// Save a float image as a Radiance .hdr file
+int save_image_hdr(const ImageF32* img, const char* filename) {
+    if (!img || !img->planes[0]) {
+        printf("Invalid image data\n");
+        return 0;
+    }
+
+    float* data = (float*)malloc((size_t)img->width * img->height * img->channels * sizeof(float));
+    int result = 0;
+    if (data) {
+        image_f32_to_interleaved(img, data);
+        TRACE_SPAN_BEGIN(span, TRACE_STAGE_WRITE);
+        result = stbi_write_hdr(filename, img->width, img->height, img->channels, data);
+        TRACE_SPAN_END(span);
+        free(data);
+    }
+
+    if (result) {
+        printf("Saved HDR image: %s (%dx%d, %d channels)\n", filename, img->width, img->height, img->channels);
+    } else {
+        printf("Error saving image: %s\n", filename);
+    }
+
+    return result;
+}
@@ -0,0 +1,358 @@
+#include "image_resize.h"
+#include "resize_internal.h"
+#include "fixed_point.h"
+#include "resize_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_DISPATCH 1
+#endif
+
+// Planes are 32-byte aligned and their rows padded to whole 32-byte vectors
+#define PLANAR_ALIGN 32
+
+// Create a planar 8-bit image with one padded, aligned plane per channel
+PlanarImage* create_planar_image(int width, int height, int channels) {
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+        return NULL;
+    }
+
+    PlanarImage* img = (PlanarImage*)malloc(sizeof(PlanarImage));
+    if (!img) return NULL;
+
+    img->width = width;
+    img->height = height;
+    img->channels = channels;
+    img->stride = (width + PLANAR_ALIGN - 1) / PLANAR_ALIGN * PLANAR_ALIGN;
+
+    size_t plane_size = (size_t)img->stride * height;
+    void* block = NULL;
+    if (posix_memalign(&block, PLANAR_ALIGN, plane_size * channels) != 0) {
+        free(img);
+        return NULL;
+    }
+
+    // Initialize to zero
+    memset(block, 0, plane_size * channels);
+    TRACE_COUNT(TRACE_ALLOCATIONS, 1);
+    TRACE_COUNT(TRACE_ALLOCATED_BYTES, plane_size * channels);
+
+    for (int c = 0; c < 4; c++) {
+        img->planes[c] = c < channels ? (uint8_t*)block + plane_size * c : NULL;
+    }
+
+    return img;
+}
+
+// Free planar image memory (all planes share one allocation)
+void free_planar_image(PlanarImage* img) {
+    if (img) {
+        free(img->planes[0]);
+        free(img);
+    }
+}
+
+// Scalar deinterleave of one row of n-channel pixels
+static void deinterleave_row_scalar(const uint8_t* src, uint8_t* const* dst, int channels, int start, int width) {
+    for (int x = start; x < width; x++) {
+        for (int c = 0; c < channels; c++) {
+            dst[c][x] = src[x * channels + c];
+        }
+    }
+}
+
+// Scalar interleave of one row into n-channel pixels
+static void interleave_row_scalar(const uint8_t* const* src, uint8_t* dst, int channels, int start, int width) {
+    for (int x = start; x < width; x++) {
+        for (int c = 0; c < channels; c++) {
+            dst[x * channels + c] = src[c][x];
+        }
+    }
+}
+
+#ifdef HAVE_X86_DISPATCH
+// Shuffle masks for 16 pixels of n channels (n 16-byte vectors). For
+// deinterleaving, mask[p][s] pulls the bytes of plane p out of source
+// vector s; OR-ing over s gives 16 samples of plane p. Interleaving uses the
+// inverse masks, mask[s][p], to place plane p's bytes into output vector s.
+static void build_shuffle_masks(int channels, int8_t deinterleave[4][4][16], int8_t interleave[4][4][16]) {
+    for (int p = 0; p < channels; p++) {
+        for (int s = 0; s < channels; s++) {
+            for (int i = 0; i < 16; i++) {
+                int k = i * channels + p - 16 * s;
+                deinterleave[p][s][i] = (k >= 0 && k < 16) ? (int8_t)k : (int8_t)0x80;
+
+                int global = 16 * s + i;
+                interleave[s][p][i] = (global % channels == p) ? (int8_t)(global / channels) : (int8_t)0x80;
+            }
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+static void deinterleave_row_ssse3(const uint8_t* src, uint8_t* const* dst, int channels, int width,
+                                   int8_t masks[4][4][16]) {
+    __m128i m[4][4];
+    for (int p = 0; p < channels; p++) {
+        for (int s = 0; s < channels; s++) {
+            m[p][s] = _mm_loadu_si128((const __m128i*)masks[p][s]);
+        }
+    }
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i v[4];
+        for (int s = 0; s < channels; s++) {
+            v[s] = _mm_loadu_si128((const __m128i*)(src + x * channels + 16 * s));
+        }
+        for (int p = 0; p < channels; p++) {
+            __m128i plane = _mm_shuffle_epi8(v[0], m[p][0]);
+            for (int s = 1; s < channels; s++) {
+                plane = _mm_or_si128(plane, _mm_shuffle_epi8(v[s], m[p][s]));
+            }
+            _mm_storeu_si128((__m128i*)(dst[p] + x), plane);
+        }
+    }
+    deinterleave_row_scalar(src, dst, channels, x, width);
+}
+
+__attribute__((target("ssse3")))
+static void interleave_row_ssse3(const uint8_t* const* src, uint8_t* dst, int channels, int width,
+                                 int8_t masks[4][4][16]) {
+    __m128i m[4][4];
+    for (int s = 0; s < channels; s++) {
+        for (int p = 0; p < channels; p++) {
+            m[s][p] = _mm_loadu_si128((const __m128i*)masks[s][p]);
+        }
+    }
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i v[4];
+        for (int p = 0; p < channels; p++) {
+            v[p] = _mm_loadu_si128((const __m128i*)(src[p] + x));
+        }
+        for (int s = 0; s < channels; s++) {
+            __m128i out = _mm_shuffle_epi8(v[0], m[s][0]);
+            for (int p = 1; p < channels; p++) {
+                out = _mm_or_si128(out, _mm_shuffle_epi8(v[p], m[s][p]));
+            }
+            _mm_storeu_si128((__m128i*)(dst + x * channels + 16 * s), out);
+        }
+    }
+    interleave_row_scalar(src, dst, channels, x, width);
+}
+#endif
+
+// Split an interleaved image into planes (SSSE3 byte shuffles when available)
+PlanarImage* image_to_planar(const Image* input) {
+    if (!input || !input->data) {
+        return NULL;
+    }
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_CONVERT);
+    PlanarImage* output = create_planar_image(input->width, input->height, input->channels);
+    if (!output) return NULL;
+
+    int channels = input->channels;
+    const uint8_t* src = (const uint8_t*)input->data;
+    uint8_t* rows[4];
+
+#ifdef HAVE_X86_DISPATCH
+    int use_ssse3 = channels > 1 && resize_isa_allows(RESIZE_ISA_SSSE3);
+    int8_t deinterleave[4][4][16];
+    int8_t interleave[4][4][16];
+    if (use_ssse3) build_shuffle_masks(channels, deinterleave, interleave);
+#endif
+
+    for (int y = 0; y < input->height; y++) {
+        for (int c = 0; c < channels; c++) {
+            rows[c] = output->planes[c] + (size_t)y * output->stride;
+        }
+        const uint8_t* row = src + (size_t)y * input->width * channels;
+#ifdef HAVE_X86_DISPATCH
+        if (use_ssse3) {
+            deinterleave_row_ssse3(row, rows, channels, input->width, deinterleave);
+            continue;
+        }
+#endif
+        deinterleave_row_scalar(row, rows, channels, 0, input->width);
+    }
+
+    TRACE_SPAN_END(span);
+    return output;
+}
+
+// Merge planes back into an interleaved image (SSSE3 byte shuffles when available)
+Image* planar_to_image(const PlanarImage* input) {
+    if (!input || !input->planes[0]) {
+        return NULL;
+    }
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_CONVERT);
+    Image* output = create_image(input->width, input->height, input->channels);
+    if (!output) return NULL;
+
+    int channels = input->channels;
+    uint8_t* dst = (uint8_t*)output->data;
+    const uint8_t* rows[4];
+
+#ifdef HAVE_X86_DISPATCH
+    int use_ssse3 = channels > 1 && resize_isa_allows(RESIZE_ISA_SSSE3);
+    int8_t deinterleave[4][4][16];
+    int8_t interleave[4][4][16];
+    if (use_ssse3) build_shuffle_masks(channels, deinterleave, interleave);
+#endif
+
+    for (int y = 0; y < input->height; y++) {
+        for (int c = 0; c < channels; c++) {
+            rows[c] = input->planes[c] + (size_t)y * input->stride;
+        }
+        uint8_t* row = dst + (size_t)y * input->width * channels;
+#ifdef HAVE_X86_DISPATCH
+        if (use_ssse3) {
+            interleave_row_ssse3(rows, row, channels, input->width, interleave);
+            continue;
+        }
+#endif
+        interleave_row_scalar(rows, row, channels, 0, input->width);
+    }
+
+    TRACE_SPAN_END(span);
+    return output;
+}
+
+// Output image for a planar resize (same size rule as the interleaved kernels)
+static PlanarImage* create_scaled_planar(const PlanarImage* input, int32_t scale_num, int32_t scale_denom) {
+    if (!input || !input->planes[0] || scale_num <= 0 || scale_denom <= 0) {
+        return NULL;
+    }
+
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
+
+    return create_planar_image(out_width, out_height, input->channels);
+}
+
+// Horizontal lerp of one plane row through the column tables
+static void lerp_plane_row(const uint8_t* row, const int32_t* x0, const int32_t* x1, const int32_t* dx,
+                           int16_t* out, int width) {
+    for (int x = 0; x < width; x++) {
+        int32_t a = row[x0[x]];
+        int32_t b = row[x1[x]];
+        out[x] = (int16_t)(a + fixed_mult(b - a, dx[x]));
+    }
+}
+
+// Fixed-point bilinear resize, written once per plane. Uses the same
+// coordinate tables and nested lerp as resize_image_fixed's gray/RGBA kernels,
+// so results match them bit for bit; horizontally filtered rows are reused
+// while consecutive output rows share a source row.
+PlanarImage* resize_planar_fixed(const PlanarImage* input, int32_t scale_num, int32_t scale_denom) {
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    PlanarImage* output = create_scaled_planar(input, scale_num, scale_denom);
+    if (!output) return NULL;
+
+    int out_width = output->width;
+    int out_height = output->height;
+
+    ResizePlan plan;
+    int16_t* rows = (int16_t*)malloc((size_t)out_width * 2 * sizeof(int16_t));
+    if (!rows || !resize_plan_init(&plan, input->width, input->height, out_width, out_height,
+                                   1, KERNEL_BILINEAR)) {
+        free(rows);
+        free_planar_image(output);
+        return NULL;
+    }
+
+    for (int c = 0; c < input->channels; c++) {
+        const uint8_t* src = input->planes[c];
+        uint8_t* dst = output->planes[c];
+        int16_t* top = rows;
+        int16_t* bottom = rows + out_width;
+        int top_row = -1;
+        int bottom_row = -1;
+
+        for (int y = 0; y < out_height; y++) {
+            int32_t y0 = plan.y0[y];
+            int32_t y1 = plan.y1[y];
+
+            // Moving down one source row: the old bottom row becomes the top
+            if (bottom_row == y0 && top_row != y0) {
+                int16_t* t = top;
+                top = bottom;
+                bottom = t;
+                top_row = y0;
+                bottom_row = -1;
+            }
+            if (top_row != y0) {
+                lerp_plane_row(src + (size_t)y0 * input->stride, plan.x0, plan.x1, plan.dx, top, out_width);
+                top_row = y0;
+            }
+            if (bottom_row != y1) {
+                lerp_plane_row(src + (size_t)y1 * input->stride, plan.x0, plan.x1, plan.dx, bottom, out_width);
+                bottom_row = y1;
+            }
+
+            blend_rows_fixed(top, bottom, plan.dy[y], dst + (size_t)y * output->stride, out_width);
+        }
+    }
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    resize_plan_free(&plan);
+    free(rows);
+    return output;
+}
+
+// Nearest neighbor resize, written once per plane
+PlanarImage* resize_planar_nearest(const PlanarImage* input, int32_t scale_num, int32_t scale_denom) {
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    PlanarImage* output = create_scaled_planar(input, scale_num, scale_denom);
+    if (!output) return NULL;
+
+    int out_width = output->width;
+    int out_height = output->height;
+
+    ResizePlan plan;
+    if (!resize_plan_init(&plan, input->width, input->height, out_width, out_height, 1, KERNEL_NEAREST)) {
+        free_planar_image(output);
+        return NULL;
+    }
+
+    for (int c = 0; c < input->channels; c++) {
+        for (int y = 0; y < out_height; y++) {
+            const uint8_t* in_row = input->planes[c] + (size_t)plan.y0[y] * input->stride;
+            uint8_t* out_row = output->planes[c] + (size_t)y * output->stride;
+            for (int x = 0; x < out_width; x++) {
+                out_row[x] = in_row[plan.x0[x]];
+            }
+        }
+    }
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    resize_plan_free(&plan);
+    return output;
+}
+
+// Bilinear resize of an interleaved image through the planar kernels:
+// deinterleave on the way in, interleave on the way out
+Image* resize_image_planar(const Image* input, int32_t scale_num, int32_t scale_denom) {
+    PlanarImage* planar = image_to_planar(input);
+    if (!planar) return NULL;
+
+    PlanarImage* resized = resize_planar_fixed(planar, scale_num, scale_denom);
+    free_planar_image(planar);
+    if (!resized) return NULL;
+
+    Image* output = planar_to_image(resized);
+    free_planar_image(resized);
+    return output;
+}
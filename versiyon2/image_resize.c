@@ -1,11 +1,21 @@
 #include "image_resize.h"
+#include "resize_internal.h"
+#include "fixed_point.h"
+#include "resize_trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Create a new image with specified dimensions and type
 Image* create_image(int width, int height, int channels) {
-    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3)) {
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4) {
         return NULL;
     }
 
@@ -16,8 +26,9 @@ Image* create_image(int width, int height, int channels) {
     img->height = height;
     img->channels = channels;
 
-    size_t pixel_size = channels == 3 ? sizeof(PixelRGB) : sizeof(PixelGray);
-    img->data = malloc(width * height * pixel_size);
+    // Every layout is tightly packed, one byte per channel
+    size_t size = (size_t)width * height * channels * sizeof(PixelGray);
+    img->data = malloc(size);
 
     if (!img->data) {
         free(img);
@@ -25,7 +36,9 @@ Image* create_image(int width, int height, int channels) {
     }
 
     // Initialize to zero
-    memset(img->data, 0, width * height * pixel_size);
+    memset(img->data, 0, size);
+    TRACE_COUNT(TRACE_ALLOCATIONS, 1);
+    TRACE_COUNT(TRACE_ALLOCATED_BYTES, size);
 
     return img;
 }
@@ -45,155 +58,526 @@ uint8_t clamp_int(int value, uint8_t min, uint8_t max) {
     return (uint8_t)value;
 }
 
-// Fixed-point multiplication
-static inline int32_t fixed_mult(int32_t a, int32_t b) {
-    return (int32_t)(((int64_t)a * b) >> FIXED_SHIFT);
+// Output size of a num/denom scale, at least 1x1. The product is taken in
+// 64 bits, so gigapixel sources with large factors cannot overflow; returns
+// 0 when a side would not fit in an int.
+int resize_scaled_size(int width, int height, int32_t scale_num, int32_t scale_denom, int* out_width,
+                       int* out_height) {
+    if (scale_num <= 0 || scale_denom <= 0) return 0;
+    int64_t w = (int64_t)width * scale_num / scale_denom;
+    int64_t h = (int64_t)height * scale_num / scale_denom;
+    if (w > INT_MAX || h > INT_MAX) return 0;
+    *out_width = w < 1 ? 1 : (int)w;
+    *out_height = h < 1 ? 1 : (int)h;
+    return 1;
 }
 
-// Fixed-point division
-static inline int32_t fixed_div(int32_t a, int32_t b) {
-    return (int32_t)(((int64_t)a << FIXED_SHIFT) / b);
+// Fixed-point image resizing with bilinear interpolation
+Image* resize_image_fixed(const Image* input, int32_t scale_num, int32_t scale_denom) {
+    if (!input || !input->data || scale_num <= 0 || scale_denom <= 0) {
+        return NULL;
+    }
+
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
+
+    return resize_image_to(input, out_width, out_height);
 }
 
-// Extract integer part from fixed-point
-static inline int32_t fixed_int_part(int32_t value) {
-    return value >> FIXED_SHIFT;
+// Integer ratio with a dedicated kernel, or 0. The upscale fast path lerps
+// along rows and then between them, which rounds like the generic kernels
+// for every layout except RGB: bilinear_u8_3 uses the expanded formula, so
+// RGB upscales stay on the generic kernel.
+static int fast_path_factor(const Image* input, int out_width, int out_height, int* upscale) {
+    int factor = integer_scale_factor(input->width, input->height, out_width, out_height, upscale);
+    if (factor && *upscale && input->channels == 3) return 0;
+    return factor;
 }
 
-// Extract fractional part from fixed-point
-static inline int32_t fixed_frac_part(int32_t value) {
-    return value & ((1 << FIXED_SHIFT) - 1);
+// Bilinear resize to an exact output size (aspect ratio not preserved)
+Image* resize_image_to(const Image* input, int out_width, int out_height) {
+    if (!input || !input->data || out_width <= 0 || out_height <= 0) {
+        return NULL;
+    }
+
+    // Exact 2x/3x/4x ratios have dedicated kernels
+    int upscale;
+    int factor = fast_path_factor(input, out_width, out_height, &upscale);
+    if (factor) {
+        return upscale ? resize_bilinear_up(input, factor) : resize_box_down(input, factor);
+    }
+
+    // Create output image
+    Image* output = create_image(out_width, out_height, input->channels);
+    if (!output) return NULL;
+
+    // Run the kernel specialised for this channel count
+    if (!resize_with_kernel(input->data, input->width, input->height, output->data, out_width, out_height,
+                            input->channels, PIXEL_U8, KERNEL_BILINEAR)) {
+        free_image(output);
+        return NULL;
+    }
+
+    return output;
 }
 
-// Integer bilinear interpolation for grayscale
-static PixelGray bilinear_interp_gray_int(const Image* input, int32_t x_fixed, int32_t y_fixed) {
-    int32_t x = fixed_int_part(x_fixed);
-    int32_t y = fixed_int_part(y_fixed);
-
-    // Fractional parts
-    int32_t dx = fixed_frac_part(x_fixed);
-    int32_t dy = fixed_frac_part(y_fixed);
-
-    // Get four neighboring pixels (with boundary checking)
-    int32_t x0 = x;
-    int32_t y0 = y;
-    int32_t x1 = x + 1;
-    int32_t y1 = y + 1;
-
-    // Clamp coordinates to image boundaries
-    if (x0 < 0) x0 = 0;
-    if (y0 < 0) y0 = 0;
-    if (x0 >= input->width) x0 = input->width - 1;
-    if (y0 >= input->height) y0 = input->height - 1;
-
-    if (x1 < 0) x1 = 0;
-    if (y1 < 0) y1 = 0;
-    if (x1 >= input->width) x1 = input->width - 1;
-    if (y1 >= input->height) y1 = input->height - 1;
-
-    PixelGray* data = (PixelGray*)input->data;
-    int32_t p00 = data[y0 * input->width + x0];
-    int32_t p01 = data[y0 * input->width + x1];
-    int32_t p10 = data[y1 * input->width + x0];
-    int32_t p11 = data[y1 * input->width + x1];
-
-    // Interpolate using fixed-point arithmetic
-    int32_t top = p00 + fixed_mult((p01 - p00), dx);
-    int32_t bottom = p10 + fixed_mult((p11 - p10), dx);
-    int32_t value = top + fixed_mult((bottom - top), dy);
-
-    return clamp_int(value, 0, 255);
+// Bilinear resize prepared once and run in bands: the kernel (integer-ratio
+// fast path or dispatch-table kernel) and its coordinate tables are chosen
+// exactly as resize_image_to would, so the bytes match however the rows are
+// split
+struct BandedResize {
+    const Image* input;
+    Image* output;
+    int factor;                 // integer ratio, 0 for the generic kernel
+    int upscale;
+    int has_plan;
+    ResizePlan plan;
+    ResizeRowsFn kernel;
+};
+
+// Choose the kernel and tables for resizing input into output's size
+static int banded_resize_prepare(BandedResize* resize, const Image* input, Image* output) {
+    memset(resize, 0, sizeof(*resize));
+    resize->input = input;
+    resize->output = output;
+    resize->factor = fast_path_factor(input, output->width, output->height, &resize->upscale);
+
+    // Box downscales need no tables; everything else runs on a plan
+    if (!resize->factor || resize->upscale) {
+        resize->kernel = resize_kernel_lookup(PIXEL_U8, input->channels, KERNEL_BILINEAR);
+        resize->has_plan = resize->kernel &&
+                           resize_plan_init(&resize->plan, input->width, input->height, output->width,
+                                            output->height, input->channels, KERNEL_BILINEAR);
+        if (!resize->has_plan) return 0;
+    }
+    return 1;
+}
+
+BandedResize* banded_resize_create(const Image* input, int out_width, int out_height) {
+    if (!input || !input->data || out_width <= 0 || out_height <= 0) {
+        return NULL;
+    }
+
+    BandedResize* resize = (BandedResize*)malloc(sizeof(BandedResize));
+    Image* output = resize ? create_image(out_width, out_height, input->channels) : NULL;
+    if (!output || !banded_resize_prepare(resize, input, output)) {
+        if (output) free_image(output);
+        free(resize);
+        return NULL;
+    }
+    return resize;
 }
 
-// Integer bilinear interpolation for RGB
-static PixelRGB bilinear_interp_rgb_int(const Image* input, int32_t x_fixed, int32_t y_fixed) {
-    int32_t x = fixed_int_part(x_fixed);
-    int32_t y = fixed_int_part(y_fixed);
-
-    // Fractional parts
-    int32_t dx = fixed_frac_part(x_fixed);
-    int32_t dy = fixed_frac_part(y_fixed);
-
-    // Get four neighboring pixels (with boundary checking)
-    int32_t x0 = x;
-    int32_t y0 = y;
-    int32_t x1 = x + 1;
-    int32_t y1 = y + 1;
-
-    // Clamp coordinates to image boundaries
-    if (x0 < 0) x0 = 0;
-    if (y0 < 0) y0 = 0;
-    if (x0 >= input->width) x0 = input->width - 1;
-    if (y0 >= input->height) y0 = input->height - 1;
-
-    if (x1 < 0) x1 = 0;
-    if (y1 < 0) y1 = 0;
-    if (x1 >= input->width) x1 = input->width - 1;
-    if (y1 >= input->height) y1 = input->height - 1;
-
-    PixelRGB* data = (PixelRGB*)input->data;
-    PixelRGB p00 = data[y0 * input->width + x0];
-    PixelRGB p01 = data[y0 * input->width + x1];
-    PixelRGB p10 = data[y1 * input->width + x0];
-    PixelRGB p11 = data[y1 * input->width + x1];
-
-    PixelRGB result;
-
-    // Interpolate each channel separately
-    result.r = clamp_int(p00.r + fixed_mult((p01.r - p00.r), dx) +
-                        fixed_mult((p10.r - p00.r), dy) +
-                        fixed_mult((p00.r - p01.r - p10.r + p11.r), fixed_mult(dx, dy)), 0, 255);
-
-    result.g = clamp_int(p00.g + fixed_mult((p01.g - p00.g), dx) +
-                        fixed_mult((p10.g - p00.g), dy) +
-                        fixed_mult((p00.g - p01.g - p10.g + p11.g), fixed_mult(dx, dy)), 0, 255);
-
-    result.b = clamp_int(p00.b + fixed_mult((p01.b - p00.b), dx) +
-                        fixed_mult((p10.b - p00.b), dy) +
-                        fixed_mult((p00.b - p01.b - p10.b + p11.b), fixed_mult(dx, dy)), 0, 255);
-
-    return result;
+// Fill output rows [y_begin, y_end); safe to call from several threads at
+// once for disjoint ranges. Returns 0 only if scratch memory ran out.
+int banded_resize_run(const BandedResize* resize, int y_begin, int y_end) {
+    const Image* input = resize->input;
+    Image* output = resize->output;
+    if (y_begin >= y_end) return 1;
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    if (resize->factor && !resize->upscale) {
+        uint16_t* sums = (uint16_t*)malloc((size_t)input->width * input->channels * sizeof(uint16_t));
+        if (!sums) return 0;
+        box_down_rows(input, output, resize->factor, y_begin, y_end, sums);
+        free(sums);
+    } else if (resize->factor) {
+        int16_t* rows = (int16_t*)malloc(2 * (size_t)output->width * output->channels * sizeof(int16_t));
+        if (!rows) return 0;
+        bilinear_up_rows(input, output, &resize->plan, y_begin, y_end, rows);
+        free(rows);
+    } else {
+        resize->kernel(input->data, output->data, &resize->plan, y_begin, y_end);
+    }
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)output->width * (y_end - y_begin));
+    return 1;
 }
 
-// Fixed-point image resizing with bilinear interpolation
-Image* resize_image_fixed(const Image* input, int32_t scale_num, int32_t scale_denom) {
+// Release the tables and hand over the output image
+Image* banded_resize_finish(BandedResize* resize) {
+    Image* output = resize->output;
+    if (resize->has_plan) resize_plan_free(&resize->plan);
+    free(resize);
+    return output;
+}
+
+// Bilinear resize into a caller-owned output (its width and height give the
+// size, channels must match); same bytes as resize_image_to
+int resize_image_into(const Image* input, Image* output) {
+    if (!input || !input->data || !output || !output->data || output->width <= 0 || output->height <= 0 ||
+        output->channels != input->channels) {
+        return 0;
+    }
+
+    BandedResize resize;
+    if (!banded_resize_prepare(&resize, input, output)) return 0;
+    int ok = banded_resize_run(&resize, 0, output->height);
+    if (resize.has_plan) resize_plan_free(&resize.plan);
+    return ok;
+}
+
+// Premultiply one source row into 16-bit storage: colour channels hold
+// colour * alpha (0..65025), the alpha channel (last) is kept as 0..255
+static void premultiply_row(const uint8_t* src, int width, int channels, const void* ctx, uint16_t* dst) {
+    (void)ctx;
+    int alpha = channels - 1;
+    for (int x = 0; x < width; x++) {
+        uint16_t a = src[alpha];
+        for (int c = 0; c < alpha; c++) {
+            dst[c] = (uint16_t)(src[c] * a);
+        }
+        dst[alpha] = a;
+        src += channels;
+        dst += channels;
+    }
+}
+
+// Converts one 8-bit source row into the 16-bit working space of a fused pass
+typedef void (*RowConvertFn)(const uint8_t* src, int width, int channels, const void* ctx, uint16_t* dst);
+
+// Fetch converted copies of source rows y0 and y1, reusing the two cached
+// rows when possible so each source row is converted at most once per pass
+static void converted_rows(const Image* input, int y0, int y1, RowConvertFn convert, const void* ctx, uint16_t* rows[2],
+                           int cached[2], const uint16_t** r0, const uint16_t** r1) {
+    size_t stride = (size_t)input->width * input->channels;
+
+    // Keep whichever cached row is still needed in its slot
+    int keep = (cached[1] == y0 || cached[1] == y1) ? 1 : 0;
+    int other = keep ^ 1;
+
+    if (cached[keep] != y0 && cached[other] != y0) {
+        convert((const uint8_t*)input->data + y0 * stride, input->width, input->channels, ctx, rows[other]);
+        cached[other] = y0;
+    }
+    if (cached[keep] != y1 && cached[other] != y1) {
+        int slot = cached[other] == y0 ? keep : other;
+        convert((const uint8_t*)input->data + y1 * stride, input->width, input->channels, ctx, rows[slot]);
+        cached[slot] = y1;
+    }
+
+    *r0 = cached[0] == y0 ? rows[0] : rows[1];
+    *r1 = cached[0] == y1 ? rows[0] : rows[1];
+}
+
+// Bilinear resize of straight-alpha images through premultiplied space.
+// Premultiplication happens while the two source rows are fetched and the
+// division by alpha (via a Q24 reciprocal table) while the output row is
+// stored, so there are no extra full-image passes. Filtering premultiplied
+// values avoids the dark fringes straight-alpha filtering gives around
+// transparent edges.
+Image* resize_image_premultiplied(const Image* input, int32_t scale_num, int32_t scale_denom) {
     if (!input || !input->data || scale_num <= 0 || scale_denom <= 0) {
         return NULL;
     }
 
-    // Calculate output dimensions using integer math
-    int out_width = (input->width * scale_num) / scale_denom;
-    int out_height = (input->height * scale_num) / scale_denom;
+    // Without alpha there is nothing to premultiply
+    if (input->channels != 2 && input->channels != 4) {
+        return resize_image_fixed(input, scale_num, scale_denom);
+    }
 
-    // Ensure at least 1 pixel in each dimension
-    if (out_width < 1) out_width = 1;
-    if (out_height < 1) out_height = 1;
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
 
-    // Create output image
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
     Image* output = create_image(out_width, out_height, input->channels);
     if (!output) return NULL;
 
-    // Precompute fixed-point step sizes
-    int32_t x_step = fixed_div(input->width << FIXED_SHIFT, out_width << FIXED_SHIFT);
-    int32_t y_step = fixed_div(input->height << FIXED_SHIFT, out_height << FIXED_SHIFT);
+    int channels = input->channels;
+    int alpha = channels - 1;
+    size_t row_size = (size_t)input->width * channels;
+    uint16_t* buffer = (uint16_t*)malloc(2 * row_size * sizeof(uint16_t));
+    ResizePlan plan;
+    if (!buffer || !resize_plan_init(&plan, input->width, input->height, out_width, out_height,
+                                     channels, KERNEL_BILINEAR)) {
+        free(buffer);
+        free_image(output);
+        return NULL;
+    }
+    uint16_t* rows[2] = { buffer, buffer + row_size };
+    int cached[2] = { -1, -1 };
+
+    // reciprocal[a] = 2^24 / a, rounded; exact for every c * a / a
+    uint32_t reciprocal[256];
+    reciprocal[0] = 0;
+    for (int a = 1; a < 256; a++) {
+        reciprocal[a] = ((1u << 24) + a / 2) / a;
+    }
 
-    // Resize the image using fixed-point coordinates
-    int32_t y_src_fixed = 0;
+    // Same source coordinates as resize_image_fixed
+    uint8_t* out_row = (uint8_t*)output->data;
     for (int y = 0; y < out_height; y++) {
-        int32_t x_src_fixed = 0;
+        int32_t dy = plan.dy[y];
+
+        const uint16_t* r0;
+        const uint16_t* r1;
+        converted_rows(input, plan.y0[y], plan.y1[y], premultiply_row, NULL, rows, cached, &r0, &r1);
+
         for (int x = 0; x < out_width; x++) {
-            if (input->channels == 3) {
-                PixelRGB* out_data = (PixelRGB*)output->data;
-                out_data[y * out_width + x] = bilinear_interp_rgb_int(input, x_src_fixed, y_src_fixed);
+            int32_t dx = plan.dx[x];
+            const uint16_t* p00 = r0 + plan.x0[x] * channels;
+            const uint16_t* p01 = r0 + plan.x1[x] * channels;
+            const uint16_t* p10 = r1 + plan.x0[x] * channels;
+            const uint16_t* p11 = r1 + plan.x1[x] * channels;
+            uint8_t* out = out_row + x * channels;
+
+            int32_t values[4];
+            for (int c = 0; c < channels; c++) {
+                int32_t top = p00[c] + fixed_mult((p01[c] - p00[c]), dx);
+                int32_t bottom = p10[c] + fixed_mult((p11[c] - p10[c]), dx);
+                values[c] = top + fixed_mult((bottom - top), dy);
+            }
+
+            // Unpremultiply on store
+            uint8_t a = clamp_int(values[alpha], 0, 255);
+            for (int c = 0; c < alpha; c++) {
+                uint32_t premul = values[c] > 0 ? (uint32_t)values[c] : 0;
+                uint32_t value = (uint32_t)(((uint64_t)premul * reciprocal[a] + (1u << 23)) >> 24);
+                out[c] = value > 255 ? 255 : (uint8_t)value;
+            }
+            out[alpha] = a;
+        }
+        out_row += (size_t)out_width * channels;
+    }
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    resize_plan_free(&plan);
+    free(buffer);
+    return output;
+}
+
+// Linear light is carried in 12 bits: 256 sRGB codes map exactly onto
+// 0..4095 and the 4096-entry inverse table maps every one of them back
+#define LINEAR_BITS 12
+#define LINEAR_MAX ((1 << LINEAR_BITS) - 1)
+
+static uint16_t srgb_to_linear_table[256];
+static uint8_t linear_to_srgb_table[LINEAR_MAX + 1];
+static pthread_once_t srgb_tables_once = PTHREAD_ONCE_INIT;
+
+// Build both transfer tables once; powf is only ever called here
+static void init_srgb_tables(void) {
+    for (int i = 0; i < 256; i++) {
+        float v = i / 255.0f;
+        float linear = v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+        srgb_to_linear_table[i] = (uint16_t)lrintf(linear * LINEAR_MAX);
+    }
+    for (int i = 0; i <= LINEAR_MAX; i++) {
+        float linear = (float)i / LINEAR_MAX;
+        float v = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+        linear_to_srgb_table[i] = (uint8_t)lrintf(v * 255.0f);
+    }
+}
+
+// Row converter context for the linear path: the plan, plus one source row
+// of 12-bit linear samples
+typedef struct {
+    const ResizePlan* plan;
+    uint16_t* source;
+} LinearRows;
+
+// Decode one sRGB source row to 12-bit linear; alpha (2 and 4 channels) is
+// already linear and stays 0..255. Every source sample goes through the
+// table once, however many output pixels read it.
+static inline __attribute__((always_inline))
+void linear_source_row(const uint8_t* src, int width, uint16_t* dst, int channels) {
+    const uint16_t* lut = srgb_to_linear_table;
+    // RGBA a whole pixel at a time, written with one 8-byte copy rather
+    // than four 16-bit stores; plain C, so every ISA level takes it
+    if (channels == 4) {
+        for (int x = 0; x < width; x++) {
+            const uint8_t* s = src + x * 4;
+            uint16_t pixel[4] = { lut[s[0]], lut[s[1]], lut[s[2]], s[3] };
+            memcpy(dst + x * 4, pixel, sizeof(pixel));
+        }
+        return;
+    }
+    if (channels == 2) {
+        for (int x = 0; x < width; x++) {
+            dst[2 * x] = lut[src[2 * x]];
+            dst[2 * x + 1] = src[2 * x + 1];
+        }
+    } else {
+        for (int i = 0; i < width * channels; i++) {
+            dst[i] = lut[src[i]];
+        }
+    }
+}
+
+// Decode one sRGB source row to linear, then resample it horizontally from
+// the 16-bit row. The constant channel count lets the compiler unroll each
+// case.
+static inline __attribute__((always_inline))
+void linearize_row_n(const uint8_t* src, int width, const LinearRows* ctx, uint16_t* dst, int channels) {
+    const ResizePlan* plan = ctx->plan;
+    const uint16_t* row = ctx->source;
+    linear_source_row(src, width, ctx->source, channels);
+
+    int x = 0;
+#if defined(__SSE2__)
+    // Two RGBA or four gray+alpha pixels per register, each loaded whole
+    // from the linear row. The signed mulhi plus the diff-where-dx-has-bit-15
+    // correction is exactly fixed_mult for dx < 1.0.
+    if (channels == 4 && resize_isa_allows(RESIZE_ISA_SSE2)) {
+        for (; x + 2 <= plan->out_width; x += 2) {
+            __m128i p0 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(row + plan->x0[x] * 4)),
+                                            _mm_loadl_epi64((const __m128i*)(row + plan->x0[x + 1] * 4)));
+            __m128i p1 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(row + plan->x1[x] * 4)),
+                                            _mm_loadl_epi64((const __m128i*)(row + plan->x1[x + 1] * 4)));
+            __m128i vdx = _mm_unpacklo_epi64(_mm_set1_epi16((int16_t)plan->dx[x]),
+                                             _mm_set1_epi16((int16_t)plan->dx[x + 1]));
+            __m128i d = _mm_sub_epi16(p1, p0);
+            __m128i m = _mm_add_epi16(_mm_mulhi_epi16(d, vdx), _mm_and_si128(d, _mm_srai_epi16(vdx, 15)));
+            _mm_storeu_si128((__m128i*)dst, _mm_add_epi16(p0, m));
+            dst += 8;
+        }
+    }
+#endif
+    for (; x < plan->out_width; x++) {
+        const uint16_t* s0 = row + plan->x0[x] * channels;
+        const uint16_t* s1 = row + plan->x1[x] * channels;
+        int32_t dx = plan->dx[x];
+        for (int c = 0; c < channels; c++) {
+            dst[c] = (uint16_t)(s0[c] + fixed_mult(s1[c] - s0[c], dx));
+        }
+        dst += channels;
+    }
+}
+
+static void linearize_row(const uint8_t* src, int width, int channels, const void* ctx, uint16_t* dst) {
+    const LinearRows* rows = (const LinearRows*)ctx;
+    switch (channels) {
+        case 1: linearize_row_n(src, width, rows, dst, 1); break;
+        case 2: linearize_row_n(src, width, rows, dst, 2); break;
+        case 3: linearize_row_n(src, width, rows, dst, 3); break;
+        default: linearize_row_n(src, width, rows, dst, 4); break;
+    }
+}
+
+// Re-encode one RGBA pixel held as four 16-bit lanes (two 32-bit halves)
+static inline uint32_t encode_rgba(uint32_t rg, uint32_t ba) {
+    const uint8_t* table = linear_to_srgb_table;
+    return table[rg & 0xffff] | (uint32_t)table[rg >> 16] << 8 | (uint32_t)table[ba & 0xffff] << 16 |
+           (ba >> 16) << 24;
+}
+
+// Vertical blend of two horizontally resampled linear rows, re-encoded to sRGB on store
+static inline __attribute__((always_inline))
+void encode_row_n(const uint16_t* r0, const uint16_t* r1, int32_t dy, uint8_t* out, int width, int channels) {
+    int colors = (channels == 2 || channels == 4) ? channels - 1 : channels;
+    int x = 0;
+#if defined(__SSE2__)
+    // Blend eight samples at a time (same mulhi correction as blend_rows_fixed),
+    // then encode through the table; eight lanes hold whole 2- and 4-channel pixels
+    if ((channels == 2 || channels == 4) && resize_isa_allows(RESIZE_ISA_SSE2)) {
+        int per_block = 8 / channels;
+        __m128i vdy = _mm_set1_epi16((int16_t)dy);
+        __m128i fix = _mm_set1_epi16(dy >= 0x8000 ? -1 : 0);
+        uint16_t blended[8];
+        for (; x + per_block <= width; x += per_block) {
+            __m128i t = _mm_loadu_si128((const __m128i*)r0);
+            __m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)r1), t);
+            __m128i v = _mm_add_epi16(t, _mm_add_epi16(_mm_mulhi_epi16(d, vdy), _mm_and_si128(d, fix)));
+            if (channels == 4) {
+                // Lanes leave through general registers and both pixels are
+                // stored at once, rather than byte by byte
+                uint64_t pixels = encode_rgba((uint32_t)_mm_cvtsi128_si32(v),
+                                              (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 4))) |
+                                  (uint64_t)encode_rgba((uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 8)),
+                                                        (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 12))) << 32;
+                memcpy(out, &pixels, sizeof(pixels));
             } else {
-                PixelGray* out_data = (PixelGray*)output->data;
-                out_data[y * out_width + x] = bilinear_interp_gray_int(input, x_src_fixed, y_src_fixed);
+                _mm_storeu_si128((__m128i*)blended, v);
+                for (int i = 0; i < 8; i++) {
+                    out[i] = i % channels < colors ? linear_to_srgb_table[blended[i]] : (uint8_t)blended[i];
+                }
             }
-            x_src_fixed += x_step;
+            r0 += 8;
+            r1 += 8;
+            out += 8;
         }
-        y_src_fixed += y_step;
+    }
+#endif
+    for (; x < width; x++) {
+        for (int c = 0; c < channels; c++) {
+            int32_t top = r0[c];
+            int32_t value = top + fixed_mult(r1[c] - top, dy);
+            out[c] = c < colors ? linear_to_srgb_table[value] : (uint8_t)value;
+        }
+        r0 += channels;
+        r1 += channels;
+        out += channels;
+    }
+}
+
+static void encode_row(const uint16_t* r0, const uint16_t* r1, int32_t dy, uint8_t* out, int width, int channels) {
+    switch (channels) {
+        case 1: encode_row_n(r0, r1, dy, out, width, 1); break;
+        case 2: encode_row_n(r0, r1, dy, out, width, 2); break;
+        case 3: encode_row_n(r0, r1, dy, out, width, 3); break;
+        default: encode_row_n(r0, r1, dy, out, width, 4); break;
+    }
+}
+
+// Gamma-correct bilinear resize: source rows are decoded to 12-bit linear
+// light through a 256-entry table and resampled horizontally as they are
+// fetched, blended vertically in Q16, and re-encoded through a 4096-entry
+// table as each output row is stored. All of it happens in the one pass, so
+// downscaled high-contrast detail keeps its brightness without any per-pixel
+// powf. Coordinates and rounding match resize_image_fixed.
+Image* resize_image_linear(const Image* input, int32_t scale_num, int32_t scale_denom) {
+    if (!input || !input->data || scale_num <= 0 || scale_denom <= 0) {
+        return NULL;
+    }
+
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    Image* output = create_image(out_width, out_height, input->channels);
+    if (!output) return NULL;
+
+    int channels = input->channels;
+    size_t row_size = (size_t)out_width * channels;
+    size_t source_size = (size_t)input->width * channels;
+    uint16_t* buffer = (uint16_t*)malloc((2 * row_size + source_size) * sizeof(uint16_t));
+    ResizePlan plan;
+    if (!buffer || !resize_plan_init(&plan, input->width, input->height, out_width, out_height,
+                                     channels, KERNEL_BILINEAR)) {
+        free(buffer);
+        free_image(output);
+        return NULL;
+    }
+    uint16_t* rows[2] = { buffer, buffer + row_size };
+    int cached[2] = { -1, -1 };
+    LinearRows linear = { &plan, buffer + 2 * row_size };
+
+    pthread_once(&srgb_tables_once, init_srgb_tables);
+
+    // Linear values are convex blends of 0..4095 table entries, so the
+    // encode table is always indexed in range without clamping
+    uint8_t* out_row = (uint8_t*)output->data;
+    for (int y = 0; y < out_height; y++) {
+        const uint16_t* r0;
+        const uint16_t* r1;
+        converted_rows(input, plan.y0[y], plan.y1[y], linearize_row, &linear, rows, cached, &r0, &r1);
+        encode_row(r0, r1, plan.dy[y], out_row, out_width, channels);
+        out_row += row_size;
     }
 
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    resize_plan_free(&plan);
+    free(buffer);
     return output;
 }
 
@@ -203,41 +587,25 @@ Image* resize_image_nearest(const Image* input, int32_t scale_num, int32_t scale
         return NULL;
     }
 
-    int out_width = (input->width * scale_num) / scale_denom;
-    int out_height = (input->height * scale_num) / scale_denom;
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
 
-    // Ensure at least 1 pixel in each dimension
-    if (out_width < 1) out_width = 1;
-    if (out_height < 1) out_height = 1;
+    // Exact 2x/3x/4x ratios are plain strided copies or replication
+    int upscale;
+    int factor = integer_scale_factor(input->width, input->height, out_width, out_height, &upscale);
+    if (factor) {
+        return resize_nearest_integer(input, factor, upscale);
+    }
 
     Image* output = create_image(out_width, out_height, input->channels);
     if (!output) return NULL;
 
-    // Precompute step sizes
-    int32_t x_ratio = (input->width << FIXED_SHIFT) / out_width;
-    int32_t y_ratio = (input->height << FIXED_SHIFT) / out_height;
-
-    for (int y = 0; y < out_height; y++) {
-        for (int x = 0; x < out_width; x++) {
-            int32_t src_x = (x * x_ratio) >> FIXED_SHIFT;
-            int32_t src_y = (y * y_ratio) >> FIXED_SHIFT;
-
-            // Clamp coordinates
-            if (src_x < 0) src_x = 0;
-            if (src_y < 0) src_y = 0;
-            if (src_x >= input->width) src_x = input->width - 1;
-            if (src_y >= input->height) src_y = input->height - 1;
-
-            if (input->channels == 3) {
-                PixelRGB* in_data = (PixelRGB*)input->data;
-                PixelRGB* out_data = (PixelRGB*)output->data;
-                out_data[y * out_width + x] = in_data[src_y * input->width + src_x];
-            } else {
-                PixelGray* in_data = (PixelGray*)input->data;
-                PixelGray* out_data = (PixelGray*)output->data;
-                out_data[y * out_width + x] = in_data[src_y * input->width + src_x];
-            }
-        }
+    if (!resize_with_kernel(input->data, input->width, input->height, output->data, out_width, out_height,
+                            input->channels, PIXEL_U8, KERNEL_NEAREST)) {
+        free_image(output);
+        return NULL;
     }
 
     return output;
@@ -248,24 +616,71 @@ Image* create_test_pattern(int width, int height, int channels) {
     Image* img = create_image(width, height, channels);
     if (!img) return NULL;
 
-    if (channels == 3) {
-        PixelRGB* data = (PixelRGB*)img->data;
+    if (channels >= 3) {
+        uint8_t* data = (uint8_t*)img->data;
         for (int y = 0; y < height; y++) {
             for (int x = 0; x < width; x++) {
-                int index = y * width + x;
-                data[index].r = (x * 255) / width;
-                data[index].g = (y * 255) / height;
-                data[index].b = ((x + y) * 255) / (width + height);
+                uint8_t* p = data + (y * width + x) * channels;
+                p[0] = (x * 255) / width;
+                p[1] = (y * 255) / height;
+                p[2] = ((x + y) * 255) / (width + height);
+                // Alpha fades out towards the right edge
+                if (channels == 4) p[3] = 255 - (x * 255) / width;
             }
         }
     } else {
-        PixelGray* data = (PixelGray*)img->data;
+        uint8_t* data = (uint8_t*)img->data;
         for (int y = 0; y < height; y++) {
             for (int x = 0; x < width; x++) {
-                data[y * width + x] = ((x + y) * 255) / (width + height);
+                uint8_t* p = data + (y * width + x) * channels;
+                p[0] = ((x + y) * 255) / (width + height);
+                if (channels == 2) p[1] = 255 - (x * 255) / width;
             }
         }
     }
 
     return img;
 }
+
+// Widen RGB to RGBX with opaque alpha
+Image* convert_rgb_to_rgbx(const Image* input) {
+    if (!input || !input->data || input->channels != 3) {
+        return NULL;
+    }
+
+    Image* output = create_image(input->width, input->height, 4);
+    if (!output) return NULL;
+
+    const PixelRGB* in_data = (const PixelRGB*)input->data;
+    PixelRGBA* out_data = (PixelRGBA*)output->data;
+    size_t count = (size_t)input->width * input->height;
+    for (size_t i = 0; i < count; i++) {
+        out_data[i].r = in_data[i].r;
+        out_data[i].g = in_data[i].g;
+        out_data[i].b = in_data[i].b;
+        out_data[i].a = 255;
+    }
+
+    return output;
+}
+
+// Narrow RGBX (or RGBA) back to RGB by dropping the fourth channel
+Image* convert_rgbx_to_rgb(const Image* input) {
+    if (!input || !input->data || input->channels != 4) {
+        return NULL;
+    }
+
+    Image* output = create_image(input->width, input->height, 3);
+    if (!output) return NULL;
+
+    const PixelRGBA* in_data = (const PixelRGBA*)input->data;
+    PixelRGB* out_data = (PixelRGB*)output->data;
+    size_t count = (size_t)input->width * input->height;
+    for (size_t i = 0; i < count; i++) {
+        out_data[i].r = in_data[i].r;
+        out_data[i].g = in_data[i].g;
+        out_data[i].b = in_data[i].b;
+    }
+
+    return output;
+}
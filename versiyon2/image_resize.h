@@ -1,6 +1,7 @@
 #ifndef IMAGE_RESIZE_H
 #define IMAGE_RESIZE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Fixed-point precision (Q16.16 format)
@@ -12,26 +13,182 @@ typedef struct {
     uint8_t r, g, b;
 } PixelRGB;
 
+// Define a structure for RGBA pixels (straight, non-premultiplied alpha)
+typedef struct {
+    uint8_t r, g, b, a;
+} PixelRGBA;
+
 // Define a structure for grayscale pixels
 typedef uint8_t PixelGray;
 
-// Define an image structure that can handle both RGB and grayscale
+// Define a structure for grayscale + alpha pixels
 typedef struct {
-    void* data;         // Pointer to pixel data
+    uint8_t v, a;
+} PixelGrayAlpha;
+
+// Define an image structure that can handle grayscale, RGB and their alpha variants
+typedef struct {
+    void* data;         // Pointer to pixel data (tightly packed, channels bytes per pixel)
     int width;          // Image width
     int height;         // Image height
-    int channels;       // Number of channels (1 for grayscale, 3 for RGB)
+    int channels;       // Number of channels (1 gray, 2 gray+alpha, 3 RGB, 4 RGBA)
 } Image;
 
+// Define a 16-bit-per-channel sample (print / medical PNGs)
+typedef uint16_t PixelGray16;
+
+// Image with 16 bits per channel, same layout rules as Image
+typedef struct {
+    void* data;         // Pointer to pixel data (channels PixelGray16 values per pixel)
+    int width;          // Image width
+    int height;         // Image height
+    int channels;       // Number of channels (1 gray, 2 gray+alpha, 3 RGB, 4 RGBA)
+} Image16;
+
+// Planar 8-bit image: one 32-byte aligned plane per channel, rows padded
+// to a multiple of 32 bytes. Used internally so kernels work per channel.
+typedef struct {
+    uint8_t* planes[4]; // One plane per channel (unused entries are NULL)
+    int width;          // Image width
+    int height;         // Image height
+    int channels;       // Number of channels (1-4)
+    int stride;         // Bytes per plane row (>= width)
+} PlanarImage;
+
+// Planar float image for HDR / linear-light data. Each channel is its own
+// 32-byte aligned plane whose rows are padded to a multiple of 8 floats.
+typedef struct {
+    float* planes[4];   // One plane per channel (unused entries are NULL)
+    int width;          // Image width
+    int height;         // Image height
+    int channels;       // Number of channels (1-4)
+    int stride;         // Floats per plane row (>= width)
+} ImageF32;
+
 // Function declarations
 Image* create_image(int width, int height, int channels);
 void free_image(Image* img);
+// Output size every num/denom entry point uses; 0 if it would overflow an int
+int resize_scaled_size(int width, int height, int32_t scale_num, int32_t scale_denom, int* out_width,
+                       int* out_height);
 Image* resize_image_fixed(const Image* input, int32_t scale_num, int32_t scale_denom);
+Image* resize_image_to(const Image* input, int out_width, int out_height);
+int resize_image_into(const Image* input, Image* output);
 Image* resize_image_nearest(const Image* input, int32_t scale_num, int32_t scale_denom);
+Image* resize_image_premultiplied(const Image* input, int32_t scale_num, int32_t scale_denom);
+Image* resize_image_linear(const Image* input, int32_t scale_num, int32_t scale_denom);
 Image* create_test_pattern(int width, int height, int channels);
 Image* load_image(const char* filename);
 int save_image(const Image* img, const char* filename);
 
+// Bilinear resize split into bands of output rows that can run on different
+// threads at once; the finished image equals resize_image_to's. The input
+// must stay alive until banded_resize_finish.
+typedef struct BandedResize BandedResize;
+BandedResize* banded_resize_create(const Image* input, int out_width, int out_height);
+int banded_resize_run(const BandedResize* resize, int y_begin, int y_end);
+Image* banded_resize_finish(BandedResize* resize);
+
+// Wall time spent in each stage of load -> resize -> save, in seconds
+typedef struct {
+    double decode;      // stb_image decode
+    double copy;        // copy of the decoded pixels into the Image
+    double resize;
+    double filter;      // PNG per-row filter selection
+    double deflate;     // zlib compression and chunk CRCs
+    double write;       // file write
+} PipelineTimes;
+
+// load_image / save_image without console output, adding each stage's time
+// to times unless it is NULL
+Image* load_image_timed(const char* filename, PipelineTimes* times);
+int save_image_timed(const Image* img, const char* filename, PipelineTimes* times);
+
+// Quiet decode of an encoded file held in memory, and the PNG bytes
+// save_image would write (free() them)
+Image* load_image_from_memory(const unsigned char* bytes, size_t len);
+unsigned char* encode_image_png(const Image* img, int* out_len);
+
+// Caller-owned output buffer for encoded files, grown as needed and
+// reusable across images: start it zeroed, free(bytes) when done. The
+// bytes are page-aligned, so they can be written with O_DIRECT.
+typedef struct {
+    unsigned char* bytes;
+    size_t len;         // encoded bytes
+    size_t capacity;
+} EncodedBuffer;
+
+// PNG bytes save_image would write, assembled straight into buffer (for
+// network responses); returns 1 on success
+int encode_image_png_into(const Image* img, EncodedBuffer* buffer);
+
+// Quietly write an encoded buffer to filename with a single pwrite. With
+// direct set, outputs of 1 MB and more bypass the page cache (O_DIRECT)
+// where the file system supports it. Returns 1 on success.
+int write_encoded_file(const EncodedBuffer* buffer, const char* filename, int direct);
+
+// 16-bit-per-channel images
+Image16* create_image16(int width, int height, int channels);
+void free_image16(Image16* img);
+Image16* resize_image16_fixed(const Image16* input, int32_t scale_num, int32_t scale_denom);
+Image16* resize_image16_nearest(const Image16* input, int32_t scale_num, int32_t scale_denom);
+Image16* resize_image16_area(const Image16* input, int32_t scale_num, int32_t scale_denom);
+int image_is_16_bit(const char* filename);
+Image16* load_image16(const char* filename);
+int save_image16(const Image16* img, const char* filename);
+
+// Separable convolution filters for resize_image_filter
+typedef enum {
+    FILTER_CATMULL_ROM,     // Bicubic, B = 0, C = 1/2
+    FILTER_MITCHELL,        // Bicubic, B = C = 1/3
+    FILTER_LANCZOS2,        // Windowed sinc, 2 lobes
+    FILTER_LANCZOS3         // Windowed sinc, 3 lobes
+} ResizeFilter;
+
+// Planar (SoA) images and per-plane kernels
+PlanarImage* create_planar_image(int width, int height, int channels);
+void free_planar_image(PlanarImage* img);
+PlanarImage* image_to_planar(const Image* input);
+Image* planar_to_image(const PlanarImage* input);
+PlanarImage* resize_planar_fixed(const PlanarImage* input, int32_t scale_num, int32_t scale_denom);
+PlanarImage* resize_planar_nearest(const PlanarImage* input, int32_t scale_num, int32_t scale_denom);
+Image* resize_image_planar(const Image* input, int32_t scale_num, int32_t scale_denom);
+PlanarImage* resize_planar_filter(const PlanarImage* input, int32_t scale_num, int32_t scale_denom, ResizeFilter filter);
+Image* resize_image_filter(const Image* input, int32_t scale_num, int32_t scale_denom, ResizeFilter filter);
+
+// Float (HDR) images
+ImageF32* create_image_f32(int width, int height, int channels);
+void free_image_f32(ImageF32* img);
+void image_f32_from_interleaved(ImageF32* img, const float* data);
+void image_f32_to_interleaved(const ImageF32* img, float* data);
+ImageF32* resize_image_f32(const ImageF32* input, int32_t scale_num, int32_t scale_denom);
+int image_is_hdr(const char* filename);
+ImageF32* load_image_f32(const char* filename);
+int save_image_hdr(const ImageF32* img, const char* filename);
+
+// Widen RGB to RGBX (alpha = 255) so it can take the 32-bit-per-pixel fast path,
+// and narrow the result back to RGB afterwards
+Image* convert_rgb_to_rgbx(const Image* input);
+Image* convert_rgbx_to_rgb(const Image* input);
+
+// Instruction-set levels the kernels may use, lowest first
+typedef enum {
+    RESIZE_ISA_SCALAR,      // Portable C only
+    RESIZE_ISA_SSE2,
+    RESIZE_ISA_SSSE3,
+    RESIZE_ISA_AVX2,        // AVX2 + FMA
+    RESIZE_ISA_NATIVE       // Everything the CPU supports (default)
+} ResizeIsa;
+
+// Cap the SIMD level used by every kernel (for verification and comparisons;
+// not to be changed while resizes are running)
+void resize_set_isa_limit(ResizeIsa isa);
+ResizeIsa resize_get_isa_limit(void);
+
+// Run every kernel variant against its scalar reference; returns the number
+// of mismatching cases (0 when everything is bit-exact)
+int resize_self_check(int verbose);
+
 // Helper functions
 uint8_t clamp_int(int value, uint8_t min, uint8_t max);
 
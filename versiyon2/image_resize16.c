@@ -0,0 +1,206 @@
+#include "image_resize.h"
+#include "resize_internal.h"
+#include "resize_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Create a new 16-bit image with specified dimensions and type
+Image16* create_image16(int width, int height, int channels) {
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+        return NULL;
+    }
+
+    Image16* img = (Image16*)malloc(sizeof(Image16));
+    if (!img) return NULL;
+
+    img->width = width;
+    img->height = height;
+    img->channels = channels;
+
+    size_t size = (size_t)width * height * channels * sizeof(PixelGray16);
+    img->data = malloc(size);
+
+    if (!img->data) {
+        free(img);
+        return NULL;
+    }
+
+    // Initialize to zero
+    memset(img->data, 0, size);
+    TRACE_COUNT(TRACE_ALLOCATIONS, 1);
+    TRACE_COUNT(TRACE_ALLOCATED_BYTES, size);
+
+    return img;
+}
+
+// Free 16-bit image memory
+void free_image16(Image16* img) {
+    if (img) {
+        free(img->data);
+        free(img);
+    }
+}
+
+// Output size shared by all 16-bit kernels (same rule as the 8-bit ones)
+static Image16* create_scaled_image16(const Image16* input, int32_t scale_num, int32_t scale_denom) {
+    if (!input || !input->data || scale_num <= 0 || scale_denom <= 0) {
+        return NULL;
+    }
+
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
+
+    return create_image16(out_width, out_height, input->channels);
+}
+
+// Fixed-point bilinear resize of a 16-bit image. Sample differences reach
+// 17 bits and weights 16 bits, so fixed_mult's 64-bit product is what gives
+// the headroom; nothing goes through float.
+Image16* resize_image16_fixed(const Image16* input, int32_t scale_num, int32_t scale_denom) {
+    Image16* output = create_scaled_image16(input, scale_num, scale_denom);
+    if (!output) return NULL;
+
+    if (!resize_with_kernel(input->data, input->width, input->height, output->data, output->width, output->height,
+                            input->channels, PIXEL_U16, KERNEL_BILINEAR)) {
+        free_image16(output);
+        return NULL;
+    }
+
+    return output;
+}
+
+// Nearest neighbor resize of a 16-bit image
+Image16* resize_image16_nearest(const Image16* input, int32_t scale_num, int32_t scale_denom) {
+    Image16* output = create_scaled_image16(input, scale_num, scale_denom);
+    if (!output) return NULL;
+
+    if (!resize_with_kernel(input->data, input->width, input->height, output->data, output->width, output->height,
+                            input->channels, PIXEL_U16, KERNEL_NEAREST)) {
+        free_image16(output);
+        return NULL;
+    }
+
+    return output;
+}
+
+// Source pixels covering one output pixel along an axis
+typedef struct {
+    int start;          // First contributing source pixel
+    int count;          // Number of contributing source pixels
+    int offset;         // Index of the first weight in the shared weight array
+} AreaSpan;
+
+// Build exact integer coverage weights along one axis. In units where a
+// source pixel is out_size wide and an output pixel is in_size wide, output
+// pixel o covers [o*in_size, (o+1)*in_size) and each weight is the integer
+// overlap with a source pixel, so the weights of every span sum to in_size.
+static int build_area_spans(int in_size, int out_size, AreaSpan** spans_out, uint32_t** weights_out) {
+    // No span covers more than ceil(in/out) + 1 source pixels
+    int max_count = in_size / out_size + 2;
+    AreaSpan* spans = (AreaSpan*)malloc((size_t)out_size * sizeof(AreaSpan));
+    uint32_t* weights = (uint32_t*)malloc((size_t)out_size * max_count * sizeof(uint32_t));
+    if (!spans || !weights) {
+        free(spans);
+        free(weights);
+        return 0;
+    }
+
+    int offset = 0;
+    for (int o = 0; o < out_size; o++) {
+        int64_t begin = (int64_t)o * in_size;
+        int64_t end = begin + in_size;
+        int first = (int)(begin / out_size);
+        int last = (int)((end - 1) / out_size);
+
+        spans[o].start = first;
+        spans[o].count = last - first + 1;
+        spans[o].offset = offset;
+        for (int i = first; i <= last; i++) {
+            int64_t lo = (int64_t)i * out_size;
+            int64_t hi = lo + out_size;
+            if (lo < begin) lo = begin;
+            if (hi > end) hi = end;
+            weights[offset++] = (uint32_t)(hi - lo);
+        }
+    }
+
+    *spans_out = spans;
+    *weights_out = weights;
+    return 1;
+}
+
+// Area (box) resampling of a 16-bit image: each output pixel is the
+// coverage-weighted mean of the source pixels under it. Sums are kept in
+// 64 bits (65535 * in_width * in_height fits comfortably) and divided once
+// with rounding at the end.
+Image16* resize_image16_area(const Image16* input, int32_t scale_num, int32_t scale_denom) {
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    Image16* output = create_scaled_image16(input, scale_num, scale_denom);
+    if (!output) return NULL;
+
+    int channels = input->channels;
+    int out_width = output->width;
+    int out_height = output->height;
+
+    AreaSpan* x_spans = NULL;
+    AreaSpan* y_spans = NULL;
+    uint32_t* x_weights = NULL;
+    uint32_t* y_weights = NULL;
+    uint64_t* acc = (uint64_t*)malloc((size_t)out_width * channels * sizeof(uint64_t));
+    if (!acc ||
+        !build_area_spans(input->width, out_width, &x_spans, &x_weights) ||
+        !build_area_spans(input->height, out_height, &y_spans, &y_weights)) {
+        free(acc);
+        free(x_spans);
+        free(x_weights);
+        free_image16(output);
+        return NULL;
+    }
+
+    uint64_t total = (uint64_t)input->width * input->height;
+    const PixelGray16* in_data = (const PixelGray16*)input->data;
+    PixelGray16* out_data = (PixelGray16*)output->data;
+
+    for (int y = 0; y < out_height; y++) {
+        memset(acc, 0, (size_t)out_width * channels * sizeof(uint64_t));
+
+        const AreaSpan* ys = &y_spans[y];
+        for (int j = 0; j < ys->count; j++) {
+            uint64_t wy = y_weights[ys->offset + j];
+            const PixelGray16* row = in_data + (size_t)(ys->start + j) * input->width * channels;
+
+            for (int x = 0; x < out_width; x++) {
+                const AreaSpan* xs = &x_spans[x];
+                const PixelGray16* p = row + (size_t)xs->start * channels;
+                uint64_t sums[4] = { 0, 0, 0, 0 };
+                for (int i = 0; i < xs->count; i++) {
+                    uint64_t wx = x_weights[xs->offset + i];
+                    for (int c = 0; c < channels; c++) {
+                        sums[c] += wx * p[c];
+                    }
+                    p += channels;
+                }
+                for (int c = 0; c < channels; c++) {
+                    acc[x * channels + c] += sums[c] * wy;
+                }
+            }
+        }
+
+        PixelGray16* out = out_data + (size_t)y * out_width * channels;
+        for (int i = 0; i < out_width * channels; i++) {
+            out[i] = (PixelGray16)((acc[i] + total / 2) / total);
+        }
+    }
+
+    free(acc);
+    free(x_spans);
+    free(x_weights);
+    free(y_spans);
+    free(y_weights);
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    return output;
+}
@@ -0,0 +1,211 @@
+#include "image_resize.h"
+#include "resize_internal.h"
+#include "resize_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_DISPATCH 1
+#endif
+
+// Planes are padded to whole 32-byte vectors and 32-byte aligned
+#define F32_ALIGN 32
+#define F32_LANES 8
+
+// Create a planar float image; every plane row is padded to a multiple of 8 floats
+ImageF32* create_image_f32(int width, int height, int channels) {
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+        return NULL;
+    }
+
+    ImageF32* img = (ImageF32*)malloc(sizeof(ImageF32));
+    if (!img) return NULL;
+
+    img->width = width;
+    img->height = height;
+    img->channels = channels;
+    img->stride = (width + F32_LANES - 1) / F32_LANES * F32_LANES;
+
+    size_t plane_size = (size_t)img->stride * height;
+    void* block = NULL;
+    if (posix_memalign(&block, F32_ALIGN, plane_size * channels * sizeof(float)) != 0) {
+        free(img);
+        return NULL;
+    }
+
+    // Initialize to zero (padding included, so vector tails read defined values)
+    memset(block, 0, plane_size * channels * sizeof(float));
+    TRACE_COUNT(TRACE_ALLOCATIONS, 1);
+    TRACE_COUNT(TRACE_ALLOCATED_BYTES, plane_size * channels * sizeof(float));
+
+    for (int c = 0; c < 4; c++) {
+        img->planes[c] = c < channels ? (float*)block + plane_size * c : NULL;
+    }
+
+    return img;
+}
+
+// Free float image memory (all planes share one allocation)
+void free_image_f32(ImageF32* img) {
+    if (img) {
+        free(img->planes[0]);
+        free(img);
+    }
+}
+
+// Split interleaved floats (as returned by stbi_loadf) into planes
+void image_f32_from_interleaved(ImageF32* img, const float* data) {
+    int channels = img->channels;
+    for (int y = 0; y < img->height; y++) {
+        const float* src = data + (size_t)y * img->width * channels;
+        for (int c = 0; c < channels; c++) {
+            float* dst = img->planes[c] + (size_t)y * img->stride;
+            for (int x = 0; x < img->width; x++) {
+                dst[x] = src[x * channels + c];
+            }
+        }
+    }
+}
+
+// Merge planes back into interleaved floats (as expected by stbi_write_hdr)
+void image_f32_to_interleaved(const ImageF32* img, float* data) {
+    int channels = img->channels;
+    for (int y = 0; y < img->height; y++) {
+        float* dst = data + (size_t)y * img->width * channels;
+        for (int c = 0; c < channels; c++) {
+            const float* src = img->planes[c] + (size_t)y * img->stride;
+            for (int x = 0; x < img->width; x++) {
+                dst[x * channels + c] = src[x];
+            }
+        }
+    }
+}
+
+// Per-axis sampling positions with versiyon1's centre-aligned mapping:
+// src = (dst + 0.5) * in / out - 0.5, clamped to the image
+static void build_axis_f32(int in_size, int out_size, int32_t* i0, int32_t* i1, float* frac) {
+    float ratio = (float)in_size / out_size;
+    for (int o = 0; o < out_size; o++) {
+        float src = (o + 0.5f) * ratio - 0.5f;
+        if (src < 0.0f) src = 0.0f;
+        int32_t lo = (int32_t)src;
+        if (lo > in_size - 1) lo = in_size - 1;
+        i0[o] = lo;
+        i1[o] = lo + 1 < in_size ? lo + 1 : in_size - 1;
+        frac[o] = src - lo;
+    }
+}
+
+// Portable row kernels: vertical lerp of two source rows, then horizontal
+// lerp through the column tables
+static void lerp_rows_f32_scalar(const float* r0, const float* r1, float fy, float* out, int width) {
+    for (int x = 0; x < width; x++) {
+        out[x] = r0[x] + fy * (r1[x] - r0[x]);
+    }
+}
+
+static void lerp_columns_f32_scalar(const float* row, const int32_t* x0, const int32_t* x1, const float* fx,
+                                    float* out, int width) {
+    for (int x = 0; x < width; x++) {
+        float a = row[x0[x]];
+        float b = row[x1[x]];
+        out[x] = a + fx[x] * (b - a);
+    }
+}
+
+#ifdef HAVE_X86_DISPATCH
+// AVX2 + FMA row kernels: 8 floats per step, gathers for the column lerp.
+// Rows are padded to whole vectors, so no scalar tail is needed.
+__attribute__((target("avx2,fma")))
+static void lerp_rows_f32_avx2(const float* r0, const float* r1, float fy, float* out, int width) {
+    __m256 vfy = _mm256_set1_ps(fy);
+    for (int x = 0; x < width; x += F32_LANES) {
+        __m256 a = _mm256_load_ps(r0 + x);
+        __m256 b = _mm256_load_ps(r1 + x);
+        _mm256_store_ps(out + x, _mm256_fmadd_ps(vfy, _mm256_sub_ps(b, a), a));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void lerp_columns_f32_avx2(const float* row, const int32_t* x0, const int32_t* x1, const float* fx,
+                                  float* out, int width) {
+    for (int x = 0; x < width; x += F32_LANES) {
+        __m256i i0 = _mm256_load_si256((const __m256i*)(x0 + x));
+        __m256i i1 = _mm256_load_si256((const __m256i*)(x1 + x));
+        __m256 a = _mm256_i32gather_ps(row, i0, 4);
+        __m256 b = _mm256_i32gather_ps(row, i1, 4);
+        __m256 f = _mm256_load_ps(fx + x);
+        _mm256_store_ps(out + x, _mm256_fmadd_ps(f, _mm256_sub_ps(b, a), a));
+    }
+}
+#endif
+
+typedef void (*LerpRowsF32)(const float*, const float*, float, float*, int);
+typedef void (*LerpColumnsF32)(const float*, const int32_t*, const int32_t*, const float*, float*, int);
+
+// Vectorised bilinear resize of a planar float image. Each plane is handled
+// on its own: two source rows are blended vertically into a scratch row,
+// which is then sampled horizontally. Uses AVX2/FMA when the CPU has them.
+ImageF32* resize_image_f32(const ImageF32* input, int32_t scale_num, int32_t scale_denom) {
+    if (!input || !input->planes[0] || scale_num <= 0 || scale_denom <= 0) {
+        return NULL;
+    }
+
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    ImageF32* output = create_image_f32(out_width, out_height, input->channels);
+    if (!output) return NULL;
+
+    LerpRowsF32 lerp_rows = lerp_rows_f32_scalar;
+    LerpColumnsF32 lerp_columns = lerp_columns_f32_scalar;
+#ifdef HAVE_X86_DISPATCH
+    if (resize_isa_allows(RESIZE_ISA_AVX2)) {
+        lerp_rows = lerp_rows_f32_avx2;
+        lerp_columns = lerp_columns_f32_avx2;
+    }
+#endif
+
+    // Column tables are padded like the planes; padding entries point at column 0
+    int out_stride = output->stride;
+    void* tables = NULL;
+    size_t table_bytes = (size_t)out_stride * (2 * sizeof(int32_t) + sizeof(float))
+                       + (size_t)input->stride * sizeof(float)
+                       + (size_t)out_height * (2 * sizeof(int32_t) + sizeof(float));
+    if (posix_memalign(&tables, F32_ALIGN, table_bytes) != 0) {
+        free_image_f32(output);
+        return NULL;
+    }
+    memset(tables, 0, table_bytes);
+
+    int32_t* x0 = (int32_t*)tables;
+    int32_t* x1 = x0 + out_stride;
+    float* fx = (float*)(x1 + out_stride);
+    float* scratch = fx + out_stride;
+    int32_t* y0 = (int32_t*)(scratch + input->stride);
+    int32_t* y1 = y0 + out_height;
+    float* fy = (float*)(y1 + out_height);
+
+    build_axis_f32(input->width, out_width, x0, x1, fx);
+    build_axis_f32(input->height, out_height, y0, y1, fy);
+
+    for (int c = 0; c < input->channels; c++) {
+        const float* src = input->planes[c];
+        float* dst = output->planes[c];
+        for (int y = 0; y < out_height; y++) {
+            lerp_rows(src + (size_t)y0[y] * input->stride, src + (size_t)y1[y] * input->stride,
+                      fy[y], scratch, input->width);
+            lerp_columns(scratch, x0, x1, fx, dst + (size_t)y * out_stride, out_width);
+        }
+    }
+
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)input->width * input->height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    free(tables);
+    return output;
+}
@@ -1,83 +1,407 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <time.h>
 #include "image_resize.h"
+#include "resize_batch.h"
+#include "resize_daemon.h"
+#include "resize_trace.h"
+
+// Scale factors exercised by the demo
+static const struct {
+    int num;
+    int denom;
+    const char* name;
+} scales[] = {
+    {1, 2, "half"},
+    {1, 4, "quarter"},
+    {3, 4, "three_quarters"},
+    {2, 1, "double"}
+};
+
+// Resize a 16-bit input with every 16-bit kernel and keep 16 bits on output
+static int run_16bit(const char* filename) {
+    Image16* original = load_image16(filename);
+    if (!original) {
+        return 1;
+    }
+
+    printf("Original image: %dx%d, %d channels, 16-bit\n", original->width, original->height, original->channels);
+
+    struct {
+        const char* name;
+        Image16* (*resize)(const Image16*, int32_t, int32_t);
+    } kernels[] = {
+        {"bilinear16", resize_image16_fixed},
+        {"nearest16", resize_image16_nearest},
+        {"area16", resize_image16_area}
+    };
+
+    for (size_t i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            char filename_out[256];
+            Image16* resized = kernels[k].resize(original, scales[i].num, scales[i].denom);
+
+            if (resized) {
+                printf("Resized %s (%s): %dx%d\n", kernels[k].name, scales[i].name, resized->width, resized->height);
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+                snprintf(filename_out, sizeof(filename_out), "%s_%s.png", kernels[k].name, scales[i].name);
+                save_image16(resized, filename_out);
 
-// Load an image from file using stb_image
-Image* load_image(const char* filename) {
-    int width, height, channels;
-    unsigned char* data = stbi_load(filename, &width, &height, &channels, 0);
+                free_image16(resized);
+            } else {
+                printf("Failed to resize image (%s) with scale %d/%d\n", kernels[k].name, scales[i].num, scales[i].denom);
+            }
+        }
+    }
 
-    if (!data) {
-        printf("Error loading image: %s\n", filename);
-        return NULL;
+    free_image16(original);
+    return 0;
+}
+
+// Resize an HDR input in float and write Radiance .hdr outputs
+static int run_hdr(const char* filename) {
+    ImageF32* original = load_image_f32(filename);
+    if (!original) {
+        return 1;
+    }
+
+    printf("Original image: %dx%d, %d channels, float\n", original->width, original->height, original->channels);
+
+    for (size_t i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
+        char filename_out[256];
+        ImageF32* resized = resize_image_f32(original, scales[i].num, scales[i].denom);
+
+        if (resized) {
+            printf("Resized float (%s): %dx%d\n", scales[i].name, resized->width, resized->height);
+
+            snprintf(filename_out, sizeof(filename_out), "bilinear_f32_%s.hdr", scales[i].name);
+            save_image_hdr(resized, filename_out);
+
+            free_image_f32(resized);
+        } else {
+            printf("Failed to resize image (float) with scale %d/%d\n", scales[i].num, scales[i].denom);
+        }
     }
 
-    printf("Loaded image: %s (%dx%d, %d channels)\n", filename, width, height, channels);
+    free_image_f32(original);
+    return 0;
+}
+
+// Pipeline stages in order, as offsets into PipelineTimes
+static const struct {
+    const char* name;
+    size_t offset;
+} pipeline_stages[] = {
+    {"decode", offsetof(PipelineTimes, decode)},
+    {"copy", offsetof(PipelineTimes, copy)},
+    {"resize", offsetof(PipelineTimes, resize)},
+    {"png filter", offsetof(PipelineTimes, filter)},
+    {"deflate", offsetof(PipelineTimes, deflate)},
+    {"write", offsetof(PipelineTimes, write)}
+};
+
+static double stage_time(const PipelineTimes* t, int stage) {
+    return *(const double*)((const char*)t + pipeline_stages[stage].offset);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double* sorted, int count, double p) {
+    int rank = (int)(p / 100.0 * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+// Time load -> resize_image_fixed -> save for every image in a directory and
+// report per-stage percentiles and each stage's share of the total time
+static int run_pipeline_bench(const char* dirname, int num, int denom, int repeats) {
+    const char* out_name = "pipeline_bench.png";
+    PipelineTimes* runs = NULL;
+    int count = 0;
+    int capacity = 0;
+    int skipped = 0;
+
+    for (int r = 0; r < repeats; r++) {
+        DIR* dir = opendir(dirname);
+        if (!dir) {
+            printf("Cannot open directory: %s\n", dirname);
+            free(runs);
+            return 1;
+        }
 
-    // Convert 4-channel images to 3-channel (remove alpha)
-    if (channels == 4) {
-        printf("Converting RGBA to RGB\n");
-        unsigned char* rgb_data = malloc(width * height * 3);
-        for (int i = 0, j = 0; i < width * height * 4; i += 4, j += 3) {
-            rgb_data[j] = data[i];
-            rgb_data[j+1] = data[i+1];
-            rgb_data[j+2] = data[i+2];
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", dirname, entry->d_name);
+
+            PipelineTimes t = {0};
+            Image* img = load_image_timed(path, &t);
+            if (!img) {
+                if (r == 0) skipped++;
+                continue;
+            }
+
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            Image* resized = resize_image_fixed(img, num, denom);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            t.resize = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+            int saved = resized && save_image_timed(resized, out_name, &t);
+            if (resized) free_image(resized);
+            free_image(img);
+            if (!saved) {
+                printf("Pipeline failed for %s\n", path);
+                continue;
+            }
+
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                PipelineTimes* grown = (PipelineTimes*)realloc(runs, capacity * sizeof(PipelineTimes));
+                if (!grown) {
+                    closedir(dir);
+                    free(runs);
+                    return 1;
+                }
+                runs = grown;
+            }
+            runs[count++] = t;
         }
-        stbi_image_free(data);
-        data = rgb_data;
-        channels = 3;
+        closedir(dir);
     }
+    remove(out_name);
 
-    // Create our image structure
-    Image* img = create_image(width, height, channels);
-    if (!img) {
-        stbi_image_free(data);
-        return NULL;
+    if (count == 0) {
+        printf("No loadable images in %s\n", dirname);
+        free(runs);
+        return 1;
     }
 
-    // Copy the data
-    memcpy(img->data, data, width * height * (channels == 3 ? sizeof(PixelRGB) : sizeof(PixelGray)));
+    int stages = sizeof(pipeline_stages) / sizeof(pipeline_stages[0]);
+    double* samples = (double*)malloc(count * sizeof(double));
+    if (!samples) {
+        free(runs);
+        return 1;
+    }
+
+    double grand_total = 0.0;
+    for (int i = 0; i < count; i++) {
+        for (int s = 0; s < stages; s++) {
+            grand_total += stage_time(&runs[i], s);
+        }
+    }
 
-    // Free stb image data
-    stbi_image_free(data);
+    printf("Pipeline benchmark: %d runs (%d repeats), scale %d/%d, %d files skipped\n",
+           count, repeats, num, denom, skipped);
+    printf("%-12s %10s %10s %10s %10s %8s\n", "stage", "p50 ms", "p90 ms", "p99 ms", "mean ms", "share");
+    for (int s = 0; s <= stages; s++) {
+        double sum = 0.0;
+        for (int i = 0; i < count; i++) {
+            if (s < stages) {
+                samples[i] = stage_time(&runs[i], s);
+            } else {
+                samples[i] = 0.0;
+                for (int k = 0; k < stages; k++) samples[i] += stage_time(&runs[i], k);
+            }
+            sum += samples[i];
+        }
+        qsort(samples, count, sizeof(double), compare_doubles);
+        printf("%-12s %10.3f %10.3f %10.3f %10.3f %7.1f%%\n", s < stages ? pipeline_stages[s].name : "total",
+               percentile(samples, count, 50.0) * 1e3, percentile(samples, count, 90.0) * 1e3,
+               percentile(samples, count, 99.0) * 1e3, sum / count * 1e3,
+               grand_total > 0.0 ? 100.0 * sum / grand_total : 0.0);
+    }
 
-    return img;
+    free(samples);
+    free(runs);
+    return 0;
 }
 
-// Save an image to PNG file using stb_image_write
-int save_image(const Image* img, const char* filename) {
-    if (!img || !img->data) {
-        printf("Invalid image data\n");
-        return 0;
+// --batch -o DIR -s SIZE[,SIZE...] [-j DECODE,RESIZE,ENCODE] [-q DEPTH] [-v] INPUT...
+// SIZE is NUM/DENOM, WxH, Wx or xH; INPUT is an image, a directory or @LIST
+static int run_batch_cli(int argc, char* argv[]) {
+    BatchOptions opt = {0};
+    BatchTarget targets[16];
+    int i = 0;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-v") == 0) {
+            opt.verbose = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--blocking-io") == 0) {
+            opt.blocking_io = 1;
+            continue;
+        }
+        if (!value) break;
+        if (strcmp(argv[i], "-o") == 0) {
+            opt.output_dir = value;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            char sizes[256];
+            snprintf(sizes, sizeof(sizes), "%s", value);
+            for (char* size = strtok(sizes, ","); size; size = strtok(NULL, ",")) {
+                if (opt.target_count == (int)(sizeof(targets) / sizeof(targets[0])) ||
+                    !batch_parse_target(size, &targets[opt.target_count])) {
+                    printf("Invalid size: %s\n", size);
+                    return 1;
+                }
+                opt.target_count++;
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (sscanf(value, "%d,%d,%d", &opt.decode_threads, &opt.resize_threads, &opt.encode_threads) != 3) {
+                printf("Invalid thread counts: %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-q") == 0) {
+            opt.queue_depth = atoi(value);
+        } else {
+            break;
+        }
+        i++;
+    }
+
+    if (!opt.output_dir || opt.target_count == 0 || i == argc) {
+        printf("Usage: --batch -o DIR -s SIZE[,SIZE...] [-j DECODE,RESIZE,ENCODE] [-q DEPTH] [--blocking-io] [-v] "
+               "INPUT...\n"
+               "  SIZE: NUM/DENOM, WxH, Wx or xH; INPUT: image, directory or @file listing one path per line\n");
+        return 1;
+    }
+    opt.targets = targets;
+    opt.inputs = (const char* const*)(argv + i);
+    opt.input_count = argc - i;
+
+    BatchStats stats;
+    if (!run_batch(&opt, &stats)) {
+        printf("Batch pipeline could not start\n");
+        return 1;
     }
 
-    int result;
-    if (img->channels == 3) {
-        result = stbi_write_png(filename, img->width, img->height, 3, img->data, img->width * 3);
-    } else {
-        result = stbi_write_png(filename, img->width, img->height, 1, img->data, img->width);
+    printf("Batch: %d images, %d files written, %d failed in %.3f s (%.1f images/s)\n", stats.images,
+           stats.outputs, stats.failed, stats.seconds, stats.seconds > 0.0 ? stats.images / stats.seconds : 0.0);
+    printf("Worker busy time: decode %.3f s, resize %.3f s, encode %.3f s (%s file I/O)\n", stats.decode_busy,
+           stats.resize_busy, stats.encode_busy, stats.async_io ? "io_uring" : "blocking");
+    return stats.failed ? 1 : 0;
+}
+
+// --serve [-j WORKERS] [--cache-mem MB] [--cache-dir DIR] [--cache-disk MB] [--source-mem MB]
+//         [--source-ttl MS] [-v] SOCKET
+static int run_daemon_cli(int argc, char* argv[]) {
+    DaemonOptions opt = {0};
+    opt.cache_memory = (size_t)64 << 20;
+    opt.cache_disk = (size_t)1024 << 20;
+    opt.source_memory = (size_t)256 << 20;
+    opt.source_ttl_ms = 2000;
+    int i = 0;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-v") == 0) {
+            opt.verbose = 1;
+            continue;
+        }
+        if (!value) break;
+        if (strcmp(argv[i], "-j") == 0) {
+            opt.workers = atoi(value);
+        } else if (strcmp(argv[i], "--cache-mem") == 0) {
+            opt.cache_memory = (size_t)atol(value) << 20;
+        } else if (strcmp(argv[i], "--cache-dir") == 0) {
+            opt.cache_dir = value;
+        } else if (strcmp(argv[i], "--cache-disk") == 0) {
+            opt.cache_disk = (size_t)atol(value) << 20;
+        } else if (strcmp(argv[i], "--source-mem") == 0) {
+            opt.source_memory = (size_t)atol(value) << 20;
+        } else if (strcmp(argv[i], "--source-ttl") == 0) {
+            opt.source_ttl_ms = atoi(value);
+        } else {
+            break;
+        }
+        i++;
     }
 
-    if (result) {
-        printf("Saved image: %s (%dx%d, %d channels)\n", filename, img->width, img->height, img->channels);
-    } else {
-        printf("Error saving image: %s\n", filename);
+    if (i != argc - 1) {
+        printf("Usage: --serve [-j WORKERS] [--cache-mem MB] [--cache-dir DIR] [--cache-disk MB] [--source-mem MB]\n"
+               "               [--source-ttl MS] [-v] SOCKET\n"
+               "  result cache: 64 MB in memory by default (0 disables), 1024 MB on disk when a directory is given\n"
+               "  decoded sources: 256 MB kept for 2000 ms after last use by default (0 disables)\n");
+        return 1;
     }
+    opt.socket_path = argv[i];
+    return run_daemon(&opt) ? 0 : 1;
+}
 
-    return result;
+#ifdef RESIZE_TRACE
+// Trace builds leave trace.json (chrome://tracing, Perfetto) and
+// metrics.prom (Prometheus text format) in the working directory on exit
+static void write_trace_files(void) {
+    FILE* f = fopen("trace.json", "w");
+    if (f) {
+        trace_write_chrome_json(f);
+        fclose(f);
+    }
+    f = fopen("metrics.prom", "w");
+    if (f) {
+        trace_write_prometheus(f);
+        fclose(f);
+    }
+    printf("Trace written to trace.json and metrics.prom\n");
 }
+#endif
 
 int main(int argc, char* argv[]) {
     printf("Integer-Based Image Resizing with PNG I/O\n");
+#ifdef RESIZE_TRACE
+    atexit(write_trace_files);
+#endif
 
     Image* original = NULL;
 
+    // 16-bit inputs take the 16-bit path instead of being truncated to 8 bits
+    if (argc > 1 && image_is_16_bit(argv[1])) {
+        return run_16bit(argv[1]);
+    }
+
+    // Per-stage timing of load -> resize -> save over a directory of images:
+    // --bench-pipeline DIR [NUM/DENOM] [REPEATS]
+    if (argc > 2 && strcmp(argv[1], "--bench-pipeline") == 0) {
+        int num = 1, denom = 2;
+        if (argc > 3 && (sscanf(argv[3], "%d/%d", &num, &denom) != 2 || num <= 0 || denom <= 0)) {
+            printf("Invalid scale: %s\n", argv[3]);
+            return 1;
+        }
+        int repeats = argc > 4 ? atoi(argv[4]) : 1;
+        return run_pipeline_bench(argv[2], num, denom, repeats > 0 ? repeats : 1);
+    }
+
+    // Many images to many sizes through the decode -> resize -> encode pipeline
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        return run_batch_cli(argc - 2, argv + 2);
+    }
+
+    // Long-running server on a Unix domain socket
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+        return run_daemon_cli(argc - 2, argv + 2);
+    }
+
+    // Bit-exactness self-check of every kernel variant
+    if (argc > 1 && strcmp(argv[1], "--verify") == 0) {
+        return resize_self_check(argc > 2 && strcmp(argv[2], "-v") == 0) ? 1 : 0;
+    }
+
+    // HDR inputs are resized in float and written back as .hdr
+    if (argc > 1 && image_is_hdr(argv[1])) {
+        return run_hdr(argv[1]);
+    }
+
     // Check if an input image was provided
     if (argc > 1) {
         // Load image from file
@@ -106,19 +430,7 @@ int main(int argc, char* argv[]) {
     // Save the original image
     save_image(original, "original.png");
 
-    // Test different scale factors
-    struct {
-        int num;
-        int denom;
-        const char* name;
-    } scales[] = {
-        {1, 2, "half"},
-        {1, 4, "quarter"},
-        {3, 4, "three_quarters"},
-        {2, 1, "double"}
-    };
-
-    for (int i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
+    for (size_t i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
         char filename[256];
 
         // Test bilinear interpolation
@@ -150,6 +462,50 @@ int main(int argc, char* argv[]) {
         } else {
             printf("Failed to resize image (NN) with scale %d/%d\n", scales[i].num, scales[i].denom);
         }
+
+        // High-quality separable filter
+        Image* resized_lz = resize_image_filter(original, scales[i].num, scales[i].denom, FILTER_LANCZOS3);
+
+        if (resized_lz) {
+            printf("Resized Lanczos-3 (%s): %dx%d\n", scales[i].name, resized_lz->width, resized_lz->height);
+
+            snprintf(filename, sizeof(filename), "lanczos3_%s.png", scales[i].name);
+            save_image(resized_lz, filename);
+
+            free_image(resized_lz);
+        } else {
+            printf("Failed to resize image (Lanczos-3) with scale %d/%d\n", scales[i].num, scales[i].denom);
+        }
+
+        // Gamma-correct (linear-light) bilinear
+        Image* resized_lin = resize_image_linear(original, scales[i].num, scales[i].denom);
+
+        if (resized_lin) {
+            printf("Resized linear light (%s): %dx%d\n", scales[i].name, resized_lin->width, resized_lin->height);
+
+            snprintf(filename, sizeof(filename), "linear_%s.png", scales[i].name);
+            save_image(resized_lin, filename);
+
+            free_image(resized_lin);
+        } else {
+            printf("Failed to resize image (linear light) with scale %d/%d\n", scales[i].num, scales[i].denom);
+        }
+
+        // Images with alpha are also filtered in premultiplied space
+        if (original->channels == 2 || original->channels == 4) {
+            Image* resized_pm = resize_image_premultiplied(original, scales[i].num, scales[i].denom);
+
+            if (resized_pm) {
+                printf("Resized premultiplied (%s): %dx%d\n", scales[i].name, resized_pm->width, resized_pm->height);
+
+                snprintf(filename, sizeof(filename), "premultiplied_%s.png", scales[i].name);
+                save_image(resized_pm, filename);
+
+                free_image(resized_pm);
+            } else {
+                printf("Failed to resize image (premultiplied) with scale %d/%d\n", scales[i].num, scales[i].denom);
+            }
+        }
     }
 
     free_image(original);
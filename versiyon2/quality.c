@@ -0,0 +1,798 @@
+#include <dirent.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "image_resize.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Quality-vs-speed tool. Every image of a corpus is resized with each 8-bit
+// resize mode and compared against a high-precision reference: separable
+// Lanczos-3 in double precision, centre-aligned and stretched on downscale
+// like resize_image_filter, with no intermediate rounding. PSNR and SSIM
+// (SSE2, one band of rows per thread) are tabulated next to each mode's
+// throughput, so the cheapest mode that meets a quality floor can be picked.
+//
+// Build: gcc -O2 -o resize_quality quality.c image_resize.c image_resize16.c image_resize_f32.c
+//        image_planar.c image_filter.c image_fastpath.c resize_kernels.c resize_trace.c image_io.c -lm -pthread
+
+// Gaussian SSIM window (Wang et al. 2004): 11 taps, sigma 1.5, constants
+// for 8-bit samples
+#define SSIM_RADIUS 5
+#define SSIM_TAPS (2 * SSIM_RADIUS + 1)
+#define SSIM_C1 ((0.01 * 255) * (0.01 * 255))
+#define SSIM_C2 ((0.03 * 255) * (0.03 * 255))
+
+// PSNR reported for identical images
+#define PSNR_IDENTICAL 100.0
+
+// Rows per unit of work handed to the metric threads
+#define BAND_ROWS 16
+
+typedef Image* (*ResizeFn)(const Image* input, int32_t scale_num, int32_t scale_denom);
+
+static Image* resize_catmull_rom(const Image* input, int32_t scale_num, int32_t scale_denom) {
+    return resize_image_filter(input, scale_num, scale_denom, FILTER_CATMULL_ROM);
+}
+
+static Image* resize_mitchell(const Image* input, int32_t scale_num, int32_t scale_denom) {
+    return resize_image_filter(input, scale_num, scale_denom, FILTER_MITCHELL);
+}
+
+static Image* resize_lanczos2(const Image* input, int32_t scale_num, int32_t scale_denom) {
+    return resize_image_filter(input, scale_num, scale_denom, FILTER_LANCZOS2);
+}
+
+static Image* resize_lanczos3(const Image* input, int32_t scale_num, int32_t scale_denom) {
+    return resize_image_filter(input, scale_num, scale_denom, FILTER_LANCZOS3);
+}
+
+// Modes under test, cheapest first. Premultiplied and linear-light resizing
+// are left out: they deliberately differ from a gamma-space, straight-alpha
+// reference, so their scores would not mean "closer to ideal".
+static const struct {
+    const char* name;
+    ResizeFn resize;
+} modes[] = {
+    {"nearest", resize_image_nearest},
+    {"bilinear", resize_image_fixed},
+    {"catmull_rom", resize_catmull_rom},
+    {"mitchell", resize_mitchell},
+    {"lanczos2", resize_lanczos2},
+    {"lanczos3", resize_lanczos3}
+};
+
+#define MODE_COUNT ((int)(sizeof(modes) / sizeof(modes[0])))
+
+// main.c's demo ratios
+static const struct {
+    int num;
+    int denom;
+} default_scales[] = {
+    {1, 2}, {1, 4}, {3, 4}, {2, 1}
+};
+
+typedef struct {
+    int threads;
+    int repeats;
+    int num;                // 0: all default scales
+    int denom;
+    double min_psnr;        // quality floor, 0 for none
+    double min_ssim;
+    int verbose;
+} QualityOptions;
+
+// Per mode totals over the corpus at one scale
+typedef struct {
+    double psnr_sum;
+    double psnr_min;
+    double ssim_sum;
+    double ssim_min;
+    double seconds;         // sum of median resize times
+    double out_pixels;
+    int images;
+} ModeStats;
+
+typedef struct {
+    Image** images;
+    char** names;
+    int count;
+} Corpus;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// ---------------------------------------------------------------------------
+// Reference resampler
+// ---------------------------------------------------------------------------
+
+static double sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+static double lanczos3(double x) {
+    return fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+// Double-precision weights for one axis: same sampling positions, support
+// and edge renormalisation as image_filter.c, but no tap cap or quantisation
+typedef struct {
+    int* first;
+    int* count;
+    double* weights;        // taps per output sample
+    int taps;
+} ReferenceAxis;
+
+static void free_reference_axis(ReferenceAxis* axis) {
+    free(axis->first);
+    free(axis->count);
+    free(axis->weights);
+}
+
+static int build_reference_axis(int in_size, int out_size, ReferenceAxis* axis) {
+    double scale = (double)in_size / out_size;
+    double filter_scale = scale > 1.0 ? scale : 1.0;
+    double support = 3.0 * filter_scale;
+
+    axis->taps = (int)ceil(support) * 2 + 1;
+    axis->first = (int*)malloc((size_t)out_size * sizeof(int));
+    axis->count = (int*)malloc((size_t)out_size * sizeof(int));
+    axis->weights = (double*)calloc((size_t)out_size * axis->taps, sizeof(double));
+    if (!axis->first || !axis->count || !axis->weights) {
+        free_reference_axis(axis);
+        return 0;
+    }
+
+    for (int o = 0; o < out_size; o++) {
+        double center = (o + 0.5) * scale - 0.5;
+        int first = (int)ceil(center - support);
+        int last = (int)floor(center + support);
+        if (first < 0) first = 0;
+        if (last > in_size - 1) last = in_size - 1;
+        if (last - first + 1 > axis->taps) last = first + axis->taps - 1;
+
+        double* w = axis->weights + (size_t)o * axis->taps;
+        double sum = 0.0;
+        for (int i = first; i <= last; i++) {
+            w[i - first] = lanczos3((i - center) / filter_scale);
+            sum += w[i - first];
+        }
+        for (int i = 0; i <= last - first; i++) {
+            w[i] /= sum;
+        }
+        axis->first[o] = first;
+        axis->count[o] = last - first + 1;
+    }
+    return 1;
+}
+
+// Resize to planar float samples (plane c at c * width * height), clamped to
+// the 8-bit range like any stored result would be
+static float* resize_reference(const Image* input, int out_width, int out_height) {
+    int channels = input->channels;
+    size_t row_len = (size_t)out_width * channels;
+    ReferenceAxis horizontal = { NULL, NULL, NULL, 0 };
+    ReferenceAxis vertical = { NULL, NULL, NULL, 0 };
+    double* temp = (double*)malloc(row_len * input->height * sizeof(double));
+    double* acc = (double*)malloc(row_len * sizeof(double));
+    float* output = (float*)malloc(row_len * out_height * sizeof(float));
+    if (!temp || !acc || !output ||
+        !build_reference_axis(input->width, out_width, &horizontal) ||
+        !build_reference_axis(input->height, out_height, &vertical)) {
+        free_reference_axis(&horizontal);
+        free(temp);
+        free(acc);
+        free(output);
+        return NULL;
+    }
+
+    const uint8_t* src = (const uint8_t*)input->data;
+    for (int y = 0; y < input->height; y++) {
+        const uint8_t* row = src + (size_t)y * input->width * channels;
+        double* out = temp + (size_t)y * row_len;
+        for (int x = 0; x < out_width; x++) {
+            const double* w = horizontal.weights + (size_t)x * horizontal.taps;
+            const uint8_t* p = row + (size_t)horizontal.first[x] * channels;
+            for (int c = 0; c < channels; c++) {
+                double sum = 0.0;
+                for (int k = 0; k < horizontal.count[x]; k++) {
+                    sum += w[k] * p[k * channels + c];
+                }
+                out[x * channels + c] = sum;
+            }
+        }
+    }
+
+    size_t plane_size = (size_t)out_width * out_height;
+    for (int y = 0; y < out_height; y++) {
+        const double* w = vertical.weights + (size_t)y * vertical.taps;
+        memset(acc, 0, row_len * sizeof(double));
+        for (int k = 0; k < vertical.count[y]; k++) {
+            const double* row = temp + (size_t)(vertical.first[y] + k) * row_len;
+            for (size_t i = 0; i < row_len; i++) {
+                acc[i] += w[k] * row[i];
+            }
+        }
+        for (int x = 0; x < out_width; x++) {
+            for (int c = 0; c < channels; c++) {
+                double v = acc[x * channels + c];
+                output[c * plane_size + (size_t)y * out_width + x] = (float)(v < 0.0 ? 0.0 : v > 255.0 ? 255.0 : v);
+            }
+        }
+    }
+
+    free_reference_axis(&horizontal);
+    free_reference_axis(&vertical);
+    free(temp);
+    free(acc);
+    return output;
+}
+
+// 8-bit interleaved image to planar float, same layout as the reference
+static float* to_planar_float(const Image* img) {
+    size_t plane_size = (size_t)img->width * img->height;
+    float* planes = (float*)malloc(plane_size * img->channels * sizeof(float));
+    if (!planes) return NULL;
+
+    const uint8_t* src = (const uint8_t*)img->data;
+    for (size_t i = 0; i < plane_size; i++) {
+        for (int c = 0; c < img->channels; c++) {
+            planes[c * plane_size + i] = src[i * img->channels + c];
+        }
+    }
+    return planes;
+}
+
+// ---------------------------------------------------------------------------
+// Metrics
+// ---------------------------------------------------------------------------
+
+// Two planar float images being compared; rows are numbered across planes
+// (channels * height rows of width samples)
+typedef struct {
+    const float* a;
+    const float* b;
+    int width;
+    int height;
+    int channels;
+    float window[SSIM_TAPS];
+} MetricPair;
+
+typedef double (*BandFn)(const MetricPair* pair, int row_begin, int row_end);
+
+// Bands are claimed through a shared counter; each band's partial sum lands
+// in its own slot, and the slots are added in order afterwards, so the
+// result does not depend on the thread count
+typedef struct {
+    BandFn fn;
+    const MetricPair* pair;
+    int rows;
+    double* partial;
+    atomic_int next_band;
+} MetricJob;
+
+static void* metric_worker(void* arg) {
+    MetricJob* job = (MetricJob*)arg;
+    int bands = (job->rows + BAND_ROWS - 1) / BAND_ROWS;
+    for (;;) {
+        int band = atomic_fetch_add(&job->next_band, 1);
+        if (band >= bands) break;
+        int row_end = (band + 1) * BAND_ROWS;
+        if (row_end > job->rows) row_end = job->rows;
+        job->partial[band] = job->fn(job->pair, band * BAND_ROWS, row_end);
+    }
+    return NULL;
+}
+
+// Sum fn over every row of the pair using up to threads threads
+static double run_metric(BandFn fn, const MetricPair* pair, int threads) {
+    int rows = pair->height * pair->channels;
+    int bands = (rows + BAND_ROWS - 1) / BAND_ROWS;
+    MetricJob job = { fn, pair, rows, (double*)malloc((size_t)bands * sizeof(double)), 0 };
+    pthread_t* workers = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
+    if (!job.partial || !workers) {
+        free(job.partial);
+        free(workers);
+        return NAN;
+    }
+
+    int started = 0;
+    for (int t = 1; t < threads && t < bands; t++) {
+        if (pthread_create(&workers[started], NULL, metric_worker, &job) == 0) started++;
+    }
+    metric_worker(&job);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+
+    double sum = 0.0;
+    for (int b = 0; b < bands; b++) {
+        sum += job.partial[b];
+    }
+    free(job.partial);
+    free(workers);
+    return sum;
+}
+
+// Sum of squared differences over a range of rows
+static double squared_error_band(const MetricPair* pair, int row_begin, int row_end) {
+    double sum = 0.0;
+    for (int r = row_begin; r < row_end; r++) {
+        const float* a = pair->a + (size_t)r * pair->width;
+        const float* b = pair->b + (size_t)r * pair->width;
+        int x = 0;
+#if defined(__SSE2__)
+        // Differences in float, squares and sums widened to double
+        __m128d acc = _mm_setzero_pd();
+        for (; x + 4 <= pair->width; x += 4) {
+            __m128 d = _mm_sub_ps(_mm_loadu_ps(a + x), _mm_loadu_ps(b + x));
+            __m128d lo = _mm_cvtps_pd(d);
+            __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(d, d));
+            acc = _mm_add_pd(acc, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        sum += lanes[0] + lanes[1];
+#endif
+        for (; x < pair->width; x++) {
+            double d = (double)a[x] - b[x];
+            sum += d * d;
+        }
+    }
+    return sum;
+}
+
+// Vertical window pass for one row: weighted sums of a, b, a*a, b*b and a*b
+// over the SSIM_TAPS rows around y (edge rows repeated), written at offset
+// SSIM_RADIUS of each padded buffer
+static void ssim_vertical(const MetricPair* pair, const float* a_plane, const float* b_plane, int y,
+                          float* const* sums) {
+    const float* a_rows[SSIM_TAPS];
+    const float* b_rows[SSIM_TAPS];
+    for (int k = 0; k < SSIM_TAPS; k++) {
+        int row = y + k - SSIM_RADIUS;
+        if (row < 0) row = 0;
+        if (row > pair->height - 1) row = pair->height - 1;
+        a_rows[k] = a_plane + (size_t)row * pair->width;
+        b_rows[k] = b_plane + (size_t)row * pair->width;
+    }
+
+    int x = 0;
+#if defined(__SSE2__)
+    for (; x + 4 <= pair->width; x += 4) {
+        __m128 sa = _mm_setzero_ps(), sb = _mm_setzero_ps();
+        __m128 saa = _mm_setzero_ps(), sbb = _mm_setzero_ps(), sab = _mm_setzero_ps();
+        for (int k = 0; k < SSIM_TAPS; k++) {
+            __m128 w = _mm_set1_ps(pair->window[k]);
+            __m128 va = _mm_loadu_ps(a_rows[k] + x);
+            __m128 vb = _mm_loadu_ps(b_rows[k] + x);
+            __m128 wa = _mm_mul_ps(w, va);
+            __m128 wb = _mm_mul_ps(w, vb);
+            sa = _mm_add_ps(sa, wa);
+            sb = _mm_add_ps(sb, wb);
+            saa = _mm_add_ps(saa, _mm_mul_ps(wa, va));
+            sbb = _mm_add_ps(sbb, _mm_mul_ps(wb, vb));
+            sab = _mm_add_ps(sab, _mm_mul_ps(wa, vb));
+        }
+        _mm_storeu_ps(sums[0] + SSIM_RADIUS + x, sa);
+        _mm_storeu_ps(sums[1] + SSIM_RADIUS + x, sb);
+        _mm_storeu_ps(sums[2] + SSIM_RADIUS + x, saa);
+        _mm_storeu_ps(sums[3] + SSIM_RADIUS + x, sbb);
+        _mm_storeu_ps(sums[4] + SSIM_RADIUS + x, sab);
+    }
+#endif
+    for (; x < pair->width; x++) {
+        float sa = 0.0f, sb = 0.0f, saa = 0.0f, sbb = 0.0f, sab = 0.0f;
+        for (int k = 0; k < SSIM_TAPS; k++) {
+            float va = a_rows[k][x];
+            float vb = b_rows[k][x];
+            float wa = pair->window[k] * va;
+            float wb = pair->window[k] * vb;
+            sa += wa;
+            sb += wb;
+            saa += wa * va;
+            sbb += wb * vb;
+            sab += wa * vb;
+        }
+        sums[0][SSIM_RADIUS + x] = sa;
+        sums[1][SSIM_RADIUS + x] = sb;
+        sums[2][SSIM_RADIUS + x] = saa;
+        sums[3][SSIM_RADIUS + x] = sbb;
+        sums[4][SSIM_RADIUS + x] = sab;
+    }
+
+    // Repeat the edge columns into the padding for the horizontal pass
+    for (int s = 0; s < 5; s++) {
+        for (int p = 0; p < SSIM_RADIUS; p++) {
+            sums[s][p] = sums[s][SSIM_RADIUS];
+            sums[s][SSIM_RADIUS + pair->width + p] = sums[s][SSIM_RADIUS + pair->width - 1];
+        }
+    }
+}
+
+// SSIM of one window from its weighted moments, in the same operation order
+// as the SSE2 path
+static inline float ssim_value(float mu_a, float mu_b, float e_aa, float e_bb, float e_ab) {
+    float mu_ab = mu_a * mu_b;
+    float mu_aa = mu_a * mu_a;
+    float mu_bb = mu_b * mu_b;
+    float var_sum = (e_aa + e_bb) - (mu_aa + mu_bb);
+    float cov = e_ab - mu_ab;
+    return ((2.0f * mu_ab + (float)SSIM_C1) * (2.0f * cov + (float)SSIM_C2)) /
+           ((mu_aa + mu_bb + (float)SSIM_C1) * (var_sum + (float)SSIM_C2));
+}
+
+// Sum of the per-pixel SSIM map over a range of rows
+static double ssim_band(const MetricPair* pair, int row_begin, int row_end) {
+    size_t padded = (size_t)pair->width + 2 * SSIM_RADIUS;
+    float* buffer = (float*)malloc(padded * 5 * sizeof(float));
+    if (!buffer) return NAN;
+    float* sums[5];
+    for (int s = 0; s < 5; s++) {
+        sums[s] = buffer + padded * s;
+    }
+
+    size_t plane_size = (size_t)pair->width * pair->height;
+    double total = 0.0;
+    for (int r = row_begin; r < row_end; r++) {
+        int c = r / pair->height;
+        int y = r % pair->height;
+        ssim_vertical(pair, pair->a + c * plane_size, pair->b + c * plane_size, y, sums);
+
+        int x = 0;
+#if defined(__SSE2__)
+        const __m128 c1 = _mm_set1_ps((float)SSIM_C1);
+        const __m128 c2 = _mm_set1_ps((float)SSIM_C2);
+        const __m128 two = _mm_set1_ps(2.0f);
+        __m128d acc = _mm_setzero_pd();
+        for (; x + 4 <= pair->width; x += 4) {
+            __m128 m[5];
+            for (int s = 0; s < 5; s++) {
+                m[s] = _mm_setzero_ps();
+                for (int k = 0; k < SSIM_TAPS; k++) {
+                    m[s] = _mm_add_ps(m[s], _mm_mul_ps(_mm_set1_ps(pair->window[k]), _mm_loadu_ps(sums[s] + x + k)));
+                }
+            }
+            __m128 mu_ab = _mm_mul_ps(m[0], m[1]);
+            __m128 mu_aa = _mm_mul_ps(m[0], m[0]);
+            __m128 mu_bb = _mm_mul_ps(m[1], m[1]);
+            __m128 var_sum = _mm_sub_ps(_mm_add_ps(m[2], m[3]), _mm_add_ps(mu_aa, mu_bb));
+            __m128 cov = _mm_sub_ps(m[4], mu_ab);
+            __m128 num = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, mu_ab), c1), _mm_add_ps(_mm_mul_ps(two, cov), c2));
+            __m128 den = _mm_mul_ps(_mm_add_ps(_mm_add_ps(mu_aa, mu_bb), c1), _mm_add_ps(var_sum, c2));
+            __m128 s = _mm_div_ps(num, den);
+            acc = _mm_add_pd(acc, _mm_add_pd(_mm_cvtps_pd(s), _mm_cvtps_pd(_mm_movehl_ps(s, s))));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        total += lanes[0] + lanes[1];
+#endif
+        for (; x < pair->width; x++) {
+            float m[5];
+            for (int s = 0; s < 5; s++) {
+                m[s] = 0.0f;
+                for (int k = 0; k < SSIM_TAPS; k++) {
+                    m[s] += pair->window[k] * sums[s][x + k];
+                }
+            }
+            total += ssim_value(m[0], m[1], m[2], m[3], m[4]);
+        }
+    }
+
+    free(buffer);
+    return total;
+}
+
+static void init_pair(MetricPair* pair, const float* a, const float* b, int width, int height, int channels) {
+    pair->a = a;
+    pair->b = b;
+    pair->width = width;
+    pair->height = height;
+    pair->channels = channels;
+
+    double sum = 0.0;
+    double weights[SSIM_TAPS];
+    for (int k = 0; k < SSIM_TAPS; k++) {
+        double d = k - SSIM_RADIUS;
+        weights[k] = exp(-d * d / (2.0 * 1.5 * 1.5));
+        sum += weights[k];
+    }
+    for (int k = 0; k < SSIM_TAPS; k++) {
+        pair->window[k] = (float)(weights[k] / sum);
+    }
+}
+
+// PSNR over all channels (peak 255) and mean SSIM over channels and pixels
+static void compare_planes(const MetricPair* pair, int threads, double* psnr, double* ssim) {
+    double samples = (double)pair->width * pair->height * pair->channels;
+    double mse = run_metric(squared_error_band, pair, threads) / samples;
+    *psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : PSNR_IDENTICAL;
+    if (*psnr > PSNR_IDENTICAL) *psnr = PSNR_IDENTICAL;
+    *ssim = run_metric(ssim_band, pair, threads) / samples;
+}
+
+// ---------------------------------------------------------------------------
+// Corpus
+// ---------------------------------------------------------------------------
+
+static int corpus_add(Corpus* corpus, Image* img, const char* name) {
+    Image** images = (Image**)realloc(corpus->images, (corpus->count + 1) * sizeof(Image*));
+    if (images) corpus->images = images;
+    char** names = (char**)realloc(corpus->names, (corpus->count + 1) * sizeof(char*));
+    if (names) corpus->names = names;
+    char* copy = strdup(name);
+    if (!images || !names || !copy) {
+        free(copy);
+        free_image(img);
+        return 0;
+    }
+    corpus->images[corpus->count] = img;
+    corpus->names[corpus->count] = copy;
+    corpus->count++;
+    return 1;
+}
+
+static void corpus_add_file(Corpus* corpus, const char* path) {
+    PipelineTimes unused = {0};
+    Image* img = load_image_timed(path, &unused);
+    if (!img) {
+        fprintf(stderr, "Skipping %s (not a loadable image)\n", path);
+        return;
+    }
+    corpus_add(corpus, img, path);
+}
+
+static void corpus_add_path(Corpus* corpus, const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        corpus_add_file(corpus, path);
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "Cannot open directory: %s\n", path);
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char file[1024];
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        corpus_add_file(corpus, file);
+    }
+    closedir(dir);
+}
+
+// Zone plate: concentric rings whose frequency rises towards the corners,
+// the usual worst case for aliasing
+static Image* create_zone_plate(int width, int height, int channels) {
+    Image* img = create_image(width, height, channels);
+    if (!img) return NULL;
+
+    uint8_t* data = (uint8_t*)img->data;
+    double k = M_PI / (2.0 * (width > height ? width : height));
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            double dx = x - width / 2.0;
+            double dy = y - height / 2.0;
+            uint8_t v = (uint8_t)lround(127.5 + 127.5 * cos(k * (dx * dx + dy * dy)));
+            for (int c = 0; c < channels; c++) {
+                data[((size_t)y * width + x) * channels + c] = v;
+            }
+        }
+    }
+    return img;
+}
+
+static void corpus_free(Corpus* corpus) {
+    for (int i = 0; i < corpus->count; i++) {
+        free_image(corpus->images[i]);
+        free(corpus->names[i]);
+    }
+    free(corpus->images);
+    free(corpus->names);
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+// ---------------------------------------------------------------------------
+
+// Median time of repeats runs of one mode; *result keeps the last output
+static double time_mode(ResizeFn resize, const Image* src, int num, int denom, int repeats, Image** result) {
+    double* samples = (double*)malloc((size_t)repeats * sizeof(double));
+    if (!samples) return -1.0;
+
+    *result = NULL;
+    for (int i = 0; i < repeats; i++) {
+        if (*result) free_image(*result);
+        double start = now_seconds();
+        *result = resize(src, num, denom);
+        samples[i] = now_seconds() - start;
+        if (!*result) {
+            free(samples);
+            return -1.0;
+        }
+    }
+
+    qsort(samples, repeats, sizeof(double), compare_doubles);
+    double median = repeats % 2 ? samples[repeats / 2] : 0.5 * (samples[repeats / 2 - 1] + samples[repeats / 2]);
+    free(samples);
+    return median;
+}
+
+// Run every mode over the corpus at one scale and print its table
+static void run_scale(const Corpus* corpus, int num, int denom, const QualityOptions* opt) {
+    ModeStats stats[MODE_COUNT];
+    for (int m = 0; m < MODE_COUNT; m++) {
+        stats[m] = (ModeStats){ 0.0, INFINITY, 0.0, INFINITY, 0.0, 0.0, 0 };
+    }
+
+    for (int i = 0; i < corpus->count; i++) {
+        const Image* src = corpus->images[i];
+        int out_width = src->width * num / denom;
+        int out_height = src->height * num / denom;
+        if (out_width < 1) out_width = 1;
+        if (out_height < 1) out_height = 1;
+
+        float* reference = resize_reference(src, out_width, out_height);
+        if (!reference) {
+            fprintf(stderr, "Out of memory for the reference of %s\n", corpus->names[i]);
+            continue;
+        }
+
+        for (int m = 0; m < MODE_COUNT; m++) {
+            // One warm-up run, then the timed ones
+            Image* out = NULL;
+            if (time_mode(modes[m].resize, src, num, denom, 1, &out) < 0.0) continue;
+            free_image(out);
+            double seconds = time_mode(modes[m].resize, src, num, denom, opt->repeats, &out);
+            if (seconds < 0.0) continue;
+
+            float* planes = to_planar_float(out);
+            free_image(out);
+            if (!planes) continue;
+
+            MetricPair pair;
+            double psnr, ssim;
+            init_pair(&pair, planes, reference, out_width, out_height, src->channels);
+            compare_planes(&pair, opt->threads, &psnr, &ssim);
+            free(planes);
+
+            ModeStats* s = &stats[m];
+            s->psnr_sum += psnr;
+            s->ssim_sum += ssim;
+            if (psnr < s->psnr_min) s->psnr_min = psnr;
+            if (ssim < s->ssim_min) s->ssim_min = ssim;
+            s->seconds += seconds;
+            s->out_pixels += (double)out_width * out_height;
+            s->images++;
+
+            if (opt->verbose) {
+                printf("  %-12s %-32s %8.3f dB  SSIM %.5f  %9.3f ms\n", modes[m].name, corpus->names[i],
+                       psnr, ssim, seconds * 1e3);
+            }
+        }
+        free(reference);
+    }
+
+    printf("\nScale %d/%d, %d image(s), reference: double-precision Lanczos-3\n", num, denom, corpus->count);
+    printf("%-12s %10s %10s %10s %10s %10s\n", "mode", "PSNR mean", "PSNR min", "SSIM mean", "SSIM min", "MPix/s");
+
+    int pick = -1;
+    for (int m = 0; m < MODE_COUNT; m++) {
+        const ModeStats* s = &stats[m];
+        if (s->images == 0) {
+            printf("%-12s %10s\n", modes[m].name, "failed");
+            continue;
+        }
+        double mpix = s->out_pixels / s->seconds / 1e6;
+        printf("%-12s %10.3f %10.3f %10.5f %10.5f %10.2f\n", modes[m].name, s->psnr_sum / s->images, s->psnr_min,
+               s->ssim_sum / s->images, s->ssim_min, mpix);
+
+        // The floor must hold for every image, not just on average
+        int meets = s->psnr_min >= opt->min_psnr && s->ssim_min >= opt->min_ssim && s->images == corpus->count;
+        if (meets && (pick < 0 || mpix > stats[pick].out_pixels / stats[pick].seconds / 1e6)) pick = m;
+    }
+
+    if (opt->min_psnr > 0.0 || opt->min_ssim > 0.0) {
+        if (pick >= 0) {
+            printf("Fastest mode meeting PSNR >= %.2f dB and SSIM >= %.4f: %s\n", opt->min_psnr, opt->min_ssim,
+                   modes[pick].name);
+        } else {
+            printf("No mode meets PSNR >= %.2f dB and SSIM >= %.4f\n", opt->min_psnr, opt->min_ssim);
+        }
+    }
+}
+
+static int parse_options(int argc, char* argv[], QualityOptions* opt, int* first_path) {
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-v") == 0) {
+            opt->verbose = 1;
+            continue;
+        }
+        if (!value) return 0;
+        if (strcmp(arg, "--threads") == 0) {
+            opt->threads = atoi(value);
+        } else if (strcmp(arg, "--repeats") == 0) {
+            opt->repeats = atoi(value);
+        } else if (strcmp(arg, "--scale") == 0) {
+            if (sscanf(value, "%d/%d", &opt->num, &opt->denom) != 2 || opt->num <= 0 || opt->denom <= 0) return 0;
+        } else if (strcmp(arg, "--min-psnr") == 0) {
+            opt->min_psnr = atof(value);
+        } else if (strcmp(arg, "--min-ssim") == 0) {
+            opt->min_ssim = atof(value);
+        } else {
+            return 0;
+        }
+        i++;
+    }
+    *first_path = i;
+    return opt->threads >= 1 && opt->repeats >= 1;
+}
+
+int main(int argc, char* argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    QualityOptions opt = { cpus > 0 ? (int)cpus : 1, 3, 0, 0, 0.0, 0.0, 0 };
+    int first_path;
+    if (!parse_options(argc, argv, &opt, &first_path)) {
+        fprintf(stderr,
+                "usage: %s [--scale NUM/DENOM] [--threads N] [--repeats N] [--min-psnr DB] [--min-ssim S] [-v]\n"
+                "          [FILE|DIR ...]\n", argv[0]);
+        return 2;
+    }
+
+    Corpus corpus = { NULL, NULL, 0 };
+    for (int i = first_path; i < argc; i++) {
+        corpus_add_path(&corpus, argv[i]);
+    }
+
+    // Without a corpus, a smooth gradient and a zone plate stand in for
+    // easy and hard content
+    if (first_path == argc) {
+        Image* gradient = create_test_pattern(1024, 768, 3);
+        Image* zone = create_zone_plate(1024, 768, 3);
+        if (gradient) corpus_add(&corpus, gradient, "gradient");
+        if (zone) corpus_add(&corpus, zone, "zone_plate");
+    }
+    if (corpus.count == 0) {
+        fprintf(stderr, "No images to measure\n");
+        corpus_free(&corpus);
+        return 1;
+    }
+
+    printf("Resize quality vs speed: %d image(s), %d thread(s), %d repeat(s)\n", corpus.count, opt.threads,
+           opt.repeats);
+    if (opt.num) {
+        run_scale(&corpus, opt.num, opt.denom, &opt);
+    } else {
+        for (size_t s = 0; s < sizeof(default_scales) / sizeof(default_scales[0]); s++) {
+            run_scale(&corpus, default_scales[s].num, default_scales[s].denom, &opt);
+        }
+    }
+
+    corpus_free(&corpus);
+    return 0;
+}
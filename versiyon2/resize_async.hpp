@@ -0,0 +1,165 @@
+#ifndef RESIZE_ASYNC_HPP
+#define RESIZE_ASYNC_HPP
+
+// C++20 coroutine front end for resize_job.h:
+//
+//     resize::ImagePtr out = co_await resize::resize_async(input, 640, 480, stop_token);
+//
+// The resize runs on the library's pool and the awaiting coroutine is
+// suspended, never blocked, until it ends. By default the coroutine resumes
+// on the pool thread that finished the job; pass a resumer to post it back
+// to your own event loop instead. A stop request on the token cancels the
+// job before its next band of rows and the co_await throws
+// resize::ResizeCancelled. The input must outlive the co_await.
+
+extern "C" {
+#include "image_resize.h"
+#include "resize_job.h"
+}
+
+#include <atomic>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <utility>
+
+namespace resize {
+
+struct ImageDeleter {
+    void operator()(Image* image) const noexcept { free_image(image); }
+};
+using ImagePtr = std::unique_ptr<Image, ImageDeleter>;
+
+class ResizeCancelled : public std::runtime_error {
+public:
+    ResizeCancelled() : std::runtime_error("resize cancelled") {}
+};
+
+class ResizeFailed : public std::runtime_error {
+public:
+    ResizeFailed() : std::runtime_error("resize failed") {}
+};
+
+// Called on a pool thread after every band with (bands_done, band_count)
+using ResizeProgress = std::function<void(int, int)>;
+
+// Given the suspended coroutine once the job ends; must resume it (or hand
+// it to a thread that will), and must not block the pool thread it runs on
+using ResizeResumer = std::function<void(std::coroutine_handle<>)>;
+
+class ResizeAwaitable {
+public:
+    ResizeAwaitable(const Image* input, int out_width, int out_height, std::stop_token token = {},
+                    ResizeProgress progress = {}, ResizeResumer resumer = {})
+        : input_(input), out_width_(out_width), out_height_(out_height), token_(std::move(token)),
+          state_(std::make_shared<State>()) {
+        state_->progress = std::move(progress);
+        state_->resumer = std::move(resumer);
+    }
+
+    ResizeAwaitable(const ResizeAwaitable&) = delete;
+    ResizeAwaitable& operator=(const ResizeAwaitable&) = delete;
+    ResizeAwaitable(ResizeAwaitable&&) = default;
+
+    ~ResizeAwaitable() {
+        if (!state_) return;
+        state_->stop.reset();
+        resize_job_release(state_->job);
+    }
+
+    bool await_ready() const noexcept { return token_.stop_requested(); }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        state_->handle = handle;
+        // The job holds its own reference to the state until done runs
+        auto* hold = new std::shared_ptr<State>(state_);
+        state_->job = resize_job_submit(input_, out_width_, out_height_, &State::on_done,
+                                        state_->progress ? &State::on_progress : nullptr, hold);
+        if (!state_->job) {
+            delete hold;
+            state_->status = RESIZE_JOB_FAILED;
+            return false;
+        }
+        if (token_.stop_possible()) state_->stop.emplace(token_, Canceller{state_->job});
+        // The job may already have ended on a pool thread; carry on here then
+        return state_->phase.exchange(Phase::Suspended, std::memory_order_acq_rel) != Phase::Completed;
+    }
+
+    ImagePtr await_resume() {
+        state_->stop.reset();
+        if (!state_->job && token_.stop_requested()) throw ResizeCancelled();
+        if (state_->status == RESIZE_JOB_CANCELLED) throw ResizeCancelled();
+        if (state_->status == RESIZE_JOB_FAILED) throw ResizeFailed();
+        return std::move(state_->output);
+    }
+
+    // Fraction of the bands finished so far, 0 before the job started
+    double progress() const { return state_->job ? resize_job_progress(state_->job) : 0.0; }
+
+private:
+    enum class Phase { Submitted, Suspended, Completed };
+
+    struct Canceller {
+        ResizeJob* job;
+        void operator()() const noexcept { resize_job_cancel(job); }
+    };
+
+    struct State {
+        ResizeJob* job = nullptr;
+        std::coroutine_handle<> handle;
+        std::atomic<Phase> phase{Phase::Submitted};
+        ResizeJobStatus status = RESIZE_JOB_FAILED;
+        ImagePtr output;
+        ResizeProgress progress;
+        ResizeResumer resumer;
+        std::optional<std::stop_callback<Canceller>> stop;
+
+        static void on_progress(void* user, int bands_done, int band_count) {
+            (*static_cast<std::shared_ptr<State>*>(user))->progress(bands_done, band_count);
+        }
+
+        static void on_done(void* user, ResizeJobStatus status, Image* output) {
+            auto* hold = static_cast<std::shared_ptr<State>*>(user);
+            std::shared_ptr<State> state = std::move(*hold);
+            delete hold;
+            state->status = status;
+            state->output.reset(output);
+            if (state->phase.exchange(Phase::Completed, std::memory_order_acq_rel) != Phase::Suspended) return;
+            if (state->resumer) {
+                state->resumer(state->handle);
+            } else {
+                state->handle.resume();
+            }
+        }
+    };
+
+    const Image* input_;
+    int out_width_;
+    int out_height_;
+    std::stop_token token_;
+    std::shared_ptr<State> state_;
+};
+
+// Bilinear resize to an exact size; the result equals resize_image_to's
+inline ResizeAwaitable resize_async(const Image* input, int out_width, int out_height, std::stop_token token = {},
+                                    ResizeProgress progress = {}, ResizeResumer resumer = {}) {
+    return ResizeAwaitable(input, out_width, out_height, std::move(token), std::move(progress), std::move(resumer));
+}
+
+// Scale by num/denom with resize_image_fixed's output size
+inline ResizeAwaitable resize_async_fixed(const Image* input, int32_t scale_num, int32_t scale_denom,
+                                          std::stop_token token = {}, ResizeProgress progress = {},
+                                          ResizeResumer resumer = {}) {
+    // Left at 0 when the size would overflow, so the co_await throws ResizeFailed
+    int out_width = 0;
+    int out_height = 0;
+    if (input) resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height);
+    return ResizeAwaitable(input, out_width, out_height, std::move(token), std::move(progress), std::move(resumer));
+}
+
+} // namespace resize
+
+#endif // RESIZE_ASYNC_HPP
@@ -0,0 +1,511 @@
+#include "resize_batch.h"
+#include "resize_io.h"
+#include "resize_pool.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Slots per queue unless BatchOptions says otherwise. Together with the
+// worker counts this bounds memory: a resize worker only picks up a new
+// source once its own bands are gone, so roughly depth + decode + resize
+// workers source images and depth + resize + encode workers outputs exist
+// at once.
+#define BATCH_DEFAULT_DEPTH 8
+
+#define BATCH_PATH_MAX 4096
+
+// Files read ahead and written behind through io_uring, per queue slot
+#define BATCH_IO_PER_SLOT 2
+
+// Outputs of at least this many pixels (or sources of four times as many)
+// are split into row bands that idle resize workers can steal, so one huge
+// image does not leave the rest of the pool waiting on a single thread
+#define BATCH_SPLIT_PIXELS (1 << 20)
+
+// Output pixels per band, and the most bands one output is cut into
+#define BATCH_BAND_PIXELS (1 << 18)
+#define BATCH_MAX_BANDS 64
+
+// One image on its way through the pipeline; path is the input path before
+// the resize stage and the output path after it
+typedef struct {
+    char* path;
+    Image* image;
+    unsigned char* bytes;           // encoded input, when read through io
+    size_t len;
+} BatchItem;
+
+typedef struct {
+    const BatchOptions* opt;
+    AsyncIo* io;                    // NULL: the workers read and write files themselves
+    WorkQueue inputs;               // BatchItem without image, with its bytes when io is set
+    WorkPool* resizers;             // one SourceTask per decoded image
+    WorkQueue resized;              // outputs waiting to be encoded
+    atomic_int images;
+    atomic_int outputs;
+    atomic_int failed;
+    _Atomic uint64_t decode_ns;
+    _Atomic uint64_t resize_ns;
+    _Atomic uint64_t encode_ns;
+} BatchRun;
+
+static uint64_t batch_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void free_item(BatchItem* item) {
+    if (!item) return;
+    if (item->image) free_image(item->image);
+    free(item->path);
+    free(item);
+}
+
+int batch_parse_target(const char* text, BatchTarget* target) {
+    BatchTarget t = { 0, 0, 0, 0 };
+    char tail;
+    if (strchr(text, '/')) {
+        if (sscanf(text, "%d/%d%c", &t.num, &t.denom, &tail) != 2 || t.num <= 0 || t.denom <= 0) return 0;
+    } else if (text[0] == 'x') {
+        if (sscanf(text + 1, "%d%c", &t.height, &tail) != 1 || t.height <= 0) return 0;
+    } else {
+        int n = sscanf(text, "%dx%d%c", &t.width, &t.height, &tail);
+        size_t len = strlen(text);
+        if (n == 1 && len > 1 && text[len - 1] == 'x') {
+            t.height = 0;
+        } else if (n != 2 || t.height <= 0) {
+            return 0;
+        }
+        if (t.width <= 0) return 0;
+    }
+    *target = t;
+    return 1;
+}
+
+void batch_target_size(const BatchTarget* t, int width, int height, int* out_width, int* out_height) {
+    if (t->num > 0) {
+        *out_width = (int)((int64_t)width * t->num / t->denom);
+        *out_height = (int)((int64_t)height * t->num / t->denom);
+    } else {
+        *out_width = t->width ? t->width : (int)(((int64_t)width * t->height + height / 2) / height);
+        *out_height = t->height ? t->height : (int)(((int64_t)height * t->width + width / 2) / width);
+    }
+    if (*out_width < 1) *out_width = 1;
+    if (*out_height < 1) *out_height = 1;
+}
+
+// OUTPUT_DIR/<input name without extension>_<target>.png
+static char* output_path(const char* output_dir, const char* input, const BatchTarget* t) {
+    const char* name = strrchr(input, '/');
+    name = name ? name + 1 : input;
+    const char* dot = strrchr(name, '.');
+    int stem = dot && dot != name ? (int)(dot - name) : (int)strlen(name);
+
+    char label[32];
+    if (t->num > 0) {
+        snprintf(label, sizeof(label), "%d-%d", t->num, t->denom);
+    } else if (!t->height) {
+        snprintf(label, sizeof(label), "%dx", t->width);
+    } else if (!t->width) {
+        snprintf(label, sizeof(label), "x%d", t->height);
+    } else {
+        snprintf(label, sizeof(label), "%dx%d", t->width, t->height);
+    }
+
+    char* path = (char*)malloc(BATCH_PATH_MAX);
+    if (path) snprintf(path, BATCH_PATH_MAX, "%s/%.*s_%s.png", output_dir, stem, name, label);
+    return path;
+}
+
+// Resizing one decoded image to every target. The source stays alive until
+// the task and every split output that still reads from it are done.
+typedef struct {
+    WorkTask task;
+    BatchRun* run;
+    BatchItem* source;
+    atomic_int users;
+} SourceTask;
+
+typedef struct SplitResize SplitResize;
+
+typedef struct {
+    WorkTask task;
+    SplitResize* split;
+    int y_begin;
+    int y_end;
+} BandTask;
+
+// One large output being filled band by band; whichever band finishes last
+// hands the image on to the encoders
+struct SplitResize {
+    SourceTask* source;
+    BandedResize* resize;
+    char* path;
+    int width;
+    int height;
+    atomic_int remaining;
+    atomic_int failed;
+    BandTask bands[];
+};
+
+static void release_source(SourceTask* source) {
+    if (atomic_fetch_sub_explicit(&source->users, 1, memory_order_acq_rel) == 1) {
+        free_item(source->source);
+        free(source);
+    }
+}
+
+// Hand a finished output to the encoders, or count it as failed
+static void deliver(BatchRun* run, const BatchItem* source, char* path, Image* image, int width, int height) {
+    if (!path || !image) {
+        fprintf(stderr, "Cannot resize %s to %dx%d\n", source->path, width, height);
+        atomic_fetch_add(&run->failed, 1);
+        free(path);
+        if (image) free_image(image);
+        return;
+    }
+    BatchItem* out = (BatchItem*)calloc(1, sizeof(BatchItem));
+    if (!out) {
+        atomic_fetch_add(&run->failed, 1);
+        free(path);
+        free_image(image);
+        return;
+    }
+    out->path = path;
+    out->image = image;
+    work_queue_push(&run->resized, out);
+}
+
+static void run_band(WorkTask* task, WorkPool* pool) {
+    (void)pool;
+    BandTask* band = (BandTask*)task;
+    SplitResize* split = band->split;
+    BatchRun* run = split->source->run;
+
+    uint64_t start = batch_now_ns();
+    if (!banded_resize_run(split->resize, band->y_begin, band->y_end)) {
+        atomic_store_explicit(&split->failed, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&run->resize_ns, batch_now_ns() - start, memory_order_relaxed);
+
+    // Nothing of split may be touched after this unless it was the last band
+    if (atomic_fetch_sub_explicit(&split->remaining, 1, memory_order_acq_rel) != 1) return;
+
+    SourceTask* source = split->source;
+    Image* image = banded_resize_finish(split->resize);
+    if (image && atomic_load_explicit(&split->failed, memory_order_relaxed)) {
+        free_image(image);
+        image = NULL;
+    }
+    deliver(run, source->source, split->path, image, split->width, split->height);
+    free(split);
+    release_source(source);
+}
+
+// Start a banded resize of a large output; its bands go on this worker's
+// deque. Returns 0 if it could not be set up.
+static int spawn_split(SourceTask* source, WorkPool* pool, char* path, int width, int height) {
+    int band_rows = BATCH_BAND_PIXELS / width;
+    if (band_rows < 8) band_rows = 8;
+    if ((height + band_rows - 1) / band_rows > BATCH_MAX_BANDS) {
+        band_rows = (height + BATCH_MAX_BANDS - 1) / BATCH_MAX_BANDS;
+    }
+    int band_count = (height + band_rows - 1) / band_rows;
+
+    SplitResize* split = (SplitResize*)malloc(sizeof(SplitResize) + (size_t)band_count * sizeof(BandTask));
+    if (!split) return 0;
+    split->resize = banded_resize_create(source->source->image, width, height);
+    if (!split->resize) {
+        free(split);
+        return 0;
+    }
+    split->source = source;
+    split->path = path;
+    split->width = width;
+    split->height = height;
+    atomic_init(&split->remaining, band_count);
+    atomic_init(&split->failed, 0);
+    atomic_fetch_add_explicit(&source->users, 1, memory_order_relaxed);
+
+    for (int b = 0; b < band_count; b++) {
+        BandTask* band = &split->bands[b];
+        band->task.run = run_band;
+        band->split = split;
+        band->y_begin = b * band_rows;
+        band->y_end = band->y_begin + band_rows < height ? band->y_begin + band_rows : height;
+    }
+    // Spawned last to first so this worker, taking LIFO, starts at the top
+    // of the image while thieves take bands from the other end
+    for (int b = band_count - 1; b >= 0; b--) {
+        work_pool_spawn(pool, &split->bands[b].task);
+    }
+    return 1;
+}
+
+static void run_source(WorkTask* task, WorkPool* pool) {
+    SourceTask* source = (SourceTask*)task;
+    BatchRun* run = source->run;
+    const BatchOptions* opt = run->opt;
+    const Image* image = source->source->image;
+    int64_t source_pixels = (int64_t)image->width * image->height;
+    int split_allowed = work_pool_size(pool) > 1;
+
+    for (int t = 0; t < opt->target_count; t++) {
+        int out_width, out_height;
+        batch_target_size(&opt->targets[t], image->width, image->height, &out_width, &out_height);
+        char* path = output_path(opt->output_dir, source->source->path, &opt->targets[t]);
+
+        int64_t out_pixels = (int64_t)out_width * out_height;
+        if (path && split_allowed && (out_pixels >= BATCH_SPLIT_PIXELS || source_pixels >= 4 * (int64_t)BATCH_SPLIT_PIXELS) &&
+            spawn_split(source, pool, path, out_width, out_height)) {
+            continue;
+        }
+
+        uint64_t start = batch_now_ns();
+        Image* out = path ? resize_image_to(image, out_width, out_height) : NULL;
+        atomic_fetch_add_explicit(&run->resize_ns, batch_now_ns() - start, memory_order_relaxed);
+        deliver(run, source->source, path, out, out_width, out_height);
+    }
+    release_source(source);
+}
+
+static void* decode_worker(void* arg) {
+    BatchRun* run = (BatchRun*)arg;
+    BatchItem* item;
+    while ((item = (BatchItem*)work_queue_pop(&run->inputs)) != NULL) {
+        uint64_t start = batch_now_ns();
+        if (run->io) {
+            item->image = item->bytes ? load_image_from_memory(item->bytes, item->len) : NULL;
+            async_io_release(run->io, item->bytes);
+            item->bytes = NULL;
+        } else {
+            item->image = load_image_timed(item->path, NULL);
+        }
+        atomic_fetch_add_explicit(&run->decode_ns, batch_now_ns() - start, memory_order_relaxed);
+
+        SourceTask* task = item->image ? (SourceTask*)malloc(sizeof(SourceTask)) : NULL;
+        if (!task) {
+            fprintf(stderr, "Cannot load %s\n", item->path);
+            atomic_fetch_add(&run->failed, 1);
+            free_item(item);
+            continue;
+        }
+        atomic_fetch_add(&run->images, 1);
+        task->task.run = run_source;
+        task->run = run;
+        task->source = item;
+        atomic_init(&task->users, 1);
+        work_pool_submit(run->resizers, &task->task);
+    }
+    return NULL;
+}
+
+static void item_written(BatchRun* run, BatchItem* item, int saved) {
+    if (saved) {
+        atomic_fetch_add(&run->outputs, 1);
+        if (run->opt->verbose) {
+            printf("Wrote %s (%dx%d)\n", item->path, item->image->width, item->image->height);
+        }
+    } else {
+        fprintf(stderr, "Cannot write %s\n", item->path);
+        atomic_fetch_add(&run->failed, 1);
+    }
+    free_item(item);
+}
+
+static void* encode_worker(void* arg) {
+    BatchRun* run = (BatchRun*)arg;
+    BatchItem* item;
+    while ((item = (BatchItem*)work_queue_pop(&run->resized)) != NULL) {
+        uint64_t start = batch_now_ns();
+        if (run->io) {
+            // Written behind by the I/O thread, which finishes the item
+            int len;
+            unsigned char* png = encode_image_png(item->image, &len);
+            atomic_fetch_add_explicit(&run->encode_ns, batch_now_ns() - start, memory_order_relaxed);
+            if (png) {
+                async_io_write(run->io, item->path, png, (size_t)len, item);
+            } else {
+                item_written(run, item, 0);
+            }
+            continue;
+        }
+
+        int saved = save_image_timed(item->image, item->path, NULL);
+        atomic_fetch_add_explicit(&run->encode_ns, batch_now_ns() - start, memory_order_relaxed);
+        item_written(run, item, saved);
+    }
+    return NULL;
+}
+
+// I/O thread callbacks. The inputs queue has a slot for every read the I/O
+// layer lets out, and a read (failed or not) keeps its slot until the
+// decode worker releases it, so handing an item on never blocks.
+static void input_read(void* context, void* user, unsigned char* bytes, size_t len, int error) {
+    BatchRun* run = (BatchRun*)context;
+    BatchItem* item = (BatchItem*)user;
+    (void)error;
+    item->bytes = bytes;
+    item->len = len;
+    work_queue_push(&run->inputs, item);
+}
+
+static void output_written(void* context, void* user, int error) {
+    item_written((BatchRun*)context, (BatchItem*)user, error == 0);
+}
+
+// Queue one input file for decoding
+static void submit_path(BatchRun* run, const char* path) {
+    BatchItem* item = (BatchItem*)calloc(1, sizeof(BatchItem));
+    if (item) item->path = strdup(path);
+    if (!item || !item->path) {
+        atomic_fetch_add(&run->failed, 1);
+        free_item(item);
+        return;
+    }
+    if (run->io) {
+        async_io_read(run->io, path, item);
+    } else {
+        work_queue_push(&run->inputs, item);
+    }
+}
+
+// Queue an image file, every regular file of a directory, or every line of
+// an @list file
+static void submit_input(BatchRun* run, const char* input) {
+    if (input[0] == '@') {
+        FILE* list = fopen(input + 1, "r");
+        if (!list) {
+            fprintf(stderr, "Cannot open list %s\n", input + 1);
+            atomic_fetch_add(&run->failed, 1);
+            return;
+        }
+        char line[BATCH_PATH_MAX];
+        while (fgets(line, sizeof(line), list)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] && line[0] != '#') submit_path(run, line);
+        }
+        fclose(list);
+        return;
+    }
+
+    struct stat st;
+    if (stat(input, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(input);
+        if (!dir) {
+            fprintf(stderr, "Cannot open directory %s\n", input);
+            atomic_fetch_add(&run->failed, 1);
+            return;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            char path[BATCH_PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", input, entry->d_name);
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) submit_path(run, path);
+        }
+        closedir(dir);
+        return;
+    }
+
+    submit_path(run, input);
+}
+
+// Start up to count workers; returns how many started
+static int start_workers(pthread_t* threads, int count, void* (*worker)(void*), BatchRun* run) {
+    int started = 0;
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&threads[started], NULL, worker, run) == 0) started++;
+    }
+    return started;
+}
+
+// Send each worker of a stage its stop item and wait for all of them
+static void stop_workers(WorkQueue* queue, pthread_t* threads, int count) {
+    for (int i = 0; i < count; i++) {
+        work_queue_push(queue, NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int run_batch(const BatchOptions* opt, BatchStats* stats) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    int wanted[3] = {
+        opt->decode_threads > 0 ? opt->decode_threads : (int)cpus,
+        opt->resize_threads > 0 ? opt->resize_threads : (int)cpus,
+        opt->encode_threads > 0 ? opt->encode_threads : (int)cpus
+    };
+    int depth = opt->queue_depth > 0 ? opt->queue_depth : BATCH_DEFAULT_DEPTH;
+
+    memset(stats, 0, sizeof(*stats));
+    if (opt->target_count < 1) return 0;
+    if (mkdir(opt->output_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s\n", opt->output_dir);
+        return 0;
+    }
+
+    BatchRun run;
+    memset(&run, 0, sizeof(run));
+    run.opt = opt;
+    pthread_t* threads[2] = {
+        (pthread_t*)malloc((size_t)wanted[0] * sizeof(pthread_t)),
+        (pthread_t*)malloc((size_t)wanted[2] * sizeof(pthread_t))
+    };
+    int io_depth = depth * BATCH_IO_PER_SLOT;
+    if (!opt->blocking_io) run.io = async_io_create(io_depth, io_depth, input_read, output_written, &run);
+    int ok = threads[0] && threads[1] && work_queue_init(&run.inputs, run.io ? io_depth : depth) &&
+             work_queue_init(&run.resized, depth);
+
+    uint64_t start = batch_now_ns();
+
+    // Downstream stages first, so every started stage has somewhere to
+    // deliver; a stage that cannot start any worker stops the ones upstream
+    int started[3] = { 0, 0, 0 };
+    if (ok) started[2] = start_workers(threads[1], wanted[2], encode_worker, &run);
+    if (started[2]) run.resizers = work_pool_create(wanted[1], depth);
+    if (run.resizers) started[1] = work_pool_size(run.resizers);
+    if (started[1]) started[0] = start_workers(threads[0], wanted[0], decode_worker, &run);
+    ok = ok && started[0] && started[1] && started[2];
+
+    if (ok) {
+        for (int i = 0; i < opt->input_count; i++) {
+            submit_input(&run, opt->inputs[i]);
+        }
+    }
+
+    // Each stage drains before the next one is told to stop; the pool only
+    // retires its workers once every band spawned so far has run
+    if (run.io) async_io_wait_reads(run.io);
+    if (started[0]) stop_workers(&run.inputs, threads[0], started[0]);
+    if (run.resizers) work_pool_shutdown(run.resizers);
+    if (started[2]) stop_workers(&run.resized, threads[1], started[2]);
+    async_io_destroy(run.io);
+
+    stats->seconds = (batch_now_ns() - start) / 1e9;
+    stats->images = atomic_load(&run.images);
+    stats->outputs = atomic_load(&run.outputs);
+    stats->failed = atomic_load(&run.failed);
+    stats->decode_busy = atomic_load(&run.decode_ns) / 1e9;
+    stats->resize_busy = atomic_load(&run.resize_ns) / 1e9;
+    stats->encode_busy = atomic_load(&run.encode_ns) / 1e9;
+    stats->async_io = run.io != NULL;
+
+    work_queue_destroy(&run.inputs);
+    work_queue_destroy(&run.resized);
+    for (int s = 0; s < 2; s++) {
+        free(threads[s]);
+    }
+    return ok;
+}
@@ -0,0 +1,57 @@
+#ifndef RESIZE_BATCH_H
+#define RESIZE_BATCH_H
+
+#include "image_resize.h"
+
+// Batch resizing: many inputs, several target sizes each, in one process.
+// Decode, resize and encode run on their own worker threads connected by
+// bounded queues, so disk, CPU-bound resizing and PNG compression overlap
+// and the number of images held in memory at once is capped. Files are
+// read and written through io_uring (resize_io.h) where the kernel allows
+// it, so those workers never wait on storage.
+
+// One output size: a ratio when num > 0, otherwise an exact width and
+// height where 0 keeps the aspect ratio from the other side
+typedef struct {
+    int num;
+    int denom;
+    int width;
+    int height;
+} BatchTarget;
+
+typedef struct {
+    const char* output_dir;         // created if missing
+    const BatchTarget* targets;
+    int target_count;
+    const char* const* inputs;      // image files, directories or @list files (one path per line)
+    int input_count;
+    int decode_threads;             // 0: one per CPU
+    int resize_threads;             // 0: one per CPU
+    int encode_threads;             // 0: one per CPU
+    int queue_depth;                // slots per queue, 0 for the default
+    int verbose;                    // print every file written
+    int blocking_io;                // read and write on the workers even when io_uring is available
+} BatchOptions;
+
+typedef struct {
+    int images;                     // inputs decoded
+    int outputs;                    // files written
+    int failed;                     // inputs or outputs that failed
+    double seconds;                 // wall time
+    double decode_busy;             // summed worker time per stage
+    double resize_busy;
+    double encode_busy;
+    int async_io;                   // files went through io_uring
+} BatchStats;
+
+// Parse "NUM/DENOM", "WxH", "Wx" or "xH"; returns 1 on success
+int batch_parse_target(const char* text, BatchTarget* target);
+
+// Output size of target for a width x height source
+void batch_target_size(const BatchTarget* target, int width, int height, int* out_width, int* out_height);
+
+// Resize every input to every target, writing OUTPUT_DIR/<name>_<target>.png.
+// Returns 1 if the pipeline ran (individual failures are counted in stats).
+int run_batch(const BatchOptions* opt, BatchStats* stats);
+
+#endif // RESIZE_BATCH_H
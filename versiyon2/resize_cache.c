@@ -0,0 +1,541 @@
+#define _GNU_SOURCE
+#include "resize_cache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// XXH64
+// ---------------------------------------------------------------------------
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ull
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4Full
+#define XXH_PRIME3 0x165667B19E3779F9ull
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ull
+#define XXH_PRIME5 0x27D4EB2F165667C5ull
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Little-endian loads; memcpy keeps them legal at any alignment
+static uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME2;
+    return rotl64(acc, 31) * XXH_PRIME1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t value) {
+    acc ^= xxh_round(0, value);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t result_cache_hash(const void* bytes, size_t len, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)bytes;
+    const unsigned char* end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        // Four independent lanes over 32-byte stripes
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint64_t v2 = seed + XXH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME5;
+    }
+    h += (uint64_t)len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * XXH_PRIME1;
+        h = rotl64(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * XXH_PRIME5;
+        h = rotl64(h, 11) * XXH_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t key_hash(const ResultKey* key) {
+    return result_cache_hash(key, sizeof(*key), 0);
+}
+
+// ---------------------------------------------------------------------------
+// Cache state
+// ---------------------------------------------------------------------------
+
+typedef struct MemoryEntry {
+    ResultKey key;
+    ResultInfo info;
+    uint64_t hash;
+    int fd;
+    struct MemoryEntry* chain;      // next in the same bucket
+    struct MemoryEntry* newer;      // LRU list
+    struct MemoryEntry* older;
+} MemoryEntry;
+
+// On-disk index: a fixed open-addressing table with linear probing, kept
+// at most half full; removed entries become tombstones until a rebuild
+#define DISK_MAGIC 0x31435352u      // "RSC1"
+#define DISK_SLOTS 16384
+#define DISK_FREE 0
+#define DISK_USED 1
+#define DISK_REMOVED 2
+
+typedef struct {
+    ResultKey key;
+    ResultInfo info;
+    uint64_t last_used;
+    uint32_t state;
+    uint32_t reserved;
+} DiskEntry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t slots;
+    uint64_t clock;                 // LRU clock, bumped on every use
+    DiskEntry entries[];
+} DiskIndex;
+
+struct ResultCache {
+    pthread_mutex_t lock;
+    ResultCacheStats stats;
+
+    size_t memory_limit;
+    size_t memory_max_entries;      // every entry holds a descriptor open
+    MemoryEntry** buckets;
+    size_t bucket_mask;
+    MemoryEntry* newest;
+    MemoryEntry* oldest;
+
+    char* dir;
+    size_t disk_limit;
+    int index_fd;
+    DiskIndex* index;
+    size_t index_size;
+    uint64_t disk_removed;
+    unsigned temp_counter;
+};
+
+// ---------------------------------------------------------------------------
+// Memory tier
+// ---------------------------------------------------------------------------
+
+static MemoryEntry* memory_find(ResultCache* cache, const ResultKey* key, uint64_t hash) {
+    if (!cache->buckets) return NULL;
+    for (MemoryEntry* e = cache->buckets[hash & cache->bucket_mask]; e; e = e->chain) {
+        if (e->hash == hash && memcmp(&e->key, key, sizeof(*key)) == 0) return e;
+    }
+    return NULL;
+}
+
+static void lru_unlink(ResultCache* cache, MemoryEntry* e) {
+    if (e->newer) e->newer->older = e->older; else cache->newest = e->older;
+    if (e->older) e->older->newer = e->newer; else cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void lru_push(ResultCache* cache, MemoryEntry* e) {
+    e->newer = NULL;
+    e->older = cache->newest;
+    if (cache->newest) cache->newest->newer = e; else cache->oldest = e;
+    cache->newest = e;
+}
+
+static void memory_remove(ResultCache* cache, MemoryEntry* e) {
+    MemoryEntry** link = &cache->buckets[e->hash & cache->bucket_mask];
+    while (*link != e) link = &(*link)->chain;
+    *link = e->chain;
+    lru_unlink(cache, e);
+    cache->stats.memory_bytes -= e->info.size;
+    cache->stats.memory_entries--;
+    close(e->fd);
+    free(e);
+}
+
+// Keep about one bucket per entry
+static int memory_grow(ResultCache* cache) {
+    size_t count = cache->buckets ? (cache->bucket_mask + 1) * 2 : 64;
+    MemoryEntry** buckets = (MemoryEntry**)calloc(count, sizeof(MemoryEntry*));
+    if (!buckets) return 0;
+    for (MemoryEntry* e = cache->newest; e; e = e->older) {
+        e->chain = buckets[e->hash & (count - 1)];
+        buckets[e->hash & (count - 1)] = e;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_mask = count - 1;
+    return 1;
+}
+
+static void memory_insert(ResultCache* cache, const ResultKey* key, uint64_t hash, const ResultInfo* info, int fd) {
+    if (info->size > cache->memory_limit || memory_find(cache, key, hash)) return;
+    while (cache->oldest && (cache->stats.memory_bytes + info->size > cache->memory_limit ||
+                             cache->stats.memory_entries >= cache->memory_max_entries)) {
+        memory_remove(cache, cache->oldest);
+        cache->stats.memory_evictions++;
+    }
+    if (cache->stats.memory_entries >= cache->bucket_mask + 1 || !cache->buckets) {
+        if (!memory_grow(cache) && !cache->buckets) return;
+    }
+
+    MemoryEntry* e = (MemoryEntry*)malloc(sizeof(MemoryEntry));
+    int copy = e ? fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1;
+    if (copy < 0) {
+        free(e);
+        return;
+    }
+    e->key = *key;
+    e->info = *info;
+    e->hash = hash;
+    e->fd = copy;
+    e->chain = cache->buckets[hash & cache->bucket_mask];
+    cache->buckets[hash & cache->bucket_mask] = e;
+    lru_push(cache, e);
+    cache->stats.memory_bytes += info->size;
+    cache->stats.memory_entries++;
+}
+
+// ---------------------------------------------------------------------------
+// Disk tier
+// ---------------------------------------------------------------------------
+
+static void disk_path(const ResultCache* cache, const ResultKey* key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx-%016llx.res", cache->dir, (unsigned long long)key->source_hash,
+             (unsigned long long)key_hash(key));
+}
+
+// Slot holding key, or -1; *insert_at gets the first reusable slot on the way
+static long disk_find(const ResultCache* cache, const ResultKey* key, uint64_t hash, long* insert_at) {
+    DiskIndex* index = cache->index;
+    size_t mask = index->slots - 1;
+    long reusable = -1;
+    for (size_t i = 0, slot = hash & mask; i < index->slots; i++, slot = (slot + 1) & mask) {
+        DiskEntry* e = &index->entries[slot];
+        if (e->state == DISK_FREE) {
+            if (reusable < 0) reusable = (long)slot;
+            break;
+        }
+        if (e->state == DISK_REMOVED) {
+            if (reusable < 0) reusable = (long)slot;
+        } else if (memcmp(&e->key, key, sizeof(*key)) == 0) {
+            return (long)slot;
+        }
+    }
+    if (insert_at) *insert_at = reusable;
+    return -1;
+}
+
+static void disk_remove(ResultCache* cache, DiskEntry* e) {
+    char path[4096];
+    disk_path(cache, &e->key, path, sizeof(path));
+    unlink(path);
+    cache->stats.disk_bytes -= e->info.size;
+    cache->stats.disk_entries--;
+    e->state = DISK_REMOVED;
+    cache->disk_removed++;
+}
+
+static void disk_evict_oldest(ResultCache* cache) {
+    DiskIndex* index = cache->index;
+    DiskEntry* oldest = NULL;
+    for (uint32_t i = 0; i < index->slots; i++) {
+        DiskEntry* e = &index->entries[i];
+        if (e->state == DISK_USED && (!oldest || e->last_used < oldest->last_used)) oldest = e;
+    }
+    if (oldest) {
+        disk_remove(cache, oldest);
+        cache->stats.disk_evictions++;
+    }
+}
+
+// Re-insert every live entry to clear out tombstones
+static void disk_rebuild(ResultCache* cache) {
+    DiskIndex* index = cache->index;
+    DiskEntry* live = (DiskEntry*)malloc((size_t)cache->stats.disk_entries * sizeof(DiskEntry) + 1);
+    if (!live) return;
+    size_t count = 0;
+    for (uint32_t i = 0; i < index->slots; i++) {
+        if (index->entries[i].state == DISK_USED) live[count++] = index->entries[i];
+    }
+    memset(index->entries, 0, (size_t)index->slots * sizeof(DiskEntry));
+    for (size_t i = 0; i < count; i++) {
+        size_t mask = index->slots - 1;
+        size_t slot = key_hash(&live[i].key) & mask;
+        while (index->entries[slot].state != DISK_FREE) slot = (slot + 1) & mask;
+        index->entries[slot] = live[i];
+    }
+    cache->disk_removed = 0;
+    free(live);
+}
+
+// Delete every result file, for an index that had to be recreated
+static void disk_clear_files(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) return;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if ((len > 4 && strcmp(entry->d_name + len - 4, ".res") == 0) || strncmp(entry->d_name, "tmp.", 4) == 0) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+static int disk_open(ResultCache* cache, const char* dir, size_t limit) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return 0;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) return 0;
+
+    // One daemon per cache directory
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "Cache directory %s is in use by another process\n", dir);
+        close(fd);
+        return 0;
+    }
+
+    size_t size = sizeof(DiskIndex) + (size_t)DISK_SLOTS * sizeof(DiskEntry);
+    struct stat st;
+    int fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != size;
+    if (fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0)) {
+        close(fd);
+        return 0;
+    }
+    DiskIndex* index = (DiskIndex*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (index == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+    if (fresh || index->magic != DISK_MAGIC || index->slots != DISK_SLOTS) {
+        memset(index, 0, size);
+        index->magic = DISK_MAGIC;
+        index->slots = DISK_SLOTS;
+        disk_clear_files(dir);
+    }
+
+    cache->dir = strdup(dir);
+    cache->disk_limit = limit;
+    cache->index_fd = fd;
+    cache->index = index;
+    cache->index_size = size;
+    for (uint32_t i = 0; i < index->slots; i++) {
+        const DiskEntry* e = &index->entries[i];
+        if (e->state == DISK_USED) {
+            cache->stats.disk_bytes += e->info.size;
+            cache->stats.disk_entries++;
+        } else if (e->state == DISK_REMOVED) {
+            cache->disk_removed++;
+        }
+    }
+    return cache->dir != NULL;
+}
+
+// Move a finished temporary file into the index, evicting as needed
+static void disk_insert(ResultCache* cache, const ResultKey* key, const ResultInfo* info, const char* temp) {
+    DiskIndex* index = cache->index;
+    uint64_t hash = key_hash(key);
+    if (disk_find(cache, key, hash, NULL) >= 0) {
+        unlink(temp);
+        return;
+    }
+    while (cache->stats.disk_entries > 0 && (cache->stats.disk_bytes + info->size > cache->disk_limit ||
+                                             cache->stats.disk_entries + 1 > index->slots / 2)) {
+        disk_evict_oldest(cache);
+    }
+    if (cache->stats.disk_entries + cache->disk_removed + 1 > index->slots / 4 * 3) disk_rebuild(cache);
+
+    long slot;
+    char path[4096];
+    disk_path(cache, key, path, sizeof(path));
+    if (disk_find(cache, key, hash, &slot) >= 0 || slot < 0 || rename(temp, path) != 0) {
+        unlink(temp);
+        return;
+    }
+    DiskEntry* e = &index->entries[slot];
+    if (e->state == DISK_REMOVED) cache->disk_removed--;
+    e->key = *key;
+    e->info = *info;
+    e->last_used = ++index->clock;
+    e->state = DISK_USED;
+    cache->stats.disk_bytes += info->size;
+    cache->stats.disk_entries++;
+}
+
+static int write_all(int fd, const void* bytes, size_t len) {
+    const char* p = (const char*)bytes;
+    while (len > 0) {
+        ssize_t put = write(fd, p, len);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return 0;
+        p += put;
+        len -= (size_t)put;
+    }
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Public interface
+// ---------------------------------------------------------------------------
+
+ResultCache* result_cache_open(size_t memory_limit, const char* disk_dir, size_t disk_limit) {
+    ResultCache* cache = (ResultCache*)calloc(1, sizeof(ResultCache));
+    if (!cache) return NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->index_fd = -1;
+    cache->memory_limit = memory_limit;
+
+    // Leave half of the descriptor limit to connections and files
+    struct rlimit files;
+    cache->memory_max_entries = getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY
+                                    ? (size_t)files.rlim_cur / 2
+                                    : 4096;
+    if (cache->memory_max_entries < 16) cache->memory_max_entries = 16;
+
+    if (disk_dir && disk_limit > 0 && !disk_open(cache, disk_dir, disk_limit)) {
+        fprintf(stderr, "Disk cache in %s disabled\n", disk_dir);
+    }
+    return cache;
+}
+
+void result_cache_close(ResultCache* cache) {
+    if (!cache) return;
+    while (cache->oldest) {
+        memory_remove(cache, cache->oldest);
+    }
+    free(cache->buckets);
+    if (cache->index) munmap(cache->index, cache->index_size);
+    if (cache->index_fd >= 0) close(cache->index_fd);
+    free(cache->dir);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+int result_cache_lookup(ResultCache* cache, const ResultKey* key, ResultInfo* info, int* tier) {
+    uint64_t hash = key_hash(key);
+    int fd = -1;
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.lookups++;
+
+    MemoryEntry* e = memory_find(cache, key, hash);
+    if (e) {
+        fd = fcntl(e->fd, F_DUPFD_CLOEXEC, 0);
+        if (fd >= 0) {
+            lru_unlink(cache, e);
+            lru_push(cache, e);
+            *info = e->info;
+            *tier = 1;
+            cache->stats.memory_hits++;
+        }
+    }
+
+    long slot = fd < 0 && cache->index ? disk_find(cache, key, hash, NULL) : -1;
+    if (slot >= 0) {
+        DiskEntry* d = &cache->index->entries[slot];
+        char path[4096];
+        disk_path(cache, key, path, sizeof(path));
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        // A file shorter than its index entry (lost on a crash, or edited)
+        // would be mapped past its end by the client
+        struct stat st;
+        if (fd >= 0 && (fstat(fd, &st) != 0 || (uint64_t)st.st_size != d->info.size)) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd >= 0) {
+            d->last_used = ++cache->index->clock;
+            *info = d->info;
+            *tier = 2;
+            cache->stats.disk_hits++;
+        } else {
+            disk_remove(cache, d);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return fd;
+}
+
+void result_cache_store(ResultCache* cache, const ResultKey* key, const ResultInfo* info, int fd,
+                        const void* bytes) {
+    uint64_t hash = key_hash(key);
+    char temp[4096];
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.stores++;
+    if (cache->memory_limit > 0) memory_insert(cache, key, hash, info, fd);
+    int to_disk = cache->index && info->size <= cache->disk_limit && disk_find(cache, key, hash, NULL) < 0;
+    if (to_disk) snprintf(temp, sizeof(temp), "%s/tmp.%d.%u", cache->dir, (int)getpid(), cache->temp_counter++);
+    pthread_mutex_unlock(&cache->lock);
+    if (!to_disk) return;
+
+    // The file is written outside the lock and only renamed into place
+    // under it, so a reader never sees a partial result
+    int out = open(temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (out < 0) return;
+    // Synced before the rename, so the index never names data that is not
+    // on disk yet
+    int written = write_all(out, bytes, info->size) && fsync(out) == 0;
+    if (close(out) != 0) written = 0;
+    if (!written) {
+        unlink(temp);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    disk_insert(cache, key, info, temp);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void result_cache_stats(ResultCache* cache, ResultCacheStats* stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
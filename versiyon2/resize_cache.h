@@ -0,0 +1,67 @@
+#ifndef RESIZE_CACHE_H
+#define RESIZE_CACHE_H
+
+#include "resize_batch.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Content-addressed cache of finished daemon results. A result is keyed by
+// a hash of the encoded source bytes plus the resize parameters, so a
+// repeated request is answered without decoding, resizing or encoding.
+//
+// The memory tier is an LRU of sealed memfds: a hit hands out a dup of the
+// descriptor. The disk tier keeps one file per result in a directory next
+// to an mmap-ed open-addressing index, survives restarts and hands out a
+// read-only descriptor of the file. Files are only ever replaced by rename,
+// so a descriptor stays valid after its entry is evicted.
+
+typedef struct {
+    uint64_t source_hash;           // result_cache_hash of the encoded source
+    uint64_t source_size;
+    int32_t filter;
+    int32_t format;
+    BatchTarget target;
+} ResultKey;
+
+typedef struct {
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t reserved;
+    uint64_t size;                  // bytes of the result
+} ResultInfo;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t memory_hits;
+    uint64_t disk_hits;
+    uint64_t stores;
+    uint64_t memory_evictions;
+    uint64_t disk_evictions;
+    uint64_t memory_bytes;
+    uint64_t memory_entries;
+    uint64_t disk_bytes;
+    uint64_t disk_entries;
+} ResultCacheStats;
+
+typedef struct ResultCache ResultCache;
+
+// memory_limit 0 disables the memory tier, disk_dir NULL the disk tier
+ResultCache* result_cache_open(size_t memory_limit, const char* disk_dir, size_t disk_limit);
+void result_cache_close(ResultCache* cache);
+
+// 64-bit xxHash (XXH64) of bytes
+uint64_t result_cache_hash(const void* bytes, size_t len, uint64_t seed);
+
+// Read-only descriptor holding the cached result (the caller closes it) and
+// its info, or -1. *tier is 1 for a memory hit and 2 for a disk hit.
+int result_cache_lookup(ResultCache* cache, const ResultKey* key, ResultInfo* info, int* tier);
+
+// Remember a result: fd is a sealed memfd with info->size bytes, which the
+// memory tier keeps a dup of; bytes is the same content for the disk tier
+void result_cache_store(ResultCache* cache, const ResultKey* key, const ResultInfo* info, int fd,
+                        const void* bytes);
+
+void result_cache_stats(ResultCache* cache, ResultCacheStats* stats);
+
+#endif // RESIZE_CACHE_H
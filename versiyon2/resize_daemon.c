@@ -0,0 +1,812 @@
+#define _GNU_SOURCE
+#include "resize_daemon.h"
+#include "resize_cache.h"
+#include "resize_pool.h"
+#include "resize_ring.h"
+#include "resize_source_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Listen backlog; the web tier keeps its connections open, so this only
+// matters for bursts of new ones
+#define DAEMON_BACKLOG 128
+
+// Readiness events handled per epoll_wait
+#define DAEMON_EVENTS 64
+
+// How often an idle ring session checks for shutdown and a vanished client
+#define DAEMON_RING_POLL_MS 200
+
+// How often an idle daemon drops expired decoded sources
+#define DAEMON_SWEEP_MS 1000
+
+typedef struct {
+    const DaemonOptions* opt;
+    WorkPool* pool;
+    ResultCache* cache;             // NULL when disabled
+    SourceCache* sources;           // NULL when disabled
+    int epoll_fd;
+    atomic_int served;
+    atomic_int failed;
+    atomic_int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;            // signalled when a ring session ends
+    int sessions;                   // ring sessions still running
+} Daemon;
+
+// Answering one readable connection. The connection is registered with
+// EPOLLONESHOT, so only this task reads from it until it is re-armed.
+typedef struct {
+    WorkTask task;
+    Daemon* daemon;
+    int fd;
+} ConnectionTask;
+
+// ---------------------------------------------------------------------------
+// Descriptor passing
+// ---------------------------------------------------------------------------
+
+// Send one message with fd attached when fd >= 0; returns 1 on success
+static int send_with_fd(int sock, const void* data, size_t len, int fd) {
+    struct iovec iov = { (void*)data, len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == (ssize_t)len;
+}
+
+// Receive one message of exactly len bytes and the descriptor attached to
+// it (-1 if none). Returns len, 0 at end of stream, -1 on error or on a
+// message of the wrong size.
+static ssize_t recv_with_fd(int sock, void* data, size_t len, int* fd) {
+    struct iovec iov = { data, len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t got;
+    do {
+        got = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (got < 0 && errno == EINTR);
+
+    *fd = -1;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (got == (ssize_t)len && !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) return got;
+
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+    return got == 0 ? 0 : -1;
+}
+
+int daemon_call(int sock, const DaemonRequest* request, int input_fd, DaemonReply* reply, int* result_fd) {
+    *result_fd = -1;
+    if (!send_with_fd(sock, request, sizeof(*request), input_fd)) return 0;
+    if (recv_with_fd(sock, reply, sizeof(*reply), result_fd) <= 0) return 0;
+    if (reply->magic != DAEMON_MAGIC || (reply->status != 0 && *result_fd >= 0)) {
+        if (*result_fd >= 0) close(*result_fd);
+        *result_fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Request handling
+// ---------------------------------------------------------------------------
+
+// Encoded source file in memory: regular files are mapped, anything else
+// (pipes, sockets) is read to the end
+typedef struct {
+    unsigned char* bytes;
+    size_t len;
+    int mapped;
+} SourceBytes;
+
+// Returns 0 or an errno value
+static int read_source(int fd, SourceBytes* source) {
+    memset(source, 0, sizeof(*source));
+    struct stat st;
+    if (fstat(fd, &st) != 0) return errno;
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* bytes = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (bytes == MAP_FAILED) return errno;
+        source->bytes = (unsigned char*)bytes;
+        source->len = (size_t)st.st_size;
+        source->mapped = 1;
+        return 0;
+    }
+
+    size_t capacity = 1 << 16;
+    source->bytes = (unsigned char*)malloc(capacity);
+    while (source->bytes) {
+        if (source->len == capacity) {
+            unsigned char* grown = (unsigned char*)realloc(source->bytes, capacity * 2);
+            if (!grown) break;
+            source->bytes = grown;
+            capacity *= 2;
+        }
+        ssize_t got = read(fd, source->bytes + source->len, capacity - source->len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got == 0) return 0;
+        if (got < 0) {
+            int error = errno;
+            free(source->bytes);
+            source->bytes = NULL;
+            return error;
+        }
+        source->len += (size_t)got;
+    }
+    free(source->bytes);
+    source->bytes = NULL;
+    return ENOMEM;
+}
+
+static void release_source(SourceBytes* source) {
+    if (source->mapped) {
+        munmap(source->bytes, source->len);
+    } else {
+        free(source->bytes);
+    }
+}
+
+// PNG replies are encoded into a buffer of the pool worker's own, kept
+// across requests so that once it has grown a reply allocates nothing; it
+// is freed when the worker exits
+static __thread EncodedBuffer* reply_png;
+static pthread_key_t reply_png_key;
+static pthread_once_t reply_png_once = PTHREAD_ONCE_INIT;
+
+static void free_reply_png(void* buffer) {
+    EncodedBuffer* png = (EncodedBuffer*)buffer;
+    free(png->bytes);
+    free(png);
+    reply_png = NULL;
+}
+
+static void create_reply_png_key(void) {
+    pthread_key_create(&reply_png_key, free_reply_png);
+}
+
+// The calling thread's PNG buffer, or NULL if out of memory
+static EncodedBuffer* thread_reply_png(void) {
+    if (reply_png) return reply_png;
+    pthread_once(&reply_png_once, create_reply_png_key);
+    reply_png = (EncodedBuffer*)calloc(1, sizeof(EncodedBuffer));
+    if (reply_png) pthread_setspecific(reply_png_key, reply_png);
+    return reply_png;
+}
+
+// Sealed memfd holding len bytes, or -1
+static int sealed_memfd(const void* bytes, size_t len) {
+    int fd = memfd_create("resized", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    const char* p = (const char*)bytes;
+    size_t left = len;
+    while (left > 0) {
+        ssize_t put = write(fd, p, left);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) {
+            close(fd);
+            return -1;
+        }
+        p += put;
+        left -= (size_t)put;
+    }
+    // The client can map it but neither side can change it any more
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// A target the filter can produce: only bilinear takes an exact size, the
+// other kernels scale by a ratio
+static int valid_target(const BatchTarget* t, int filter) {
+    if (filter < DAEMON_FILTER_BILINEAR || filter > DAEMON_FILTER_LANCZOS3) return 0;
+    if (t->num > 0) return t->denom > 0;
+    return filter == DAEMON_FILTER_BILINEAR && t->num == 0 && t->width >= 0 && t->height >= 0 &&
+           (t->width || t->height);
+}
+
+static Image* resize_with_filter(const Image* input, int filter, const BatchTarget* t, int width, int height) {
+    static const ResizeFilter filters[] = { FILTER_CATMULL_ROM, FILTER_MITCHELL, FILTER_LANCZOS2, FILTER_LANCZOS3 };
+    switch (filter) {
+    case DAEMON_FILTER_BILINEAR:
+        return resize_image_to(input, width, height);
+    case DAEMON_FILTER_NEAREST:
+        return resize_image_nearest(input, t->num, t->denom);
+    default:
+        return resize_image_filter(input, t->num, t->denom, filters[filter - DAEMON_FILTER_CATMULL_ROM]);
+    }
+}
+
+// Read the source on first use; returns 0 or an errno value
+static int need_source(int fd, SourceBytes* source) {
+    return source->bytes ? 0 : read_source(fd, source);
+}
+
+// Decoded input for a request: a recently decoded image from the source
+// cache (*entry held until released) or a fresh decode (*decoded, which the
+// caller frees). NULL with *status set on failure.
+static const Image* source_image(Daemon* daemon, int fd, SourceBytes* source, SourceKey* key, SourceEntry** entry,
+                                 Image** decoded, int* status) {
+    if (daemon->sources) {
+        if (!key->inode) {
+            // Not a regular file: named by its bytes instead
+            if ((*status = need_source(fd, source)) != 0) return NULL;
+            key->size = source->len;
+            if (!key->content_hash) key->content_hash = result_cache_hash(source->bytes, source->len, 0);
+        }
+        const Image* image = source_cache_get(daemon->sources, key, entry);
+        if (image) return image;
+    }
+
+    Image* image = NULL;
+    if ((*status = need_source(fd, source)) == 0) {
+        image = load_image_from_memory(source->bytes, source->len);
+        if (!image) *status = EBADMSG;
+    }
+    if (!*entry) {
+        *decoded = image;
+        return image;
+    }
+
+    // Requests waiting on the placeholder get the image, or retry alone
+    source_cache_fill(daemon->sources, *entry, image);
+    if (!image) {
+        source_cache_release(daemon->sources, *entry);
+        *entry = NULL;
+    }
+    return image;
+}
+
+// Fill reply and *result_fd for a request on the open source fd; returns 0
+// or an errno value
+static int answer_request(Daemon* daemon, const DaemonRequest* request, int fd, SourceBytes* source,
+                          DaemonReply* reply, int* result_fd) {
+    const BatchTarget* t = &request->target;
+
+    // A regular file is recognised by its identity without reading it
+    SourceKey source_key;
+    struct stat st;
+    memset(&source_key, 0, sizeof(source_key));
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        source_key.device = (uint64_t)st.st_dev;
+        source_key.inode = (uint64_t)st.st_ino;
+        source_key.size = (uint64_t)st.st_size;
+        source_key.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    // Same source bytes and parameters: hand out the stored result
+    ResultKey key;
+    ResultInfo info;
+    int status;
+    memset(&key, 0, sizeof(key));
+    memset(&info, 0, sizeof(info));
+    if (daemon->cache) {
+        if ((status = need_source(fd, source)) != 0) return status;
+        key.source_hash = result_cache_hash(source->bytes, source->len, 0);
+        key.source_size = source->len;
+        key.filter = request->filter;
+        key.format = request->format;
+        key.target = *t;
+        if (!source_key.inode) source_key.content_hash = key.source_hash;
+        int tier;
+        *result_fd = result_cache_lookup(daemon->cache, &key, &info, &tier);
+        if (*result_fd >= 0) {
+            reply->width = info.width;
+            reply->height = info.height;
+            reply->channels = info.channels;
+            reply->format = request->format;
+            reply->cached = tier;
+            reply->size = info.size;
+            return 0;
+        }
+    }
+
+    SourceEntry* entry = NULL;
+    Image* decoded = NULL;
+    const Image* input = source_image(daemon, fd, source, &source_key, &entry, &decoded, &status);
+    if (!input) return status;
+
+    int width, height;
+    batch_target_size(t, input->width, input->height, &width, &height);
+    Image* output = resize_with_filter(input, request->filter, t, width, height);
+    if (decoded) free_image(decoded);
+    source_cache_release(daemon->sources, entry);
+    if (!output) return ENOMEM;
+
+    const void* bytes = output->data;
+    size_t len = (size_t)output->width * output->height * output->channels;
+    if (request->format == DAEMON_FORMAT_PNG) {
+        EncodedBuffer* png = thread_reply_png();
+        int encoded = png && encode_image_png_into(output, png);
+        bytes = encoded ? png->bytes : NULL;
+        len = encoded ? png->len : 0;
+    }
+    *result_fd = bytes ? sealed_memfd(bytes, len) : -1;
+    status = *result_fd >= 0 ? 0 : ENOMEM;
+
+    reply->width = output->width;
+    reply->height = output->height;
+    reply->channels = output->channels;
+    reply->format = request->format;
+    reply->size = len;
+    if (status == 0 && daemon->cache) {
+        info.width = output->width;
+        info.height = output->height;
+        info.channels = output->channels;
+        info.size = len;
+        result_cache_store(daemon->cache, &key, &info, *result_fd, bytes);
+    }
+    free_image(output);
+    return status;
+}
+
+// Fill reply and *result_fd for one request; returns 0 or an errno value
+static int handle_request(Daemon* daemon, const DaemonRequest* request, int input_fd, DaemonReply* reply,
+                          int* result_fd) {
+    if (request->magic != DAEMON_MAGIC) return EPROTO;
+    if ((request->format != DAEMON_FORMAT_PNG && request->format != DAEMON_FORMAT_RAW) ||
+        !valid_target(&request->target, request->filter)) {
+        return EINVAL;
+    }
+
+    int fd = input_fd;
+    if (fd < 0) {
+        if (!memchr(request->path, '\0', sizeof(request->path))) return ENAMETOOLONG;
+        fd = open(request->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return errno;
+    }
+
+    // The encoded bytes are only read when the caches cannot answer without
+    SourceBytes source;
+    memset(&source, 0, sizeof(source));
+    int status = answer_request(daemon, request, fd, &source, reply, result_fd);
+    if (source.bytes) release_source(&source);
+    if (fd != input_fd) close(fd);
+    return status;
+}
+
+// Stop watching a connection and close it
+static void drop_connection(Daemon* daemon, int fd) {
+    epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+}
+
+// ---------------------------------------------------------------------------
+// Shared-memory ring sessions
+// ---------------------------------------------------------------------------
+
+// A client that attached a ring. The connection carries nothing more; it
+// stays open only so the session notices when the client goes away.
+typedef struct {
+    Daemon* daemon;
+    ResizeRing ring;
+    int connection;
+    int filter;
+} RingSession;
+
+// Resize one frame from its input slot into its output slot
+static RingCompletion resize_ring_frame(const RingSession* session, const RingRequest* request) {
+    const ResizeRing* ring = &session->ring;
+    RingCompletion done;
+    memset(&done, 0, sizeof(done));
+    done.slot = request->slot;
+    done.tag = request->tag;
+
+    if (request->slot >= ring->slot_count || request->width <= 0 || request->height <= 0 ||
+        request->channels < 1 || request->channels > 4 ||
+        (uint64_t)request->width * request->height * request->channels > ring->input_slot_bytes ||
+        !valid_target(&request->target, session->filter)) {
+        done.status = EINVAL;
+        return done;
+    }
+
+    Image input = { resize_ring_input(ring, request->slot), request->width, request->height, request->channels };
+    int width, height;
+    batch_target_size(&request->target, input.width, input.height, &width, &height);
+    Image output = { resize_ring_output(ring, request->slot), width, height, input.channels };
+    if ((uint64_t)width * height * input.channels > ring->output_slot_bytes) {
+        done.status = EMSGSIZE;
+        return done;
+    }
+
+    // Bilinear writes straight into the slot; the other kernels only come
+    // with an allocating entry point
+    if (session->filter == DAEMON_FILTER_BILINEAR) {
+        if (!resize_image_into(&input, &output)) done.status = ENOMEM;
+    } else {
+        Image* resized = resize_with_filter(&input, session->filter, &request->target, width, height);
+        if (!resized) {
+            done.status = ENOMEM;
+        } else if ((uint64_t)resized->width * resized->height * resized->channels > ring->output_slot_bytes) {
+            done.status = EMSGSIZE;
+        } else {
+            output.width = resized->width;
+            output.height = resized->height;
+            memcpy(output.data, resized->data, (size_t)resized->width * resized->height * resized->channels);
+        }
+        if (resized) free_image(resized);
+    }
+
+    if (done.status == 0) {
+        done.width = output.width;
+        done.height = output.height;
+        done.channels = output.channels;
+    }
+    return done;
+}
+
+static int client_gone(int connection) {
+    struct pollfd p = { connection, POLLRDHUP, 0 };
+    return poll(&p, 1, 0) > 0 && (p.revents & (POLLRDHUP | POLLHUP | POLLERR));
+}
+
+static void* serve_ring(void* arg) {
+    RingSession* session = (RingSession*)arg;
+    Daemon* daemon = session->daemon;
+    for (;;) {
+        RingRequest request;
+        int got = resize_ring_next(&session->ring, &request, DAEMON_RING_POLL_MS);
+        if (got < 0 || atomic_load(&daemon->stopping)) break;
+        if (got == 0) {
+            if (client_gone(session->connection)) break;
+            continue;
+        }
+
+        RingCompletion done = resize_ring_frame(session, &request);
+        atomic_fetch_add(done.status == 0 ? &daemon->served : &daemon->failed, 1);
+        // Full only if the client reused a slot before reading its
+        // completion; either way the session is over
+        if (!resize_ring_complete(&session->ring, &done)) break;
+    }
+
+    resize_ring_close(&session->ring);
+    close(session->connection);
+    free(session);
+
+    pthread_mutex_lock(&daemon->lock);
+    daemon->sessions--;
+    pthread_cond_broadcast(&daemon->idle);
+    pthread_mutex_unlock(&daemon->lock);
+    return NULL;
+}
+
+// Map the ring a client attached; returns 0 or an errno value
+static int attach_ring(Daemon* daemon, int fd, const DaemonRequest* request, int ring_fd, RingSession** out) {
+    if (request->magic != DAEMON_MAGIC || ring_fd < 0) return EPROTO;
+    if (request->filter < DAEMON_FILTER_BILINEAR || request->filter > DAEMON_FILTER_LANCZOS3) return EINVAL;
+    if (atomic_load(&daemon->stopping)) return ESHUTDOWN;
+
+    RingSession* session = (RingSession*)malloc(sizeof(RingSession));
+    if (!session) return ENOMEM;
+    if (!resize_ring_map(&session->ring, ring_fd)) {
+        free(session);
+        return EINVAL;
+    }
+    session->daemon = daemon;
+    session->connection = fd;
+    session->filter = request->filter;
+    *out = session;
+    return 0;
+}
+
+// Hand the connection over to a session thread (after the attach reply went
+// out, since the session may close the connection at any time)
+static void start_ring_session(Daemon* daemon, RingSession* session) {
+    epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, session->connection, NULL);
+    pthread_mutex_lock(&daemon->lock);
+    daemon->sessions++;
+    pthread_mutex_unlock(&daemon->lock);
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int started = pthread_create(&thread, &attr, serve_ring, session) == 0;
+    pthread_attr_destroy(&attr);
+    if (started) return;
+
+    // The client sees the ring closed
+    pthread_mutex_lock(&daemon->lock);
+    daemon->sessions--;
+    pthread_mutex_unlock(&daemon->lock);
+    resize_ring_close(&session->ring);
+    close(session->connection);
+    free(session);
+}
+
+static void run_connection(WorkTask* task, WorkPool* pool) {
+    (void)pool;
+    ConnectionTask* connection = (ConnectionTask*)task;
+    Daemon* daemon = connection->daemon;
+    int fd = connection->fd;
+    free(connection);
+
+    DaemonRequest request;
+    int input_fd;
+    ssize_t got = recv_with_fd(fd, &request, sizeof(request), &input_fd);
+    if (got <= 0) {
+        drop_connection(daemon, fd);
+        return;
+    }
+
+    DaemonReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = DAEMON_MAGIC;
+    int result_fd = -1;
+    if (request.format == DAEMON_FORMAT_RING) {
+        RingSession* session = NULL;
+        reply.format = DAEMON_FORMAT_RING;
+        reply.status = attach_ring(daemon, fd, &request, input_fd, &session);
+        if (input_fd >= 0) close(input_fd);
+        if (daemon->opt->verbose) {
+            printf("Ring %s%s\n", reply.status == 0 ? "attached" : "refused: ",
+                   reply.status == 0 ? "" : strerror(reply.status));
+        }
+
+        int sent = send_with_fd(fd, &reply, sizeof(reply), -1);
+        if (session) {
+            // A client that vanished meanwhile is noticed by the session
+            start_ring_session(daemon, session);
+            return;
+        }
+        if (sent) {
+            struct epoll_event event = { EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, { .fd = fd } };
+            if (epoll_ctl(daemon->epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0) return;
+        }
+        drop_connection(daemon, fd);
+        return;
+    }
+    reply.status = handle_request(daemon, &request, input_fd, &reply, &result_fd);
+    if (input_fd >= 0) close(input_fd);
+    if (reply.status != 0 && result_fd >= 0) {
+        close(result_fd);
+        result_fd = -1;
+    }
+
+    atomic_fetch_add(reply.status == 0 ? &daemon->served : &daemon->failed, 1);
+    if (daemon->opt->verbose) {
+        const char* source = input_fd >= 0 ? "<fd>" : request.path;
+        if (reply.status == 0) {
+            static const char* const origin[] = { "", " (memory cache)", " (disk cache)" };
+            printf("%s -> %dx%d, %llu bytes%s\n", source, reply.width, reply.height, (unsigned long long)reply.size,
+                   origin[reply.cached]);
+        } else {
+            printf("%s failed: %s\n", source, strerror(reply.status));
+        }
+    }
+
+    int sent = send_with_fd(fd, &reply, sizeof(reply), result_fd);
+    if (result_fd >= 0) close(result_fd);
+    if (!sent) {
+        drop_connection(daemon, fd);
+        return;
+    }
+
+    // Watch for the next request on this connection
+    struct epoll_event event = { EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, { .fd = fd } };
+    if (epoll_ctl(daemon->epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0) drop_connection(daemon, fd);
+}
+
+// ---------------------------------------------------------------------------
+// Event loop
+// ---------------------------------------------------------------------------
+
+static int open_listener(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Message boundaries keep one request per recvmsg, with its descriptor
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, DAEMON_BACKLOG) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Register every pending connection; they start out blocking, since a
+// worker only reads one once epoll reported it readable
+static void accept_connections(Daemon* daemon, int listener) {
+    for (;;) {
+        int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        struct epoll_event event = { EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, { .fd = fd } };
+        if (epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) close(fd);
+    }
+}
+
+static void print_cache_stats(Daemon* daemon) {
+    if (daemon->sources) {
+        SourceCacheStats ss;
+        source_cache_stats(daemon->sources, &ss);
+        printf("Decoded sources: %llu lookups, %.1f%% hits; %llu entries / %.1f MB (%llu evicted, %llu expired)\n",
+               (unsigned long long)ss.lookups, ss.lookups ? 100.0 * ss.hits / ss.lookups : 0.0,
+               (unsigned long long)ss.entries, ss.bytes / 1048576.0, (unsigned long long)ss.evictions,
+               (unsigned long long)ss.expirations);
+    }
+    if (!daemon->cache) {
+        fflush(stdout);
+        return;
+    }
+
+    ResultCacheStats st;
+    result_cache_stats(daemon->cache, &st);
+    uint64_t hits = st.memory_hits + st.disk_hits;
+    printf("Cache: %llu lookups, %.1f%% hits (%llu memory, %llu disk); memory %llu entries / %.1f MB "
+           "(%llu evicted), disk %llu entries / %.1f MB (%llu evicted)\n",
+           (unsigned long long)st.lookups, st.lookups ? 100.0 * hits / st.lookups : 0.0,
+           (unsigned long long)st.memory_hits, (unsigned long long)st.disk_hits,
+           (unsigned long long)st.memory_entries, st.memory_bytes / 1048576.0,
+           (unsigned long long)st.memory_evictions, (unsigned long long)st.disk_entries,
+           st.disk_bytes / 1048576.0, (unsigned long long)st.disk_evictions);
+    fflush(stdout);
+}
+
+int run_daemon(const DaemonOptions* opt) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = opt->workers > 0 ? opt->workers : (cpus > 0 ? (int)cpus : 1);
+
+    // SIGINT, SIGTERM and SIGUSR1 arrive through the event loop; blocked
+    // before the workers start so none of them takes the signal instead
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+
+    Daemon daemon;
+    memset(&daemon, 0, sizeof(daemon));
+    daemon.opt = opt;
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.idle, NULL);
+    daemon.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    int listener = open_listener(opt->socket_path);
+    daemon.pool = work_pool_create(workers, workers * 4);
+    if (opt->cache_memory > 0 || opt->cache_dir) {
+        daemon.cache = result_cache_open(opt->cache_memory, opt->cache_dir, opt->cache_disk);
+    }
+    if (opt->source_memory > 0 && opt->source_ttl_ms > 0) {
+        daemon.sources = source_cache_open(opt->source_memory, opt->source_ttl_ms);
+    }
+
+    int ok = daemon.epoll_fd >= 0 && signal_fd >= 0 && listener >= 0 && daemon.pool;
+    struct epoll_event event = { EPOLLIN, { .fd = listener } };
+    ok = ok && epoll_ctl(daemon.epoll_fd, EPOLL_CTL_ADD, listener, &event) == 0;
+    event.data.fd = signal_fd;
+    ok = ok && epoll_ctl(daemon.epoll_fd, EPOLL_CTL_ADD, signal_fd, &event) == 0;
+
+    if (ok) {
+        printf("Serving on %s with %d workers\n", opt->socket_path, work_pool_size(daemon.pool));
+        fflush(stdout);
+    }
+
+    int running = ok;
+    while (running) {
+        struct epoll_event events[DAEMON_EVENTS];
+        int count = epoll_wait(daemon.epoll_fd, events, DAEMON_EVENTS, daemon.sources ? DAEMON_SWEEP_MS : -1);
+        if (daemon.sources) source_cache_expire(daemon.sources);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == signal_fd) {
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) != (ssize_t)sizeof(info)) continue;
+                if (info.ssi_signo != SIGUSR1) {
+                    running = 0;
+                } else {
+                    print_cache_stats(&daemon);
+                }
+            } else if (fd == listener) {
+                accept_connections(&daemon, listener);
+            } else {
+                ConnectionTask* task = (ConnectionTask*)malloc(sizeof(ConnectionTask));
+                if (!task) {
+                    drop_connection(&daemon, fd);
+                    continue;
+                }
+                task->task.run = run_connection;
+                task->daemon = &daemon;
+                task->fd = fd;
+                work_pool_submit(daemon.pool, &task->task);
+            }
+        }
+    }
+
+    // Requests already handed to the pool are answered and ring sessions
+    // end; idle connections are closed when the process exits
+    if (listener >= 0) {
+        close(listener);
+        unlink(opt->socket_path);
+    }
+    atomic_store(&daemon.stopping, 1);
+    if (daemon.pool) work_pool_shutdown(daemon.pool);
+
+    // Ring sessions notice stopping within one poll interval
+    pthread_mutex_lock(&daemon.lock);
+    while (daemon.sessions > 0) {
+        pthread_cond_wait(&daemon.idle, &daemon.lock);
+    }
+    pthread_mutex_unlock(&daemon.lock);
+    if (ok) {
+        printf("Served %d requests, %d failed\n", atomic_load(&daemon.served), atomic_load(&daemon.failed));
+        print_cache_stats(&daemon);
+    }
+    result_cache_close(daemon.cache);
+    source_cache_close(daemon.sources);
+    if (signal_fd >= 0) close(signal_fd);
+    if (daemon.epoll_fd >= 0) close(daemon.epoll_fd);
+    pthread_mutex_destroy(&daemon.lock);
+    pthread_cond_destroy(&daemon.idle);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return ok;
+}
@@ -0,0 +1,84 @@
+#ifndef RESIZE_DAEMON_H
+#define RESIZE_DAEMON_H
+
+#include "resize_batch.h"
+#include <stdint.h>
+
+// Long-running resize server on a Unix domain socket. One process keeps
+// stb, the worker pool and the allocator warm across requests instead of
+// paying process start-up for every image.
+//
+// A client sends a DaemonRequest per image, optionally with the encoded
+// input file attached as an SCM_RIGHTS descriptor (otherwise path names a
+// file the daemon can read). The daemon answers with a DaemonReply and, on
+// success, a sealed memfd holding the result, so the pixels or PNG bytes
+// are never copied through the socket: the client maps the descriptor.
+// Repeated requests for the same source bytes and parameters are answered
+// from the result cache (resize_cache.h) without decoding anything; the
+// descriptor is then the cached memfd or cache file, equally read-only.
+// Other sizes of a source decoded moments ago reuse the decoded image
+// (resize_source_cache.h).
+// Requests on one connection are answered in order; connections are
+// served concurrently. A connection that attaches a shared-memory ring
+// (resize_ring.h) carries no further requests: frames then go through the
+// ring with the filter of the attach request.
+
+#define DAEMON_MAGIC 0x52535a31u    // "RSZ1"
+#define DAEMON_PATH_MAX 1024
+
+typedef enum {
+    DAEMON_FILTER_BILINEAR,         // resize_image_to: any target
+    DAEMON_FILTER_NEAREST,          // the rest need a NUM/DENOM target
+    DAEMON_FILTER_CATMULL_ROM,
+    DAEMON_FILTER_MITCHELL,
+    DAEMON_FILTER_LANCZOS2,
+    DAEMON_FILTER_LANCZOS3
+} DaemonFilter;
+
+typedef enum {
+    DAEMON_FORMAT_PNG,              // encoded PNG file
+    DAEMON_FORMAT_RAW,              // width * height * channels bytes, rows packed
+    DAEMON_FORMAT_RING              // attach the resize_ring_create memfd sent along (see resize_ring.h)
+} DaemonFormat;
+
+typedef struct {
+    uint32_t magic;                 // DAEMON_MAGIC
+    int32_t filter;                 // DaemonFilter
+    int32_t format;                 // DaemonFormat
+    BatchTarget target;             // same meaning as a --batch size
+    char path[DAEMON_PATH_MAX];     // input file, ignored when a descriptor is attached
+} DaemonRequest;
+
+typedef struct {
+    uint32_t magic;                 // DAEMON_MAGIC
+    int32_t status;                 // 0, or an errno value (no descriptor attached)
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t format;                 // DaemonFormat of the attached descriptor
+    int32_t cached;                 // 0 resized now, 1 memory cache hit, 2 disk cache hit
+    uint64_t size;                  // bytes in the descriptor
+} DaemonReply;
+
+typedef struct {
+    const char* socket_path;        // replaced if a stale socket is left there
+    int workers;                    // 0: one per CPU
+    int verbose;                    // log every request
+    size_t cache_memory;            // bytes of results kept in memory, 0 for none
+    const char* cache_dir;          // disk tier of the result cache, NULL for none
+    size_t cache_disk;              // bytes of results kept on disk
+    size_t source_memory;           // bytes of decoded sources kept for follow-up sizes, 0 for none
+    int source_ttl_ms;              // a decoded source is dropped this long after its last use
+} DaemonOptions;
+
+// Serve until SIGINT or SIGTERM (SIGUSR1 prints cache statistics); returns
+// 1 after a clean shutdown, 0 if the socket or the workers could not be set up
+int run_daemon(const DaemonOptions* opt);
+
+// Client side: send one request (input_fd < 0 to send none) and wait for the
+// reply. On success *result_fd is the memfd with reply->size bytes, which the
+// caller closes (-1 after a ring attach). Returns 0 only when the connection
+// itself failed.
+int daemon_call(int sock, const DaemonRequest* request, int input_fd, DaemonReply* reply, int* result_fd);
+
+#endif // RESIZE_DAEMON_H
@@ -0,0 +1,69 @@
+#ifndef RESIZE_INTERNAL_H
+#define RESIZE_INTERNAL_H
+
+#include "image_resize.h"
+
+// Shared helpers between the resize translation units; not part of the
+// public API in image_resize.h.
+
+// Vertical Q16 lerp of two rows of already horizontally filtered samples:
+// out[i] = top[i] + ((bottom[i] - top[i]) * dy >> 16), clamped to a byte
+void blend_rows_fixed(const int16_t* top, const int16_t* bottom, int32_t dy, uint8_t* out, int count);
+
+// Exact integer ratio between input and output size: returns k (2, 3 or 4)
+// and sets *upscale when both axes scale by exactly k, otherwise returns 0
+int integer_scale_factor(int in_width, int in_height, int out_width, int out_height, int* upscale);
+
+// Integer-ratio kernels used by resize_image_fixed / resize_image_nearest
+Image* resize_box_down(const Image* input, int factor);
+Image* resize_bilinear_up(const Image* input, int factor);
+Image* resize_nearest_integer(const Image* input, int factor, int upscale);
+
+// Sample type of an interleaved image handled by the kernel dispatch table
+typedef enum {
+    PIXEL_U8,           // Image (8 bits per channel)
+    PIXEL_U16,          // Image16 (16 bits per channel)
+    PIXEL_TYPE_COUNT
+} PixelType;
+
+// Whether a SIMD level is both supported by this CPU and allowed by resize_set_isa_limit
+int resize_isa_allows(ResizeIsa isa);
+
+// Kernels available in the dispatch table
+typedef enum {
+    KERNEL_BILINEAR,
+    KERNEL_NEAREST,
+    KERNEL_FILTER_COUNT
+} KernelFilter;
+
+// Precomputed source coordinates for one resize: for every output column
+// (x0, x1, dx) and output row (y0, y1, dy), Q16 weights, already clamped
+typedef struct {
+    int in_width, in_height;
+    int out_width, out_height;
+    int channels;
+    int32_t* x0;
+    int32_t* x1;
+    int32_t* dx;
+    int32_t* y0;
+    int32_t* y1;
+    int32_t* dy;
+} ResizePlan;
+
+// Specialised kernel: fills output rows [y_begin, y_end)
+typedef void (*ResizeRowsFn)(const void* src, void* dst, const ResizePlan* plan, int y_begin, int y_end);
+
+int resize_plan_init(ResizePlan* plan, int in_width, int in_height, int out_width, int out_height,
+                     int channels, KernelFilter filter);
+void resize_plan_free(ResizePlan* plan);
+ResizeRowsFn resize_kernel_lookup(PixelType type, int channels, KernelFilter filter);
+int resize_with_kernel(const void* src, int in_width, int in_height, void* dst, int out_width, int out_height,
+                       int channels, PixelType type, KernelFilter filter);
+
+// Row-range forms of the integer-ratio bilinear kernels (for banded resizes):
+// fill output rows [y_begin, y_end) given per-caller scratch rows
+void box_down_rows(const Image* input, Image* output, int factor, int y_begin, int y_end, uint16_t* sums);
+void bilinear_up_rows(const Image* input, Image* output, const ResizePlan* plan, int y_begin, int y_end,
+                      int16_t* rows);
+
+#endif // RESIZE_INTERNAL_H
@@ -0,0 +1,556 @@
+#define _GNU_SOURCE
+#include "resize_io.h"
+#include "resize_trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Read buffer for a file of unknown size (a pipe), doubled as it fills
+#define IO_CHUNK (1 << 16)
+
+// Largest single read or write handed to the kernel
+#define IO_MAX_TRANSFER (1u << 30)
+
+// Pooled buffers carry their capacity in front of the bytes
+#define IO_BUFFER_HEADER 64
+
+// user_data of the read kept queued on the wake-up eventfd
+#define IO_WAKE_TOKEN 0
+
+typedef enum {
+    IO_STAT,                        // read: size and type of the file
+    IO_OPEN,
+    IO_DATA,
+    IO_CLOSE
+} IoStage;
+
+// One file read or written; it has at most one operation in the ring
+typedef struct IoOp {
+    struct IoOp* next;              // queued for the I/O thread
+    int write;
+    IoStage stage;
+    char* path;
+    void* user;
+    int fd;
+    int error;
+    unsigned char* bytes;
+    size_t len;                     // read: bytes so far; write: total
+    size_t done;                    // write: bytes written so far
+    size_t size;                    // read: size of a regular file, 0 to read until EOF
+    struct statx stx;
+} IoOp;
+
+typedef struct {
+    int fd;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    _Atomic uint32_t* sq_tail;
+    uint32_t sq_mask;
+    uint32_t* sq_array;
+    _Atomic uint32_t* cq_head;
+    _Atomic uint32_t* cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe* cqes;
+    uint32_t unsubmitted;
+} Uring;
+
+struct AsyncIo {
+    Uring ring;
+    int wake_fd;
+    uint64_t wake_value;            // target of the queued eventfd read
+    pthread_t thread;
+    AsyncReadDone read_done;
+    AsyncWriteDone write_done;
+    void* context;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;         // a slot came back or a read was reported
+    IoOp* queued;                   // FIFO for the I/O thread
+    IoOp* queued_last;
+    int stopping;
+    int max_reads;
+    int max_writes;
+    int reads_out;                  // queued reads plus reports not yet released
+    int reads_pending;              // queued reads not yet reported
+    int writes_out;
+    unsigned char** pool;           // free read buffers
+    int pool_count;
+};
+
+// ---------------------------------------------------------------------------
+// Ring
+// ---------------------------------------------------------------------------
+
+static int uring_setup(Uring* ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) return 0;
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) ring->sq_ring = NULL;
+    ring->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP) || !ring->sq_ring
+                        ? ring->sq_ring
+                        : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED) ring->cq_ring = NULL;
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+    if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) return 0;
+
+    unsigned char* sq = (unsigned char*)ring->sq_ring;
+    unsigned char* cq = (unsigned char*)ring->cq_ring;
+    ring->sq_tail = (_Atomic uint32_t*)(sq + p.sq_off.tail);
+    ring->sq_mask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*)(sq + p.sq_off.array);
+    ring->cq_head = (_Atomic uint32_t*)(cq + p.cq_off.head);
+    ring->cq_tail = (_Atomic uint32_t*)(cq + p.cq_off.tail);
+    ring->cq_mask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 1;
+}
+
+static void uring_teardown(Uring* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+// Every operation the I/O thread issues, available since Linux 5.6
+static int uring_supports_ops(const Uring* ring) {
+    static const int needed[] = { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE,
+                                  IORING_OP_CLOSE };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    if (!probe) return 0;
+    int ok = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        ok = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+// The submission ring never fills: every IoOp has at most one entry in it
+// and it has room for all of them
+static struct io_uring_sqe* uring_next(Uring* ring, uint8_t opcode, int fd, uint64_t user_data) {
+    uint32_t tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    uint32_t index = tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    atomic_store_explicit(ring->sq_tail, tail + 1, memory_order_release);
+    ring->unsubmitted++;
+    return sqe;
+}
+
+// Submit everything queued and wait for at least one completion
+static void uring_submit_and_wait(Uring* ring) {
+    for (;;) {
+        long done = syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (done >= 0) {
+            ring->unsubmitted -= (uint32_t)done;
+            if (ring->unsubmitted == 0) return;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Buffers
+// ---------------------------------------------------------------------------
+
+static unsigned char* buffer_resize(unsigned char* bytes, size_t capacity) {
+    unsigned char* raw = (unsigned char*)realloc(bytes ? bytes - IO_BUFFER_HEADER : NULL,
+                                                 IO_BUFFER_HEADER + capacity);
+    if (!raw) return NULL;
+    memcpy(raw, &capacity, sizeof(capacity));
+    return raw + IO_BUFFER_HEADER;
+}
+
+static size_t buffer_capacity(const unsigned char* bytes) {
+    size_t capacity;
+    memcpy(&capacity, bytes - IO_BUFFER_HEADER, sizeof(capacity));
+    return capacity;
+}
+
+static void buffer_free(unsigned char* bytes) {
+    if (bytes) free(bytes - IO_BUFFER_HEADER);
+}
+
+// A pooled buffer of at least capacity bytes, or a new one; called locked
+static unsigned char* buffer_take(AsyncIo* io, size_t capacity) {
+    for (int i = 0; i < io->pool_count; i++) {
+        if (buffer_capacity(io->pool[i]) >= capacity) {
+            unsigned char* bytes = io->pool[i];
+            io->pool[i] = io->pool[--io->pool_count];
+            return bytes;
+        }
+    }
+    // Too small ones are regrown rather than kept next to a new buffer
+    unsigned char* reuse = io->pool_count ? io->pool[--io->pool_count] : NULL;
+    unsigned char* bytes = buffer_resize(reuse, capacity);
+    if (!bytes) buffer_free(reuse);
+    return bytes;
+}
+
+// Called locked
+static void buffer_give(AsyncIo* io, unsigned char* bytes) {
+    if (!bytes) return;
+    if (io->pool_count < io->max_reads) {
+        io->pool[io->pool_count++] = bytes;
+    } else {
+        buffer_free(bytes);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// I/O thread
+// ---------------------------------------------------------------------------
+
+static void queue_wake_read(AsyncIo* io) {
+    struct io_uring_sqe* sqe = uring_next(&io->ring, IORING_OP_READ, io->wake_fd, IO_WAKE_TOKEN);
+    sqe->addr = (uint64_t)(uintptr_t)&io->wake_value;
+    sqe->len = sizeof(io->wake_value);
+}
+
+static void queue_data(AsyncIo* io, IoOp* op) {
+    op->stage = IO_DATA;
+    struct io_uring_sqe* sqe = uring_next(&io->ring, op->write ? IORING_OP_WRITE : IORING_OP_READ, op->fd,
+                                          (uint64_t)(uintptr_t)op);
+    size_t offset = op->write ? op->done : op->len;
+    size_t left = op->write ? op->len - op->done : buffer_capacity(op->bytes) - op->len;
+    sqe->addr = (uint64_t)(uintptr_t)(op->bytes + offset);
+    sqe->len = left < IO_MAX_TRANSFER ? (uint32_t)left : IO_MAX_TRANSFER;
+    // Streams have no offset to read at: -1 reads at the current position
+    sqe->off = op->write || op->size ? (uint64_t)offset : (uint64_t)-1;
+}
+
+static void queue_open(AsyncIo* io, IoOp* op) {
+    op->stage = IO_OPEN;
+    struct io_uring_sqe* sqe = uring_next(&io->ring, IORING_OP_OPENAT, AT_FDCWD, (uint64_t)(uintptr_t)op);
+    sqe->addr = (uint64_t)(uintptr_t)op->path;
+    sqe->open_flags = op->write ? O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC : O_RDONLY | O_CLOEXEC;
+    sqe->len = op->write ? 0666 : 0;
+}
+
+static void queue_close(AsyncIo* io, IoOp* op) {
+    op->stage = IO_CLOSE;
+    uring_next(&io->ring, IORING_OP_CLOSE, op->fd, (uint64_t)(uintptr_t)op);
+}
+
+static void start_op(AsyncIo* io, IoOp* op) {
+    if (op->write) {
+        queue_open(io, op);
+        return;
+    }
+    op->stage = IO_STAT;
+    struct io_uring_sqe* sqe = uring_next(&io->ring, IORING_OP_STATX, AT_FDCWD, (uint64_t)(uintptr_t)op);
+    sqe->addr = (uint64_t)(uintptr_t)op->path;
+    sqe->len = STATX_TYPE | STATX_SIZE;
+    sqe->off = (uint64_t)(uintptr_t)&op->stx;
+}
+
+// Report a finished file and free its IoOp
+static void finish_op(AsyncIo* io, IoOp* op) {
+    if (op->write) {
+        if (!op->error) TRACE_COUNT(TRACE_BYTES_WRITTEN, op->len);
+        free(op->bytes);
+        io->write_done(io->context, op->user, op->error);
+        pthread_mutex_lock(&io->lock);
+        io->writes_out--;
+    } else {
+        // A failed read keeps its slot until the consumer releases it, so
+        // the consumer's queue never holds more reports than max_reads
+        if (op->error) {
+            pthread_mutex_lock(&io->lock);
+            buffer_give(io, op->bytes);
+            pthread_mutex_unlock(&io->lock);
+            op->bytes = NULL;
+            op->len = 0;
+        }
+        // Reported before reads_pending drops, so async_io_wait_reads also
+        // waits for the callback
+        io->read_done(io->context, op->user, op->bytes, op->len, op->error);
+        pthread_mutex_lock(&io->lock);
+        io->reads_pending--;
+    }
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+    free(op->path);
+    free(op);
+}
+
+// Move a file on after one completion; returns 1 once it is finished
+static int advance_op(AsyncIo* io, IoOp* op, int res) {
+    switch (op->stage) {
+    case IO_STAT: {
+        if (res < 0) {
+            op->error = -res;
+            break;
+        }
+        op->size = S_ISREG(op->stx.stx_mode) ? (size_t)op->stx.stx_size : 0;
+        pthread_mutex_lock(&io->lock);
+        op->bytes = buffer_take(io, op->size ? op->size : IO_CHUNK);
+        pthread_mutex_unlock(&io->lock);
+        if (!op->bytes) {
+            op->error = ENOMEM;
+            break;
+        }
+        queue_open(io, op);
+        return 0;
+    }
+    case IO_OPEN:
+        if (res < 0) {
+            op->error = -res;
+            break;
+        }
+        op->fd = res;
+        if (op->write ? op->len == 0 : S_ISREG(op->stx.stx_mode) && op->size == 0) {
+            queue_close(io, op);
+        } else {
+            queue_data(io, op);
+        }
+        return 0;
+    case IO_DATA:
+        if (res < 0 || (op->write && res == 0)) {
+            op->error = res < 0 ? -res : EIO;
+            queue_close(io, op);
+            return 0;
+        }
+        if (op->write) {
+            op->done += (size_t)res;
+            if (op->done < op->len) {
+                queue_data(io, op);
+                return 0;
+            }
+        } else {
+            op->len += (size_t)res;
+            int more = res > 0 && (op->size ? op->len < op->size : 1);
+            if (more && op->len == buffer_capacity(op->bytes)) {
+                unsigned char* grown = buffer_resize(op->bytes, op->len * 2);
+                if (!grown) {
+                    op->error = ENOMEM;
+                    more = 0;
+                } else {
+                    op->bytes = grown;
+                }
+            }
+            if (more) {
+                queue_data(io, op);
+                return 0;
+            }
+        }
+        queue_close(io, op);
+        return 0;
+    case IO_CLOSE:
+        // A failed close can be the only report of a failed write on
+        // network file systems
+        if (res < 0 && op->write && !op->error) op->error = -res;
+        break;
+    }
+    finish_op(io, op);
+    return 1;
+}
+
+static void* io_thread(void* arg) {
+    AsyncIo* io = (AsyncIo*)arg;
+    int active = 0;
+    queue_wake_read(io);
+    for (;;) {
+        pthread_mutex_lock(&io->lock);
+        IoOp* op = io->queued;
+        io->queued = io->queued_last = NULL;
+        int stopping = io->stopping;
+        pthread_mutex_unlock(&io->lock);
+        for (; op; op = op->next) {
+            start_op(io, op);
+            active++;
+        }
+        if (stopping && active == 0) break;
+
+        uring_submit_and_wait(&io->ring);
+
+        Uring* ring = &io->ring;
+        uint32_t head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+            if (cqe->user_data == IO_WAKE_TOKEN) {
+                queue_wake_read(io);
+            } else {
+                active -= advance_op(io, (IoOp*)(uintptr_t)cqe->user_data, cqe->res);
+            }
+        }
+        atomic_store_explicit(ring->cq_head, head, memory_order_release);
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Public interface
+// ---------------------------------------------------------------------------
+
+static void wake(AsyncIo* io) {
+    uint64_t one = 1;
+    while (write(io->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+static void enqueue(AsyncIo* io, IoOp* op) {
+    op->next = NULL;
+    if (io->queued_last) io->queued_last->next = op; else io->queued = op;
+    io->queued_last = op;
+}
+
+AsyncIo* async_io_create(int max_reads, int max_writes, AsyncReadDone read_done, AsyncWriteDone write_done,
+                         void* context) {
+    if (max_reads < 1 || max_writes < 1) return NULL;
+    AsyncIo* io = (AsyncIo*)calloc(1, sizeof(AsyncIo));
+    if (!io) return NULL;
+    io->ring.fd = -1;
+    io->wake_fd = -1;
+    io->max_reads = max_reads;
+    io->max_writes = max_writes;
+    io->read_done = read_done;
+    io->write_done = write_done;
+    io->context = context;
+
+    unsigned entries = 1;
+    while (entries < (unsigned)(max_reads + max_writes + 1)) entries *= 2;
+    io->pool = (unsigned char**)calloc((size_t)max_reads, sizeof(unsigned char*));
+    io->wake_fd = eventfd(0, EFD_CLOEXEC);
+    int ok = io->pool && io->wake_fd >= 0 && uring_setup(&io->ring, entries) && uring_supports_ops(&io->ring);
+    if (ok) {
+        pthread_mutex_init(&io->lock, NULL);
+        pthread_cond_init(&io->changed, NULL);
+        ok = pthread_create(&io->thread, NULL, io_thread, io) == 0;
+        if (!ok) {
+            pthread_mutex_destroy(&io->lock);
+            pthread_cond_destroy(&io->changed);
+        }
+    }
+    if (!ok) {
+        uring_teardown(&io->ring);
+        if (io->wake_fd >= 0) close(io->wake_fd);
+        free(io->pool);
+        free(io);
+        return NULL;
+    }
+    return io;
+}
+
+void async_io_destroy(AsyncIo* io) {
+    if (!io) return;
+    pthread_mutex_lock(&io->lock);
+    io->stopping = 1;
+    pthread_mutex_unlock(&io->lock);
+    wake(io);
+    pthread_join(io->thread, NULL);
+
+    for (int i = 0; i < io->pool_count; i++) {
+        buffer_free(io->pool[i]);
+    }
+    uring_teardown(&io->ring);
+    close(io->wake_fd);
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->changed);
+    free(io->pool);
+    free(io);
+}
+
+void async_io_read(AsyncIo* io, const char* path, void* user) {
+    pthread_mutex_lock(&io->lock);
+    while (io->reads_out >= io->max_reads) {
+        pthread_cond_wait(&io->changed, &io->lock);
+    }
+    io->reads_out++;
+    pthread_mutex_unlock(&io->lock);
+
+    IoOp* op = (IoOp*)calloc(1, sizeof(IoOp));
+    if (op) op->path = strdup(path);
+    if (!op || !op->path) {
+        // Reported with its slot held, like any other failed read
+        free(op);
+        io->read_done(io->context, user, NULL, 0, ENOMEM);
+        return;
+    }
+    op->user = user;
+    op->fd = -1;
+
+    pthread_mutex_lock(&io->lock);
+    io->reads_pending++;
+    enqueue(io, op);
+    pthread_mutex_unlock(&io->lock);
+    wake(io);
+}
+
+void async_io_release(AsyncIo* io, unsigned char* bytes) {
+    pthread_mutex_lock(&io->lock);
+    buffer_give(io, bytes);
+    io->reads_out--;
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+}
+
+void async_io_wait_reads(AsyncIo* io) {
+    pthread_mutex_lock(&io->lock);
+    while (io->reads_pending > 0) {
+        pthread_cond_wait(&io->changed, &io->lock);
+    }
+    pthread_mutex_unlock(&io->lock);
+}
+
+void async_io_write(AsyncIo* io, const char* path, unsigned char* bytes, size_t len, void* user) {
+    IoOp* op = (IoOp*)calloc(1, sizeof(IoOp));
+    if (op) op->path = strdup(path);
+    if (!op || !op->path) {
+        free(op);
+        free(bytes);
+        io->write_done(io->context, user, ENOMEM);
+        return;
+    }
+    op->write = 1;
+    op->user = user;
+    op->fd = -1;
+    op->bytes = bytes;
+    op->len = len;
+
+    pthread_mutex_lock(&io->lock);
+    while (io->writes_out >= io->max_writes) {
+        pthread_cond_wait(&io->changed, &io->lock);
+    }
+    io->writes_out++;
+    enqueue(io, op);
+    pthread_mutex_unlock(&io->lock);
+    wake(io);
+}
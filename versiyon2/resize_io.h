@@ -0,0 +1,46 @@
+#ifndef RESIZE_IO_H
+#define RESIZE_IO_H
+
+#include <stddef.h>
+
+// Asynchronous whole-file reads and writes for the batch pipeline. One I/O
+// thread drives an io_uring (set up with raw system calls), so many files
+// are opened, read, written and closed at once while the decode and encode
+// workers only ever touch memory. On network storage this keeps the CPU
+// stages busy instead of parked in read() and write().
+//
+// Reads land in pooled buffers that go back to the pool once decoded;
+// writes take ownership of a malloc'd buffer. Completions are reported
+// through callbacks on the I/O thread, which must not block.
+
+// bytes is NULL (and error an errno value) when the read failed
+typedef void (*AsyncReadDone)(void* context, void* user, unsigned char* bytes, size_t len, int error);
+typedef void (*AsyncWriteDone)(void* context, void* user, int error);
+
+typedef struct AsyncIo AsyncIo;
+
+// Returns NULL when io_uring is unavailable (old kernel, seccomp), in which
+// case the caller does its own blocking I/O
+AsyncIo* async_io_create(int max_reads, int max_writes, AsyncReadDone read_done, AsyncWriteDone write_done,
+                         void* context);
+
+// Waits for every queued write, then stops the I/O thread
+void async_io_destroy(AsyncIo* io);
+
+// Queue a read of the whole file. Blocks while max_reads buffers are out,
+// so a slow consumer holds back the readers.
+void async_io_read(AsyncIo* io, const char* path, void* user);
+
+// Hand a read completion back: its buffer returns to the pool (bytes is
+// NULL after a failed read). Every reported read holds one of the max_reads
+// slots until this is called, failed ones included.
+void async_io_release(AsyncIo* io, unsigned char* bytes);
+
+// Wait until every queued read has been reported
+void async_io_wait_reads(AsyncIo* io);
+
+// Queue writing len bytes to path (created or truncated); the I/O layer
+// frees bytes. Blocks while max_writes writes are in flight.
+void async_io_write(AsyncIo* io, const char* path, unsigned char* bytes, size_t len, void* user);
+
+#endif // RESIZE_IO_H
@@ -0,0 +1,212 @@
+#include "resize_job.h"
+#include "resize_pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Bands of about this many output pixels: small enough that a cancelled
+// job stops soon and progress moves smoothly, large enough to keep the
+// per-band overhead out of the profile
+#define JOB_BAND_PIXELS (1 << 16)
+#define JOB_MAX_BANDS 64
+
+typedef struct {
+    WorkTask task;
+    ResizeJob* job;
+    int y_begin;
+    int y_end;
+} JobBand;
+
+struct ResizeJob {
+    WorkTask task;                  // plans the bands on a pool thread
+    const Image* input;
+    int out_width;
+    int out_height;
+    ResizeJobDone done;
+    ResizeJobProgress progress;
+    void* user;
+    BandedResize* resize;
+    ResizeJob* next_pending;
+    atomic_int refs;                // the caller and the running job
+    atomic_int cancelled;
+    atomic_int skipped;             // bands dropped after a cancel
+    atomic_int failed;
+    atomic_int bands_done;
+    atomic_int remaining;
+    int band_count;
+    JobBand bands[];
+};
+
+// The pool behind every job, started by the first submit and kept for the
+// life of the process
+static struct {
+    pthread_once_t once;
+    WorkPool* pool;
+    pthread_mutex_t lock;
+    int running;
+    ResizeJob* first_pending;
+    ResizeJob* last_pending;
+} jobs = { PTHREAD_ONCE_INIT, NULL, PTHREAD_MUTEX_INITIALIZER, 0, NULL, NULL };
+
+static void start_pool(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs.pool = work_pool_create(cpus > 0 ? (int)cpus : 1, RESIZE_JOB_MAX_RUNNING);
+}
+
+static void release_job(ResizeJob* job) {
+    if (atomic_fetch_sub_explicit(&job->refs, 1, memory_order_acq_rel) == 1) free(job);
+}
+
+// A job left the pool: let the oldest waiting one take its place. Spawned
+// from inside the finishing task, so this never waits for queue space.
+static void start_next(WorkPool* pool) {
+    pthread_mutex_lock(&jobs.lock);
+    ResizeJob* next = jobs.first_pending;
+    if (next) {
+        jobs.first_pending = next->next_pending;
+        if (!jobs.first_pending) jobs.last_pending = NULL;
+    } else {
+        jobs.running--;
+    }
+    pthread_mutex_unlock(&jobs.lock);
+    if (next) work_pool_spawn(pool, &next->task);
+}
+
+static void finish_job(ResizeJob* job, WorkPool* pool) {
+    Image* image = job->resize ? banded_resize_finish(job->resize) : NULL;
+    ResizeJobStatus status = RESIZE_JOB_DONE;
+    if (atomic_load_explicit(&job->skipped, memory_order_relaxed)) {
+        status = RESIZE_JOB_CANCELLED;
+    } else if (!image || atomic_load_explicit(&job->failed, memory_order_relaxed)) {
+        status = RESIZE_JOB_FAILED;
+    }
+    if (status != RESIZE_JOB_DONE && image) {
+        free_image(image);
+        image = NULL;
+    }
+    start_next(pool);
+    job->done(job->user, status, image);
+    release_job(job);
+}
+
+static void run_band(WorkTask* task, WorkPool* pool) {
+    JobBand* band = (JobBand*)task;
+    ResizeJob* job = band->job;
+
+    if (atomic_load_explicit(&job->cancelled, memory_order_relaxed)) {
+        atomic_store_explicit(&job->skipped, 1, memory_order_relaxed);
+    } else {
+        if (!banded_resize_run(job->resize, band->y_begin, band->y_end)) {
+            atomic_store_explicit(&job->failed, 1, memory_order_relaxed);
+        }
+        int done = atomic_fetch_add_explicit(&job->bands_done, 1, memory_order_relaxed) + 1;
+        if (job->progress) job->progress(job->user, done, job->band_count);
+    }
+
+    // The last band out finishes the job
+    if (atomic_fetch_sub_explicit(&job->remaining, 1, memory_order_acq_rel) == 1) finish_job(job, pool);
+}
+
+static void run_job(WorkTask* task, WorkPool* pool) {
+    ResizeJob* job = (ResizeJob*)task;
+    if (atomic_load_explicit(&job->cancelled, memory_order_relaxed)) {
+        atomic_store_explicit(&job->skipped, 1, memory_order_relaxed);
+        finish_job(job, pool);
+        return;
+    }
+    job->resize = banded_resize_create(job->input, job->out_width, job->out_height);
+    if (!job->resize) {
+        finish_job(job, pool);
+        return;
+    }
+    // Last to first, so this worker starts at the top of the image while
+    // idle workers steal from the bottom
+    for (int b = job->band_count - 1; b >= 0; b--) {
+        work_pool_spawn(pool, &job->bands[b].task);
+    }
+}
+
+ResizeJob* resize_job_submit(const Image* input, int out_width, int out_height,
+                             ResizeJobDone done, ResizeJobProgress progress, void* user) {
+    if (!input || !input->data || out_width <= 0 || out_height <= 0 || !done) return NULL;
+    pthread_once(&jobs.once, start_pool);
+    if (!jobs.pool) return NULL;
+
+    int band_rows = JOB_BAND_PIXELS / out_width;
+    if (band_rows < 1) band_rows = 1;
+    if ((out_height + band_rows - 1) / band_rows > JOB_MAX_BANDS) {
+        band_rows = (out_height + JOB_MAX_BANDS - 1) / JOB_MAX_BANDS;
+    }
+    int band_count = (out_height + band_rows - 1) / band_rows;
+
+    ResizeJob* job = (ResizeJob*)malloc(sizeof(ResizeJob) + (size_t)band_count * sizeof(JobBand));
+    if (!job) return NULL;
+    job->task.run = run_job;
+    job->input = input;
+    job->out_width = out_width;
+    job->out_height = out_height;
+    job->done = done;
+    job->progress = progress;
+    job->user = user;
+    job->resize = NULL;
+    job->next_pending = NULL;
+    atomic_init(&job->refs, 2);
+    atomic_init(&job->cancelled, 0);
+    atomic_init(&job->skipped, 0);
+    atomic_init(&job->failed, 0);
+    atomic_init(&job->bands_done, 0);
+    atomic_init(&job->remaining, band_count);
+    job->band_count = band_count;
+    for (int b = 0; b < band_count; b++) {
+        JobBand* band = &job->bands[b];
+        band->task.run = run_band;
+        band->job = job;
+        band->y_begin = b * band_rows;
+        band->y_end = band->y_begin + band_rows < out_height ? band->y_begin + band_rows : out_height;
+    }
+
+    // At most RESIZE_JOB_MAX_RUNNING jobs are ever in the injection queue,
+    // the rest wait in a list, so the submit below finds a free cell and
+    // returns at once
+    pthread_mutex_lock(&jobs.lock);
+    int admit = jobs.running < RESIZE_JOB_MAX_RUNNING;
+    if (admit) {
+        jobs.running++;
+    } else if (jobs.last_pending) {
+        jobs.last_pending->next_pending = job;
+        jobs.last_pending = job;
+    } else {
+        jobs.first_pending = jobs.last_pending = job;
+    }
+    pthread_mutex_unlock(&jobs.lock);
+    if (admit) work_pool_submit(jobs.pool, &job->task);
+    return job;
+}
+
+ResizeJob* resize_job_submit_fixed(const Image* input, int32_t scale_num, int32_t scale_denom,
+                                   ResizeJobDone done, ResizeJobProgress progress, void* user) {
+    if (!input) return NULL;
+    int out_width, out_height;
+    if (!resize_scaled_size(input->width, input->height, scale_num, scale_denom, &out_width, &out_height)) {
+        return NULL;
+    }
+    return resize_job_submit(input, out_width, out_height, done, progress, user);
+}
+
+int resize_job_workers(void) {
+    pthread_once(&jobs.once, start_pool);
+    return jobs.pool ? work_pool_size(jobs.pool) : 0;
+}
+
+void resize_job_cancel(ResizeJob* job) {
+    atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+}
+
+double resize_job_progress(const ResizeJob* job) {
+    return (double)atomic_load_explicit(&job->bands_done, memory_order_relaxed) / job->band_count;
+}
+
+void resize_job_release(ResizeJob* job) {
+    if (job) release_job(job);
+}
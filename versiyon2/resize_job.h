@@ -0,0 +1,57 @@
+#ifndef RESIZE_JOB_H
+#define RESIZE_JOB_H
+
+#include "image_resize.h"
+
+// Non-blocking bilinear resizes on the library's own work-stealing pool
+// (resize_pool.h, one worker per CPU, started on first use). Submitting
+// only queues the job and returns, so an event loop thread can hand off a
+// resize without ever waiting for it. A job runs as bands of output rows;
+// cancellation is checked before every band and progress is counted per
+// finished band. The result equals resize_image_to's.
+//
+// resize_async.hpp wraps this in a C++20 awaitable.
+
+// Jobs on the pool at once; later submits wait in order for a free place
+#define RESIZE_JOB_MAX_RUNNING 64
+
+typedef enum {
+    RESIZE_JOB_DONE,
+    RESIZE_JOB_CANCELLED,
+    RESIZE_JOB_FAILED
+} ResizeJobStatus;
+
+// Called once on a pool thread when the job ends. output belongs to the
+// callee and is only set for RESIZE_JOB_DONE. Must not block: it runs in
+// place of the next band.
+typedef void (*ResizeJobDone)(void* user, ResizeJobStatus status, Image* output);
+
+// Called on a pool thread after every finished band (not in order of rows)
+typedef void (*ResizeJobProgress)(void* user, int bands_done, int band_count);
+
+typedef struct ResizeJob ResizeJob;
+
+// Queue a resize of input, which must stay alive until done is called.
+// progress may be NULL. Returns NULL (and calls nothing) if the job could
+// not be queued; otherwise the caller holds the job until resize_job_release.
+ResizeJob* resize_job_submit(const Image* input, int out_width, int out_height,
+                             ResizeJobDone done, ResizeJobProgress progress, void* user);
+
+// Same output size as resize_image_fixed
+ResizeJob* resize_job_submit_fixed(const Image* input, int32_t scale_num, int32_t scale_denom,
+                                   ResizeJobDone done, ResizeJobProgress progress, void* user);
+
+// Worker threads behind every job (starts the pool); 0 if it could not start
+int resize_job_workers(void);
+
+// Ask the job to stop; bands not yet started are skipped and done reports
+// RESIZE_JOB_CANCELLED unless every band had already run. Thread-safe.
+void resize_job_cancel(ResizeJob* job);
+
+// Fraction of the bands finished, 0 to 1
+double resize_job_progress(const ResizeJob* job);
+
+// Drop the caller's hold; a running job still finishes and calls done
+void resize_job_release(ResizeJob* job);
+
+#endif // RESIZE_JOB_H
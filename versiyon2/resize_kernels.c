@@ -0,0 +1,355 @@
+#include "resize_internal.h"
+#include "fixed_point.h"
+#include "resize_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static ResizeIsa isa_limit = RESIZE_ISA_NATIVE;
+
+void resize_set_isa_limit(ResizeIsa isa) {
+    isa_limit = isa;
+}
+
+ResizeIsa resize_get_isa_limit(void) {
+    return isa_limit;
+}
+
+int resize_isa_allows(ResizeIsa isa) {
+    if (isa > isa_limit) return 0;
+    switch (isa) {
+        case RESIZE_ISA_SCALAR:
+            return 1;
+#if defined(__SSE2__)
+        case RESIZE_ISA_SSE2:
+            return 1;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+        case RESIZE_ISA_SSSE3:
+            return __builtin_cpu_supports("ssse3");
+        case RESIZE_ISA_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        default:
+            return 0;
+    }
+}
+
+// Source positions are generated as exact rationals rather than by adding a
+// rounded Q16 step: the Q16 position of output sample i is kept as a 64-bit
+// quotient/remainder pair over a fixed denominator and advanced by constant
+// increments, so every sample costs one add and a compare, nothing drifts
+// across the row, and sizes far beyond the 32767 limit of in << FIXED_SHIFT
+// (gigapixel sources of 100k+ columns) map correctly.
+typedef struct {
+    int64_t pos;        // floor(Q16 position)
+    int64_t rem;        // remainder, 0 <= rem < denom
+    int64_t step;       // floor(Q16 increment)
+    int64_t step_rem;
+    int64_t denom;
+} AxisWalk;
+
+// Start the walk at numerator / denom and advance by increment / denom
+static void axis_walk_init(AxisWalk* walk, int64_t numerator, int64_t increment, int64_t denom) {
+    walk->pos = numerator / denom;
+    walk->rem = numerator % denom;
+    if (walk->rem < 0) {        // floor, not truncation, left of the first pixel
+        walk->rem += denom;
+        walk->pos--;
+    }
+    walk->step = increment / denom;
+    walk->step_rem = increment % denom;
+    walk->denom = denom;
+}
+
+static inline void axis_walk_next(AxisWalk* walk) {
+    walk->pos += walk->step;
+    walk->rem += walk->step_rem;
+    if (walk->rem >= walk->denom) {
+        walk->rem -= walk->denom;
+        walk->pos++;
+    }
+}
+
+// Bilinear uses versiyon1's centre-aligned mapping: output sample i sits at
+// (i + 0.5) * in / out - 0.5, i.e. ((2i + 1) * in - out) / (2 * out).
+// Positions left of the first pixel centre clamp to it, as in versiyon1.
+static void build_axis_bilinear(int in_size, int out_size, int32_t* i0, int32_t* i1, int32_t* frac) {
+    AxisWalk walk;
+    axis_walk_init(&walk, ((int64_t)in_size - out_size) << FIXED_SHIFT,
+                   (int64_t)in_size << (FIXED_SHIFT + 1), (int64_t)out_size * 2);
+
+    for (int i = 0; i < out_size; i++, axis_walk_next(&walk)) {
+        if (walk.pos < 0) {
+            i0[i] = i1[i] = 0;
+            frac[i] = 0;
+            continue;
+        }
+        i0[i] = (int32_t)(walk.pos >> FIXED_SHIFT);
+        i1[i] = i0[i] + 1;
+        frac[i] = (int32_t)(walk.pos & (FIXED_ONE - 1));
+        if (i0[i] >= in_size - 1) {
+            i0[i] = i1[i] = in_size - 1;
+            frac[i] = 0;
+        }
+    }
+}
+
+// Nearest keeps the original top-left mapping, floor(i * in / out), now exact
+static void build_axis_nearest(int in_size, int out_size, int32_t* index) {
+    AxisWalk walk;
+    axis_walk_init(&walk, 0, in_size, out_size);
+
+    for (int i = 0; i < out_size; i++, axis_walk_next(&walk)) {
+        index[i] = walk.pos < in_size ? (int32_t)walk.pos : in_size - 1;
+    }
+}
+
+// Build the per-row and per-column source tables once per resize so the
+// kernels never re-derive coordinates or image sizes inside the pixel loop
+int resize_plan_init(ResizePlan* plan, int in_width, int in_height, int out_width, int out_height,
+                     int channels, KernelFilter filter) {
+    plan->in_width = in_width;
+    plan->in_height = in_height;
+    plan->out_width = out_width;
+    plan->out_height = out_height;
+    plan->channels = channels;
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_PLAN);
+    plan->x0 = (int32_t*)malloc((size_t)(out_width + out_height) * 3 * sizeof(int32_t));
+    if (!plan->x0) return 0;
+    plan->x1 = plan->x0 + out_width;
+    plan->dx = plan->x1 + out_width;
+    plan->y0 = plan->dx + out_width;
+    plan->y1 = plan->y0 + out_height;
+    plan->dy = plan->y1 + out_height;
+
+    if (filter == KERNEL_NEAREST) {
+        build_axis_nearest(in_width, out_width, plan->x0);
+        build_axis_nearest(in_height, out_height, plan->y0);
+        memcpy(plan->x1, plan->x0, (size_t)out_width * sizeof(int32_t));
+        memcpy(plan->y1, plan->y0, (size_t)out_height * sizeof(int32_t));
+        memset(plan->dx, 0, (size_t)out_width * sizeof(int32_t));
+        memset(plan->dy, 0, (size_t)out_height * sizeof(int32_t));
+    } else {
+        build_axis_bilinear(in_width, out_width, plan->x0, plan->x1, plan->dx);
+        build_axis_bilinear(in_height, out_height, plan->y0, plan->y1, plan->dy);
+    }
+
+    TRACE_SPAN_END(span);
+    return 1;
+}
+
+void resize_plan_free(ResizePlan* plan) {
+    free(plan->x0);
+    plan->x0 = NULL;
+}
+
+// Generic kernel bodies. They are always inlined into the small wrappers
+// generated below with a constant channel count, so the channel loop is
+// fully unrolled and nothing in the pixel loop branches on the layout.
+#define DEFINE_KERNEL_BODIES(SUFFIX, T, MAX_VALUE)                                              \
+static inline __attribute__((always_inline))                                                    \
+void bilinear_rows_##SUFFIX(const void* src_data, void* dst_data, const ResizePlan* plan,       \
+                            int y_begin, int y_end, const int channels) {                       \
+    const T* src = (const T*)src_data;                                                          \
+    size_t in_stride = (size_t)plan->in_width * channels;                                       \
+    size_t out_stride = (size_t)plan->out_width * channels;                                     \
+    for (int y = y_begin; y < y_end; y++) {                                                     \
+        const T* r0 = src + (size_t)plan->y0[y] * in_stride;                                    \
+        const T* r1 = src + (size_t)plan->y1[y] * in_stride;                                    \
+        int32_t dy = plan->dy[y];                                                               \
+        T* out = (T*)dst_data + (size_t)y * out_stride;                                         \
+        for (int x = 0; x < plan->out_width; x++) {                                             \
+            const T* p00 = r0 + plan->x0[x] * channels;                                         \
+            const T* p01 = r0 + plan->x1[x] * channels;                                         \
+            const T* p10 = r1 + plan->x0[x] * channels;                                         \
+            const T* p11 = r1 + plan->x1[x] * channels;                                         \
+            int32_t dx = plan->dx[x];                                                           \
+            for (int c = 0; c < channels; c++) {                                                \
+                int32_t top = p00[c] + fixed_mult((p01[c] - p00[c]), dx);                       \
+                int32_t bottom = p10[c] + fixed_mult((p11[c] - p10[c]), dx);                    \
+                int32_t value = top + fixed_mult((bottom - top), dy);                           \
+                out[c] = value < 0 ? 0 : value > MAX_VALUE ? MAX_VALUE : (T)value;              \
+            }                                                                                   \
+            out += channels;                                                                    \
+        }                                                                                       \
+    }                                                                                           \
+}                                                                                               \
+                                                                                                \
+static inline __attribute__((always_inline))                                                    \
+void nearest_rows_##SUFFIX(const void* src_data, void* dst_data, const ResizePlan* plan,        \
+                           int y_begin, int y_end, const int channels) {                        \
+    const T* src = (const T*)src_data;                                                          \
+    size_t in_stride = (size_t)plan->in_width * channels;                                       \
+    size_t out_stride = (size_t)plan->out_width * channels;                                     \
+    for (int y = y_begin; y < y_end; y++) {                                                     \
+        const T* row = src + (size_t)plan->y0[y] * in_stride;                                   \
+        T* out = (T*)dst_data + (size_t)y * out_stride;                                         \
+        for (int x = 0; x < plan->out_width; x++) {                                             \
+            /* constant size, so this compiles to a single load/store */                        \
+            memcpy(out, row + plan->x0[x] * channels, channels * sizeof(T));                    \
+            out += channels;                                                                    \
+        }                                                                                       \
+    }                                                                                           \
+}
+
+DEFINE_KERNEL_BODIES(u8, uint8_t, 255)
+DEFINE_KERNEL_BODIES(u16, uint16_t, 65535)
+
+// One instantiation per (filter, pixel type, channel count)
+#define INSTANTIATE_KERNEL(FILTER, SUFFIX, CH)                                                  \
+static void FILTER##_##SUFFIX##_##CH(const void* src, void* dst, const ResizePlan* plan,        \
+                                     int y_begin, int y_end) {                                  \
+    FILTER##_rows_##SUFFIX(src, dst, plan, y_begin, y_end, CH);                                 \
+}
+
+INSTANTIATE_KERNEL(bilinear, u8, 1)
+INSTANTIATE_KERNEL(bilinear, u8, 2)
+INSTANTIATE_KERNEL(bilinear, u8, 4)
+INSTANTIATE_KERNEL(bilinear, u16, 1)
+INSTANTIATE_KERNEL(bilinear, u16, 2)
+INSTANTIATE_KERNEL(bilinear, u16, 3)
+INSTANTIATE_KERNEL(bilinear, u16, 4)
+INSTANTIATE_KERNEL(nearest, u8, 1)
+INSTANTIATE_KERNEL(nearest, u8, 2)
+INSTANTIATE_KERNEL(nearest, u8, 3)
+INSTANTIATE_KERNEL(nearest, u8, 4)
+INSTANTIATE_KERNEL(nearest, u16, 1)
+INSTANTIATE_KERNEL(nearest, u16, 2)
+INSTANTIATE_KERNEL(nearest, u16, 3)
+INSTANTIATE_KERNEL(nearest, u16, 4)
+
+// 8-bit RGB keeps its original expanded bilinear form (corner weights with
+// a dx*dy cross term) so existing RGB outputs do not change
+static void bilinear_u8_3(const void* src_data, void* dst_data, const ResizePlan* plan, int y_begin, int y_end) {
+    const PixelRGB* src = (const PixelRGB*)src_data;
+    for (int y = y_begin; y < y_end; y++) {
+        const PixelRGB* r0 = src + (size_t)plan->y0[y] * plan->in_width;
+        const PixelRGB* r1 = src + (size_t)plan->y1[y] * plan->in_width;
+        int32_t dy = plan->dy[y];
+        PixelRGB* out = (PixelRGB*)dst_data + (size_t)y * plan->out_width;
+        for (int x = 0; x < plan->out_width; x++) {
+            PixelRGB p00 = r0[plan->x0[x]];
+            PixelRGB p01 = r0[plan->x1[x]];
+            PixelRGB p10 = r1[plan->x0[x]];
+            PixelRGB p11 = r1[plan->x1[x]];
+            int32_t dx = plan->dx[x];
+            int32_t dxy = fixed_mult(dx, dy);
+
+            out[x].r = clamp_int(p00.r + fixed_mult((p01.r - p00.r), dx) +
+                                 fixed_mult((p10.r - p00.r), dy) +
+                                 fixed_mult((p00.r - p01.r - p10.r + p11.r), dxy), 0, 255);
+            out[x].g = clamp_int(p00.g + fixed_mult((p01.g - p00.g), dx) +
+                                 fixed_mult((p10.g - p00.g), dy) +
+                                 fixed_mult((p00.g - p01.g - p10.g + p11.g), dxy), 0, 255);
+            out[x].b = clamp_int(p00.b + fixed_mult((p01.b - p00.b), dx) +
+                                 fixed_mult((p10.b - p00.b), dy) +
+                                 fixed_mult((p00.b - p01.b - p10.b + p11.b), dxy), 0, 255);
+        }
+    }
+}
+
+#if defined(__SSE2__)
+// SSE2 has no 32-bit low multiply; build it from two 32x32->64 multiplies.
+// Only the low 32 bits are kept, so the result is the same for signed inputs.
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Expand one 4-byte pixel to four 32-bit lanes
+static inline __m128i load_pixel_epi32(const PixelRGBA* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)v), zero), zero);
+}
+
+// RGBA bilinear with the whole 32-bit pixel in one register, one channel
+// per lane; bit-identical to bilinear_rows_u8 with four channels
+static void bilinear_u8_4_sse2(const void* src_data, void* dst_data, const ResizePlan* plan, int y_begin, int y_end) {
+    const PixelRGBA* src = (const PixelRGBA*)src_data;
+    for (int y = y_begin; y < y_end; y++) {
+        const PixelRGBA* r0 = src + (size_t)plan->y0[y] * plan->in_width;
+        const PixelRGBA* r1 = src + (size_t)plan->y1[y] * plan->in_width;
+        __m128i vdy = _mm_set1_epi32(plan->dy[y]);
+        PixelRGBA* out = (PixelRGBA*)dst_data + (size_t)y * plan->out_width;
+        for (int x = 0; x < plan->out_width; x++) {
+            __m128i p00 = load_pixel_epi32(&r0[plan->x0[x]]);
+            __m128i p01 = load_pixel_epi32(&r0[plan->x1[x]]);
+            __m128i p10 = load_pixel_epi32(&r1[plan->x0[x]]);
+            __m128i p11 = load_pixel_epi32(&r1[plan->x1[x]]);
+            __m128i vdx = _mm_set1_epi32(plan->dx[x]);
+
+            // Differences fit in 9 bits and weights in 16, so the products stay in 32 bits
+            __m128i top = _mm_add_epi32(p00, _mm_srai_epi32(mullo_epi32_sse2(_mm_sub_epi32(p01, p00), vdx), FIXED_SHIFT));
+            __m128i bottom = _mm_add_epi32(p10, _mm_srai_epi32(mullo_epi32_sse2(_mm_sub_epi32(p11, p10), vdx), FIXED_SHIFT));
+            __m128i value = _mm_add_epi32(top, _mm_srai_epi32(mullo_epi32_sse2(_mm_sub_epi32(bottom, top), vdy), FIXED_SHIFT));
+
+            // Saturating packs clamp to [0, 255]
+            __m128i packed = _mm_packs_epi32(value, value);
+            packed = _mm_packus_epi16(packed, packed);
+            uint32_t v = (uint32_t)_mm_cvtsi128_si32(packed);
+            memcpy(&out[x], &v, sizeof(v));
+        }
+    }
+}
+#endif
+
+// Dispatch table indexed by [pixel type][channels - 1][filter]; these are the
+// portable kernels, SIMD replacements are picked in resize_kernel_lookup
+static const ResizeRowsFn kernel_table[PIXEL_TYPE_COUNT][4][KERNEL_FILTER_COUNT] = {
+    [PIXEL_U8] = {
+        { bilinear_u8_1, nearest_u8_1 },
+        { bilinear_u8_2, nearest_u8_2 },
+        { bilinear_u8_3, nearest_u8_3 },
+        { bilinear_u8_4, nearest_u8_4 },
+    },
+    [PIXEL_U16] = {
+        { bilinear_u16_1, nearest_u16_1 },
+        { bilinear_u16_2, nearest_u16_2 },
+        { bilinear_u16_3, nearest_u16_3 },
+        { bilinear_u16_4, nearest_u16_4 },
+    },
+};
+
+// Look up the specialised kernel; NULL for unsupported combinations
+ResizeRowsFn resize_kernel_lookup(PixelType type, int channels, KernelFilter filter) {
+    if (type < 0 || type >= PIXEL_TYPE_COUNT || channels < 1 || channels > 4 ||
+        filter < 0 || filter >= KERNEL_FILTER_COUNT) {
+        return NULL;
+    }
+#if defined(__SSE2__)
+    if (type == PIXEL_U8 && channels == 4 && filter == KERNEL_BILINEAR && resize_isa_allows(RESIZE_ISA_SSE2)) {
+        return bilinear_u8_4_sse2;
+    }
+#endif
+    return kernel_table[type][channels - 1][filter];
+}
+
+// Plan and run a whole-image resize through the dispatch table
+int resize_with_kernel(const void* src, int in_width, int in_height, void* dst, int out_width, int out_height,
+                       int channels, PixelType type, KernelFilter filter) {
+    ResizeRowsFn kernel = resize_kernel_lookup(type, channels, filter);
+    if (!kernel) return 0;
+
+    TRACE_SPAN_BEGIN(span, TRACE_STAGE_RESIZE);
+    ResizePlan plan;
+    if (!resize_plan_init(&plan, in_width, in_height, out_width, out_height, channels, filter)) {
+        return 0;
+    }
+
+    kernel(src, dst, &plan, 0, out_height);
+
+    resize_plan_free(&plan);
+    TRACE_SPAN_END(span);
+    TRACE_COUNT(TRACE_PIXELS_IN, (uint64_t)in_width * in_height);
+    TRACE_COUNT(TRACE_PIXELS_OUT, (uint64_t)out_width * out_height);
+    return 1;
+}
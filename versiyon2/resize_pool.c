@@ -0,0 +1,356 @@
+#include "resize_pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+// Bounded MPMC queue
+// ---------------------------------------------------------------------------
+//
+// Cell i is free for position pos when its sequence equals pos and holds the
+// item for pos when it equals pos + 1; a pop hands the cell to the next lap
+// by setting it to pos + capacity.
+
+int work_queue_init(WorkQueue* q, int depth) {
+    size_t capacity = 2;
+    while (capacity < (size_t)depth) capacity <<= 1;
+
+    q->cells = (WorkQueueCell*)malloc(capacity * sizeof(WorkQueueCell));
+    if (!q->cells) return 0;
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&q->cells[i].sequence, i);
+        q->cells[i].item = NULL;
+    }
+    q->mask = capacity - 1;
+    atomic_init(&q->push_pos, 0);
+    atomic_init(&q->pop_pos, 0);
+    sem_init(&q->free_cells, 0, (unsigned)capacity);
+    sem_init(&q->filled_cells, 0, 0);
+    return 1;
+}
+
+void work_queue_destroy(WorkQueue* q) {
+    if (!q->cells) return;
+    sem_destroy(&q->free_cells);
+    sem_destroy(&q->filled_cells);
+    free(q->cells);
+    q->cells = NULL;
+}
+
+static void semaphore_wait(sem_t* sem) {
+    while (sem_wait(sem) != 0 && errno == EINTR) {
+    }
+}
+
+// Store item in the next position; the caller already owns a free cell
+static void queue_store(WorkQueue* q, void* item) {
+    size_t pos = atomic_load_explicit(&q->push_pos, memory_order_relaxed);
+    for (;;) {
+        WorkQueueCell* cell = &q->cells[pos & q->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->push_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->item = item;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return;
+            }
+        } else {
+            // diff < 0: a free cell was counted but the consumer that
+            // emptied this one has not marked it yet
+            if (diff < 0) sched_yield();
+            pos = atomic_load_explicit(&q->push_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Take the item of the next position; the caller already owns a filled cell
+static void* queue_load(WorkQueue* q) {
+    size_t pos = atomic_load_explicit(&q->pop_pos, memory_order_relaxed);
+    for (;;) {
+        WorkQueueCell* cell = &q->cells[pos & q->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->pop_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                void* item = cell->item;
+                atomic_store_explicit(&cell->sequence, pos + q->mask + 1, memory_order_release);
+                return item;
+            }
+        } else {
+            // diff < 0: a filled cell was counted but its producer is still
+            // storing the item
+            if (diff < 0) sched_yield();
+            pos = atomic_load_explicit(&q->pop_pos, memory_order_relaxed);
+        }
+    }
+}
+
+void work_queue_push(WorkQueue* q, void* item) {
+    semaphore_wait(&q->free_cells);
+    queue_store(q, item);
+    sem_post(&q->filled_cells);
+}
+
+void* work_queue_pop(WorkQueue* q) {
+    semaphore_wait(&q->filled_cells);
+    void* item = queue_load(q);
+    sem_post(&q->free_cells);
+    return item;
+}
+
+int work_queue_try_pop(WorkQueue* q, void** item) {
+    if (sem_trywait(&q->filled_cells) != 0) return 0;
+    *item = queue_load(q);
+    sem_post(&q->free_cells);
+    return 1;
+}
+
+static int work_queue_has_items(WorkQueue* q) {
+    int filled = 0;
+    sem_getvalue(&q->filled_cells, &filled);
+    return filled > 0;
+}
+
+// ---------------------------------------------------------------------------
+// Chase-Lev deque (fixed capacity, C11 formulation of Le et al., PPoPP 2013)
+// ---------------------------------------------------------------------------
+
+#define DEQUE_CAPACITY 1024
+
+typedef struct {
+    _Alignas(64) _Atomic int64_t top;       // steal end
+    _Alignas(64) _Atomic int64_t bottom;    // owner end
+    _Atomic(WorkTask*) tasks[DEQUE_CAPACITY];
+} WorkDeque;
+
+// Owner only; 0 when the deque is full
+static int deque_push(WorkDeque* d, WorkTask* task) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY) return 0;
+    // The slot itself publishes the task to a thief that reads it
+    atomic_store_explicit(&d->tasks[b & (DEQUE_CAPACITY - 1)], task, memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+    return 1;
+}
+
+// Owner only: newest task, or NULL
+static WorkTask* deque_take(WorkDeque* d) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    WorkTask* task = atomic_load_explicit(&d->tasks[b & (DEQUE_CAPACITY - 1)], memory_order_relaxed);
+    if (t == b) {
+        // Last task: race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst,
+                                                     memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Any thread: oldest task, or NULL when empty or when another thread won it
+static WorkTask* deque_steal(WorkDeque* d) {
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+
+    WorkTask* task = atomic_load_explicit(&d->tasks[t & (DEQUE_CAPACITY - 1)], memory_order_acquire);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return task;
+}
+
+static int deque_has_tasks(WorkDeque* d) {
+    return atomic_load_explicit(&d->bottom, memory_order_acquire) >
+           atomic_load_explicit(&d->top, memory_order_acquire);
+}
+
+// ---------------------------------------------------------------------------
+// Pool
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    WorkDeque deque;
+    WorkPool* pool;
+    pthread_t thread;
+    uint32_t rng;
+} PoolWorker;
+
+struct WorkPool {
+    PoolWorker* workers;
+    int count;                      // slots (workers that failed to start keep an empty deque)
+    int started;
+    WorkQueue injection;
+
+    // Sleeping: an idle worker notes the epoch, registers as a sleeper,
+    // checks for work once more and waits until the epoch moves. Whoever
+    // adds work bumps the epoch and only takes the lock if someone sleeps.
+    _Atomic unsigned epoch;
+    atomic_int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+static __thread PoolWorker* current_worker;
+
+static void pool_notify(WorkPool* pool) {
+    atomic_fetch_add(&pool->epoch, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Try every other deque once, starting at a random victim
+static WorkTask* steal_any(WorkPool* pool, PoolWorker* self) {
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 17;
+    self->rng ^= self->rng << 5;
+    int first = (int)(self->rng % (uint32_t)pool->count);
+    for (int i = 0; i < pool->count; i++) {
+        PoolWorker* victim = &pool->workers[(first + i) % pool->count];
+        if (victim == self) continue;
+        WorkTask* task = deque_steal(&victim->deque);
+        if (task) return task;
+    }
+    return NULL;
+}
+
+static int pool_has_work(WorkPool* pool, int retired) {
+    for (int i = 0; i < pool->count; i++) {
+        if (deque_has_tasks(&pool->workers[i].deque)) return 1;
+    }
+    return !retired && work_queue_has_items(&pool->injection);
+}
+
+static void* pool_worker(void* arg) {
+    PoolWorker* self = (PoolWorker*)arg;
+    WorkPool* pool = self->pool;
+    int retired = 0;
+    current_worker = self;
+
+    for (;;) {
+        WorkTask* task = deque_take(&self->deque);
+        if (!task) task = steal_any(pool, self);
+        if (!task && !retired) {
+            void* item;
+            if (work_queue_try_pop(&pool->injection, &item)) {
+                if (item) {
+                    task = (WorkTask*)item;
+                } else {
+                    retired = 1;
+                    continue;       // one more look for stealable work
+                }
+            }
+        }
+        if (task) {
+            task->run(task, pool);
+            continue;
+        }
+        if (retired) break;
+
+        unsigned epoch = atomic_load(&pool->epoch);
+        atomic_fetch_add(&pool->sleepers, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!pool_has_work(pool, retired)) {
+            pthread_mutex_lock(&pool->lock);
+            while (atomic_load(&pool->epoch) == epoch) {
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            pthread_mutex_unlock(&pool->lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+    }
+
+    current_worker = NULL;
+    return NULL;
+}
+
+WorkPool* work_pool_create(int workers, int queue_depth) {
+    if (workers < 1) return NULL;
+
+    WorkPool* pool = (WorkPool*)calloc(1, sizeof(WorkPool));
+    if (!pool) return NULL;
+    void* slots = NULL;
+    if (posix_memalign(&slots, 64, (size_t)workers * sizeof(PoolWorker)) != 0) {
+        free(pool);
+        return NULL;
+    }
+    memset(slots, 0, (size_t)workers * sizeof(PoolWorker));
+    pool->workers = (PoolWorker*)slots;
+    pool->count = workers;
+    if (!work_queue_init(&pool->injection, queue_depth)) {
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for (int i = 0; i < workers; i++) {
+        PoolWorker* w = &pool->workers[i];
+        w->pool = pool;
+        w->rng = 0x9E3779B9u * (uint32_t)(i + 1);
+        if (pthread_create(&w->thread, NULL, pool_worker, w) == 0) {
+            pool->started++;
+        } else {
+            w->pool = NULL;
+        }
+    }
+    if (pool->started == 0) {
+        work_pool_shutdown(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int work_pool_size(const WorkPool* pool) {
+    return pool->started;
+}
+
+void work_pool_submit(WorkPool* pool, WorkTask* task) {
+    work_queue_push(&pool->injection, task);
+    pool_notify(pool);
+}
+
+void work_pool_spawn(WorkPool* pool, WorkTask* task) {
+    PoolWorker* self = current_worker;
+    if (!self || self->pool != pool || !deque_push(&self->deque, task)) {
+        task->run(task, pool);
+        return;
+    }
+    pool_notify(pool);
+}
+
+void work_pool_shutdown(WorkPool* pool) {
+    for (int i = 0; i < pool->started; i++) {
+        work_pool_submit(pool, NULL);
+    }
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->workers[i].pool) pthread_join(pool->workers[i].thread, NULL);
+    }
+    work_queue_destroy(&pool->injection);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,64 @@
+#ifndef RESIZE_POOL_H
+#define RESIZE_POOL_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Threading building blocks for the batch pipeline: a bounded lock-free
+// queue between stages and a work-stealing pool for the resize stage.
+
+// Bounded multi-producer / multi-consumer queue of pointers. Pushes and pops
+// claim a ring position with one CAS and never take a lock; semaphores
+// counting free and filled cells only put a thread to sleep when the queue
+// is full or empty. NULL is a valid item.
+typedef struct {
+    _Atomic size_t sequence;
+    void* item;
+} WorkQueueCell;
+
+typedef struct {
+    WorkQueueCell* cells;
+    size_t mask;
+    _Alignas(64) _Atomic size_t push_pos;
+    _Alignas(64) _Atomic size_t pop_pos;
+    sem_t free_cells;
+    sem_t filled_cells;
+} WorkQueue;
+
+// Capacity is depth rounded up to a power of two (at least 2)
+int work_queue_init(WorkQueue* queue, int depth);
+void work_queue_destroy(WorkQueue* queue);
+void work_queue_push(WorkQueue* queue, void* item);        // blocks while full
+void* work_queue_pop(WorkQueue* queue);                    // blocks while empty
+int work_queue_try_pop(WorkQueue* queue, void** item);     // 0 if empty
+
+// Work-stealing pool. Every worker owns a Chase-Lev deque: tasks it spawns
+// go to the bottom of its own deque and it takes them back LIFO, while idle
+// workers steal FIFO from the top of other deques. New work enters through
+// a bounded injection queue, so a producer still blocks when the pool is
+// saturated. Idle workers sleep until something is spawned or submitted.
+typedef struct WorkPool WorkPool;
+
+typedef struct WorkTask {
+    void (*run)(struct WorkTask* task, WorkPool* pool);    // owns the task from here on
+} WorkTask;
+
+// Start up to workers threads; NULL if none could start
+WorkPool* work_pool_create(int workers, int queue_depth);
+int work_pool_size(const WorkPool* pool);
+
+// Queue a task from any thread (blocks while the injection queue is full).
+// Submitting NULL retires one worker once it finds nothing left to steal.
+void work_pool_submit(WorkPool* pool, WorkTask* task);
+
+// Push a subtask onto the calling worker's deque, for idle workers to
+// steal; only valid from inside a task run by this pool (runs it inline if
+// the deque is full)
+void work_pool_spawn(WorkPool* pool, WorkTask* task);
+
+// Retire every worker (after all real work was submitted), wait for them
+// and free the pool
+void work_pool_shutdown(WorkPool* pool);
+
+#endif // RESIZE_POOL_H
@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include "resize_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_ALIGN 64
+#define RING_PAGE 4096
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+// Shared (not process-private) futexes, since the peer is another process
+static int futex_wait(_Atomic uint32_t* word, uint32_t expected, int timeout_ms) {
+    struct timespec timeout = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    return (int)syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, timeout_ms >= 0 ? &timeout : NULL,
+                        NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t* word) {
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Producer side; 0 when full or closed
+static int queue_push(RingQueue* q, void* slots, size_t item_size, uint32_t mask, const void* item,
+                      _Atomic uint32_t* closed) {
+    if (atomic_load_explicit(closed, memory_order_acquire)) return 0;
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail > mask) return 0;
+
+    memcpy((unsigned char*)slots + (size_t)(head & mask) * item_size, item, item_size);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+    // Pairs with the fence in queue_pop: either the consumer sees the new
+    // head before sleeping, or this sees waiting and wakes it
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->waiting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&q->signal, 1, memory_order_release);
+        futex_wake(&q->signal);
+    }
+    return 1;
+}
+
+// Consumer side; 1 with an item, 0 on timeout, -1 once closed
+static int queue_pop(RingQueue* q, const void* slots, size_t item_size, uint32_t mask, void* item,
+                     _Atomic uint32_t* closed, int timeout_ms) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    int timed_out = 0;
+    for (;;) {
+        if (atomic_load_explicit(&q->head, memory_order_acquire) != tail) {
+            memcpy(item, (const unsigned char*)slots + (size_t)(tail & mask) * item_size, item_size);
+            atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+            return 1;
+        }
+        if (atomic_load_explicit(closed, memory_order_acquire)) return -1;
+        if (timed_out || timeout_ms == 0) return 0;
+
+        uint32_t signal = atomic_load_explicit(&q->signal, memory_order_acquire);
+        atomic_store_explicit(&q->waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&q->head, memory_order_acquire) == tail &&
+            !atomic_load_explicit(closed, memory_order_acquire)) {
+            if (futex_wait(&q->signal, signal, timeout_ms) != 0 && errno == ETIMEDOUT) timed_out = 1;
+        }
+        atomic_store_explicit(&q->waiting, 0, memory_order_relaxed);
+    }
+}
+
+int resize_ring_create(ResizeRing* ring, int slot_count, size_t input_slot_bytes, size_t output_slot_bytes,
+                       int* fd) {
+    memset(ring, 0, sizeof(*ring));
+    *fd = -1;
+    if (slot_count < 1 || slot_count > RING_MAX_SLOTS || (slot_count & (slot_count - 1)) ||
+        !input_slot_bytes || !output_slot_bytes) {
+        return 0;
+    }
+
+    ring->slot_count = (uint32_t)slot_count;
+    ring->input_slot_bytes = round_up(input_slot_bytes, RING_ALIGN);
+    ring->output_slot_bytes = round_up(output_slot_bytes, RING_ALIGN);
+    ring->input_offset = round_up(sizeof(RingHeader), RING_PAGE);
+    ring->output_offset = round_up(ring->input_offset + ring->slot_count * ring->input_slot_bytes, RING_PAGE);
+    ring->size = round_up(ring->output_offset + ring->slot_count * ring->output_slot_bytes, RING_PAGE);
+
+    // Sealed against shrinking, so neither side can make the other fault on
+    // a truncated mapping
+    int memfd = memfd_create("resize-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) return 0;
+    if (ftruncate(memfd, (off_t)ring->size) != 0 ||
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        close(memfd);
+        return 0;
+    }
+    void* base = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (base == MAP_FAILED) {
+        close(memfd);
+        return 0;
+    }
+
+    // The memfd starts zeroed, so the queues start empty
+    ring->base = (unsigned char*)base;
+    ring->header = (RingHeader*)base;
+    ring->header->magic = RING_MAGIC;
+    ring->header->slot_count = ring->slot_count;
+    ring->header->input_slot_bytes = ring->input_slot_bytes;
+    ring->header->output_slot_bytes = ring->output_slot_bytes;
+    ring->header->input_offset = ring->input_offset;
+    ring->header->output_offset = ring->output_offset;
+    ring->header->total_bytes = ring->size;
+    *fd = memfd;
+    return 1;
+}
+
+int resize_ring_map(ResizeRing* ring, int fd) {
+    memset(ring, 0, sizeof(*ring));
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RingHeader) || seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        return 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return 0;
+    RingHeader* header = (RingHeader*)base;
+
+    // Everything is checked against the mapping once, on private copies
+    uint64_t slots = header->slot_count;
+    uint64_t in_bytes = header->input_slot_bytes, out_bytes = header->output_slot_bytes;
+    uint64_t in_offset = header->input_offset, out_offset = header->output_offset;
+    int ok = header->magic == RING_MAGIC && slots >= 1 && slots <= RING_MAX_SLOTS && !(slots & (slots - 1)) &&
+             in_offset >= sizeof(RingHeader) && out_offset >= sizeof(RingHeader) && in_offset <= size &&
+             out_offset <= size && in_bytes <= (size - in_offset) / slots && out_bytes <= (size - out_offset) / slots &&
+             (in_offset + slots * in_bytes <= out_offset || out_offset + slots * out_bytes <= in_offset);
+    if (!ok) {
+        munmap(base, size);
+        return 0;
+    }
+
+    ring->header = header;
+    ring->base = (unsigned char*)base;
+    ring->size = size;
+    ring->slot_count = (uint32_t)slots;
+    ring->input_slot_bytes = (size_t)in_bytes;
+    ring->output_slot_bytes = (size_t)out_bytes;
+    ring->input_offset = (size_t)in_offset;
+    ring->output_offset = (size_t)out_offset;
+    return 1;
+}
+
+void resize_ring_close(ResizeRing* ring) {
+    if (!ring->header) return;
+    RingHeader* header = ring->header;
+    atomic_store_explicit(&header->closed, 1, memory_order_seq_cst);
+    atomic_fetch_add_explicit(&header->requests.signal, 1, memory_order_release);
+    atomic_fetch_add_explicit(&header->completions.signal, 1, memory_order_release);
+    futex_wake(&header->requests.signal);
+    futex_wake(&header->completions.signal);
+    munmap(ring->base, ring->size);
+    memset(ring, 0, sizeof(*ring));
+}
+
+void* resize_ring_input(const ResizeRing* ring, uint32_t slot) {
+    return slot < ring->slot_count ? ring->base + ring->input_offset + (size_t)slot * ring->input_slot_bytes : NULL;
+}
+
+void* resize_ring_output(const ResizeRing* ring, uint32_t slot) {
+    return slot < ring->slot_count ? ring->base + ring->output_offset + (size_t)slot * ring->output_slot_bytes : NULL;
+}
+
+int resize_ring_submit(ResizeRing* ring, const RingRequest* request) {
+    RingHeader* header = ring->header;
+    return queue_push(&header->requests, header->request_slots, sizeof(RingRequest), ring->slot_count - 1, request,
+                      &header->closed);
+}
+
+int resize_ring_wait(ResizeRing* ring, RingCompletion* completion, int timeout_ms) {
+    RingHeader* header = ring->header;
+    return queue_pop(&header->completions, header->completion_slots, sizeof(RingCompletion), ring->slot_count - 1,
+                     completion, &header->closed, timeout_ms);
+}
+
+int resize_ring_next(ResizeRing* ring, RingRequest* request, int timeout_ms) {
+    RingHeader* header = ring->header;
+    return queue_pop(&header->requests, header->request_slots, sizeof(RingRequest), ring->slot_count - 1, request,
+                     &header->closed, timeout_ms);
+}
+
+int resize_ring_complete(ResizeRing* ring, const RingCompletion* completion) {
+    RingHeader* header = ring->header;
+    return queue_push(&header->completions, header->completion_slots, sizeof(RingCompletion), ring->slot_count - 1,
+                      completion, &header->closed);
+}
@@ -0,0 +1,101 @@
+#ifndef RESIZE_RING_H
+#define RESIZE_RING_H
+
+#include "resize_batch.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Zero-copy resizing for clients that already hold decoded frames. The
+// client creates a ring in a memfd and attaches it to the daemon once
+// (DAEMON_FORMAT_RING); after that no pixels and no socket messages move
+// per frame. The client writes a frame into one of its input slots and
+// queues a RingRequest, the daemon resizes straight from that slot into the
+// matching output slot and queues a RingCompletion.
+//
+// Both queues are single-producer / single-consumer rings in the shared
+// header. A consumer that finds its ring empty sleeps on a futex there, and
+// a producer only makes the wake-up system call when the other side is
+// actually asleep.
+
+#define RING_MAGIC 0x474e4952u      // "RING"
+#define RING_MAX_SLOTS 64
+
+typedef struct {
+    uint32_t slot;                  // input slot holding the frame, output goes to the same slot
+    int32_t width;                  // frame in the input slot, rows packed
+    int32_t height;
+    int32_t channels;
+    BatchTarget target;             // same meaning as a --batch size
+    uint64_t tag;                   // echoed in the completion
+} RingRequest;
+
+typedef struct {
+    uint32_t slot;
+    int32_t status;                 // 0, or an errno value
+    int32_t width;                  // frame in the output slot, rows packed
+    int32_t height;
+    int32_t channels;
+    uint64_t tag;
+} RingCompletion;
+
+// One direction: the producer advances head, the consumer tail. The
+// consumer sleeps on signal, which the producer bumps when waiting is set.
+typedef struct {
+    _Alignas(64) _Atomic uint32_t head;
+    _Atomic uint32_t signal;
+    _Atomic uint32_t waiting;
+    _Alignas(64) _Atomic uint32_t tail;
+} RingQueue;
+
+// Start of the shared mapping; the slots follow at the given offsets
+typedef struct {
+    uint32_t magic;                 // RING_MAGIC
+    uint32_t slot_count;            // power of two, at most RING_MAX_SLOTS
+    uint64_t input_slot_bytes;
+    uint64_t output_slot_bytes;
+    uint64_t input_offset;
+    uint64_t output_offset;
+    uint64_t total_bytes;
+    _Atomic uint32_t closed;        // set by whichever side leaves first
+    RingQueue requests;             // client -> daemon
+    RingQueue completions;          // daemon -> client
+    RingRequest request_slots[RING_MAX_SLOTS];
+    RingCompletion completion_slots[RING_MAX_SLOTS];
+} RingHeader;
+
+// A mapped ring; the layout is copied out of the header when mapping, so a
+// misbehaving peer cannot move the slots afterwards
+typedef struct {
+    RingHeader* header;
+    unsigned char* base;
+    size_t size;
+    uint32_t slot_count;
+    size_t input_slot_bytes;
+    size_t output_slot_bytes;
+    size_t input_offset;
+    size_t output_offset;
+} ResizeRing;
+
+// Client: create a ring in a new memfd (*fd, to attach and then close)
+int resize_ring_create(ResizeRing* ring, int slot_count, size_t input_slot_bytes, size_t output_slot_bytes,
+                       int* fd);
+// Daemon: map a ring received from a client, checking its layout
+int resize_ring_map(ResizeRing* ring, int fd);
+// Either side: mark the ring closed, wake the peer and unmap
+void resize_ring_close(ResizeRing* ring);
+
+void* resize_ring_input(const ResizeRing* ring, uint32_t slot);
+void* resize_ring_output(const ResizeRing* ring, uint32_t slot);
+
+// Client side. submit returns 0 if the ring is full or closed; wait returns
+// 1 with a completion, 0 on timeout (timeout_ms < 0 waits forever) and -1
+// once the ring is closed.
+int resize_ring_submit(ResizeRing* ring, const RingRequest* request);
+int resize_ring_wait(ResizeRing* ring, RingCompletion* completion, int timeout_ms);
+
+// Daemon side, same return values
+int resize_ring_next(ResizeRing* ring, RingRequest* request, int timeout_ms);
+int resize_ring_complete(ResizeRing* ring, const RingCompletion* completion);
+
+#endif // RESIZE_RING_H
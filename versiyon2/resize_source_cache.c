@@ -0,0 +1,194 @@
+#include "resize_source_cache.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum {
+    SOURCE_LOADING,
+    SOURCE_READY,
+    SOURCE_FAILED
+} SourceState;
+
+struct SourceEntry {
+    SourceKey key;
+    SourceState state;
+    Image* image;
+    size_t bytes;
+    int64_t last_used_ms;
+    int refs;                       // requests holding the entry
+    int listed;                     // still findable; freed at refs 0 once not
+    SourceEntry* newer;             // LRU list
+    SourceEntry* older;
+};
+
+// Only a handful of decoded images fit in the bound, so the list is searched
+// linearly
+struct SourceCache {
+    pthread_mutex_t lock;
+    pthread_cond_t decoded;         // a placeholder was filled
+    size_t memory_limit;
+    int ttl_ms;
+    SourceEntry* newest;
+    SourceEntry* oldest;
+    SourceCacheStats stats;
+};
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void free_entry(SourceEntry* e) {
+    if (e->image) free_image(e->image);
+    free(e);
+}
+
+static void lru_unlink(SourceCache* cache, SourceEntry* e) {
+    if (e->newer) e->newer->older = e->older; else cache->newest = e->older;
+    if (e->older) e->older->newer = e->newer; else cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void lru_push(SourceCache* cache, SourceEntry* e) {
+    e->newer = NULL;
+    e->older = cache->newest;
+    if (cache->newest) cache->newest->newer = e; else cache->oldest = e;
+    cache->newest = e;
+}
+
+// Make an entry unfindable; its memory goes once the last holder releases it
+static void unlist(SourceCache* cache, SourceEntry* e) {
+    lru_unlink(cache, e);
+    e->listed = 0;
+    cache->stats.entries--;
+    if (e->state == SOURCE_READY) cache->stats.bytes -= e->bytes;
+    if (e->refs == 0) free_entry(e);
+}
+
+static void expire_locked(SourceCache* cache, int64_t now) {
+    SourceEntry* e = cache->oldest;
+    while (e) {
+        SourceEntry* newer = e->newer;
+        if (e->state == SOURCE_READY && now - e->last_used_ms > cache->ttl_ms) {
+            unlist(cache, e);
+            cache->stats.expirations++;
+        }
+        e = newer;
+    }
+}
+
+static void evict_locked(SourceCache* cache) {
+    SourceEntry* e = cache->oldest;
+    while (e && cache->stats.bytes > cache->memory_limit) {
+        SourceEntry* newer = e->newer;
+        if (e->state == SOURCE_READY) {
+            unlist(cache, e);
+            cache->stats.evictions++;
+        }
+        e = newer;
+    }
+}
+
+SourceCache* source_cache_open(size_t memory_limit, int ttl_ms) {
+    SourceCache* cache = (SourceCache*)calloc(1, sizeof(SourceCache));
+    if (!cache) return NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->decoded, NULL);
+    cache->memory_limit = memory_limit;
+    cache->ttl_ms = ttl_ms;
+    return cache;
+}
+
+void source_cache_close(SourceCache* cache) {
+    if (!cache) return;
+    while (cache->oldest) {
+        SourceEntry* e = cache->oldest;
+        lru_unlink(cache, e);
+        free_entry(e);
+    }
+    pthread_cond_destroy(&cache->decoded);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+const Image* source_cache_get(SourceCache* cache, const SourceKey* key, SourceEntry** entry) {
+    int64_t now = now_ms();
+    const Image* image = NULL;
+    pthread_mutex_lock(&cache->lock);
+    expire_locked(cache, now);
+    cache->stats.lookups++;
+
+    SourceEntry* e = cache->newest;
+    while (e && memcmp(&e->key, key, sizeof(*key)) != 0) e = e->older;
+
+    if (e) {
+        e->refs++;
+        while (e->state == SOURCE_LOADING) pthread_cond_wait(&cache->decoded, &cache->lock);
+        if (e->state == SOURCE_READY) {
+            cache->stats.hits++;
+            e->last_used_ms = now;
+            if (e->listed) {
+                lru_unlink(cache, e);
+                lru_push(cache, e);
+            }
+            image = e->image;
+        } else {
+            // The decode this request waited for failed: let it try alone
+            if (--e->refs == 0 && !e->listed) free_entry(e);
+            e = NULL;
+        }
+    } else {
+        e = (SourceEntry*)calloc(1, sizeof(SourceEntry));
+        if (e) {
+            e->key = *key;
+            e->state = SOURCE_LOADING;
+            e->last_used_ms = now;
+            e->refs = 1;
+            e->listed = 1;
+            lru_push(cache, e);
+            cache->stats.entries++;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    *entry = e;
+    return image;
+}
+
+void source_cache_fill(SourceCache* cache, SourceEntry* entry, Image* image) {
+    pthread_mutex_lock(&cache->lock);
+    entry->image = image;
+    entry->last_used_ms = now_ms();
+    if (image) {
+        entry->state = SOURCE_READY;
+        entry->bytes = sizeof(Image) + (size_t)image->width * image->height * image->channels;
+        cache->stats.bytes += entry->bytes;
+        evict_locked(cache);
+    } else {
+        entry->state = SOURCE_FAILED;
+        unlist(cache, entry);
+    }
+    pthread_cond_broadcast(&cache->decoded);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void source_cache_release(SourceCache* cache, SourceEntry* entry) {
+    if (!entry) return;
+    pthread_mutex_lock(&cache->lock);
+    if (--entry->refs == 0 && !entry->listed) free_entry(entry);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void source_cache_expire(SourceCache* cache) {
+    int64_t now = now_ms();
+    pthread_mutex_lock(&cache->lock);
+    expire_locked(cache, now);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void source_cache_stats(SourceCache* cache, SourceCacheStats* stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
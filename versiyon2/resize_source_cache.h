@@ -0,0 +1,60 @@
+#ifndef RESIZE_SOURCE_CACHE_H
+#define RESIZE_SOURCE_CACHE_H
+
+#include "image_resize.h"
+#include <stdint.h>
+
+// Short-lived cache of decoded sources. Clients usually ask for several
+// sizes of one image as separate requests a few milliseconds apart; every
+// request after the first one resizes the Image decoded by the first
+// instead of decoding the file again. Requests that arrive while the image
+// is still being decoded wait for that decode rather than starting their
+// own.
+//
+// Entries expire a while after their last use and the decoded bytes are
+// bounded; an image in use by a request stays alive until it is released.
+
+// Identity of an encoded source. A regular file is named by device, inode,
+// size and modification time, so it is recognised without reading it; any
+// other source (a pipe) by a hash of its bytes, with the identity fields 0.
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t content_hash;
+} SourceKey;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;                  // includes requests that waited for a decode
+    uint64_t evictions;             // dropped for space
+    uint64_t expirations;           // dropped after the TTL
+    uint64_t bytes;
+    uint64_t entries;
+} SourceCacheStats;
+
+typedef struct SourceCache SourceCache;
+typedef struct SourceEntry SourceEntry;
+
+SourceCache* source_cache_open(size_t memory_limit, int ttl_ms);
+void source_cache_close(SourceCache* cache);
+
+// Look a source up. A hit returns the decoded image and holds *entry. On a
+// miss the caller gets a held placeholder in *entry, decodes and hands the
+// result to source_cache_fill; *entry is NULL when the caller should just
+// decode privately.
+const Image* source_cache_get(SourceCache* cache, const SourceKey* key, SourceEntry** entry);
+
+// Publish the image decoded for a placeholder (NULL if decoding failed).
+// The cache takes ownership of image; the entry stays held by the caller.
+void source_cache_fill(SourceCache* cache, SourceEntry* entry, Image* image);
+
+void source_cache_release(SourceCache* cache, SourceEntry* entry);
+
+// Drop entries unused for longer than the TTL
+void source_cache_expire(SourceCache* cache);
+
+void source_cache_stats(SourceCache* cache, SourceCacheStats* stats);
+
+#endif // RESIZE_SOURCE_CACHE_H
@@ -0,0 +1,241 @@
+#include "resize_trace.h"
+
+#ifdef RESIZE_TRACE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Events kept per thread; older spans are overwritten once the ring is full
+#define TRACE_RING_SIZE 8192
+
+typedef struct {
+    TraceStage stage;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} TraceEvent;
+
+// One record per live tracing thread. Only the owning thread writes it,
+// so updates are plain relaxed stores; the exporter reads them with relaxed
+// loads, which never tears a 64-bit value. A thread that exits gives its
+// record back and the next new thread takes it over, counters and ring
+// included, so a process starting thread after thread (the daemon's ring
+// sessions) keeps as many records as it ever had threads at once.
+typedef struct TraceThread {
+    struct TraceThread* next;
+    int id;
+    int in_use;                                     // guarded by registry_lock
+    _Atomic uint64_t head;                          // events ever recorded
+    _Atomic uint64_t stage_ns[TRACE_STAGE_COUNT];
+    _Atomic uint64_t stage_calls[TRACE_STAGE_COUNT];
+    _Atomic uint64_t counters[TRACE_COUNTER_COUNT];
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceThread;
+
+static const char* const stage_names[TRACE_STAGE_COUNT] = {
+    "decode", "copy", "plan", "resize", "convert", "png_filter", "deflate", "write"
+};
+
+static const struct {
+    const char* metric;
+    const char* help;
+} counter_info[TRACE_COUNTER_COUNT] = {
+    {"resize_pixels_in_total", "Source pixels resampled"},
+    {"resize_pixels_out_total", "Destination pixels produced"},
+    {"resize_decoded_bytes_total", "Decoded sample bytes"},
+    {"resize_written_bytes_total", "Encoded bytes written to files"},
+    {"resize_allocations_total", "Image buffers allocated"},
+    {"resize_allocated_bytes_total", "Bytes of image buffers allocated"}
+};
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceThread* registry;
+static int next_thread_id = 1;
+static __thread TraceThread* current;
+static pthread_key_t exit_key;
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Thread exit: hand the record back for reuse
+static void release_thread(void* record) {
+    TraceThread* t = (TraceThread*)record;
+    pthread_mutex_lock(&registry_lock);
+    t->in_use = 0;
+    pthread_mutex_unlock(&registry_lock);
+    current = NULL;
+}
+
+static void create_exit_key(void) {
+    pthread_key_create(&exit_key, release_thread);
+}
+
+// The calling thread's record: one left by an exited thread, or a new one
+// registered on first use (NULL if out of memory)
+static TraceThread* trace_thread(void) {
+    if (current) return current;
+    pthread_once(&exit_key_once, create_exit_key);
+
+    pthread_mutex_lock(&registry_lock);
+    TraceThread* t = registry;
+    while (t && t->in_use) t = t->next;
+    if (!t) {
+        t = (TraceThread*)calloc(1, sizeof(TraceThread));
+        if (!t) {
+            pthread_mutex_unlock(&registry_lock);
+            return NULL;
+        }
+        t->id = next_thread_id++;
+        t->next = registry;
+        registry = t;
+    }
+    t->in_use = 1;
+    pthread_mutex_unlock(&registry_lock);
+
+    pthread_setspecific(exit_key, t);
+    current = t;
+    return t;
+}
+
+static inline void add_relaxed(_Atomic uint64_t* value, uint64_t amount) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void trace_span_end(const TraceSpan* span) {
+    uint64_t end = trace_now_ns();
+    TraceThread* t = trace_thread();
+    if (!t) return;
+
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    TraceEvent* e = &t->events[head % TRACE_RING_SIZE];
+    e->stage = span->stage;
+    e->start_ns = span->start_ns;
+    e->duration_ns = end - span->start_ns;
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+
+    add_relaxed(&t->stage_ns[span->stage], end - span->start_ns);
+    add_relaxed(&t->stage_calls[span->stage], 1);
+}
+
+void trace_count(TraceCounter counter, uint64_t amount) {
+    TraceThread* t = trace_thread();
+    if (t) add_relaxed(&t->counters[counter], amount);
+}
+
+int trace_write_chrome_json(FILE* out) {
+    pid_t pid = getpid();
+    int first = 1;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    pthread_mutex_lock(&registry_lock);
+
+    // Timestamps are relative to the earliest span still held in any ring
+    uint64_t epoch_ns = trace_now_ns();
+    for (TraceThread* t = registry; t; t = t->next) {
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        for (uint64_t i = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0; i < head; i++) {
+            uint64_t start = t->events[i % TRACE_RING_SIZE].start_ns;
+            if (start < epoch_ns) epoch_ns = start;
+        }
+    }
+
+    for (TraceThread* t = registry; t; t = t->next) {
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        uint64_t begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        fprintf(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"name\": \"resize-%d\"}}", first ? "" : ",", (int)pid, t->id, t->id);
+        first = 0;
+
+        // Complete ("X") events, timestamps in microseconds
+        for (uint64_t i = begin; i < head; i++) {
+            const TraceEvent* e = &t->events[i % TRACE_RING_SIZE];
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"resize\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                    "\"ts\": %.3f, \"dur\": %.3f}", stage_names[e->stage], (int)pid, t->id,
+                    (double)(e->start_ns - epoch_ns) / 1e3, (double)e->duration_ns / 1e3);
+        }
+    }
+
+    // Counter totals as one counter ("C") sample at export time
+    uint64_t totals[TRACE_COUNTER_COUNT] = {0};
+    for (TraceThread* t = registry; t; t = t->next) {
+        for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+            totals[c] += atomic_load_explicit(&t->counters[c], memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    fprintf(out, "%s\n{\"name\": \"counters\", \"ph\": \"C\", \"pid\": %d, \"tid\": 0, \"ts\": %.3f, \"args\": {",
+            first ? "" : ",", (int)pid, (double)(trace_now_ns() - epoch_ns) / 1e3);
+    for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+        fprintf(out, "%s\"%s\": %llu", c ? ", " : "", counter_info[c].metric, (unsigned long long)totals[c]);
+    }
+    fprintf(out, "}}\n]}\n");
+    return !ferror(out);
+}
+
+int trace_write_prometheus(FILE* out) {
+    uint64_t stage_ns[TRACE_STAGE_COUNT] = {0};
+    uint64_t stage_calls[TRACE_STAGE_COUNT] = {0};
+    uint64_t counters[TRACE_COUNTER_COUNT] = {0};
+    uint64_t dropped = 0;
+
+    pthread_mutex_lock(&registry_lock);
+    for (TraceThread* t = registry; t; t = t->next) {
+        for (int s = 0; s < TRACE_STAGE_COUNT; s++) {
+            stage_ns[s] += atomic_load_explicit(&t->stage_ns[s], memory_order_relaxed);
+            stage_calls[s] += atomic_load_explicit(&t->stage_calls[s], memory_order_relaxed);
+        }
+        for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+            counters[c] += atomic_load_explicit(&t->counters[c], memory_order_relaxed);
+        }
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+        if (head > TRACE_RING_SIZE) dropped += head - TRACE_RING_SIZE;
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    fprintf(out, "# HELP resize_stage_seconds_total Wall time spent in each stage\n");
+    fprintf(out, "# TYPE resize_stage_seconds_total counter\n");
+    for (int s = 0; s < TRACE_STAGE_COUNT; s++) {
+        fprintf(out, "resize_stage_seconds_total{stage=\"%s\"} %.9f\n", stage_names[s], stage_ns[s] / 1e9);
+    }
+    fprintf(out, "# HELP resize_stage_calls_total Spans recorded per stage\n");
+    fprintf(out, "# TYPE resize_stage_calls_total counter\n");
+    for (int s = 0; s < TRACE_STAGE_COUNT; s++) {
+        fprintf(out, "resize_stage_calls_total{stage=\"%s\"} %llu\n", stage_names[s],
+                (unsigned long long)stage_calls[s]);
+    }
+    for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_info[c].metric, counter_info[c].help,
+                counter_info[c].metric, counter_info[c].metric, (unsigned long long)counters[c]);
+    }
+    fprintf(out, "# HELP resize_trace_spans_dropped_total Spans overwritten in full ring buffers\n");
+    fprintf(out, "# TYPE resize_trace_spans_dropped_total counter\n");
+    fprintf(out, "resize_trace_spans_dropped_total %llu\n", (unsigned long long)dropped);
+    return !ferror(out);
+}
+
+// Forget everything recorded so far (thread records stay registered)
+void trace_reset(void) {
+    pthread_mutex_lock(&registry_lock);
+    for (TraceThread* t = registry; t; t = t->next) {
+        atomic_store_explicit(&t->head, 0, memory_order_relaxed);
+        for (int s = 0; s < TRACE_STAGE_COUNT; s++) {
+            atomic_store_explicit(&t->stage_ns[s], 0, memory_order_relaxed);
+            atomic_store_explicit(&t->stage_calls[s], 0, memory_order_relaxed);
+        }
+        for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+            atomic_store_explicit(&t->counters[c], 0, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+#endif // RESIZE_TRACE
@@ -0,0 +1,66 @@
+#ifndef RESIZE_TRACE_H
+#define RESIZE_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Optional instrumentation: monotonic-clock spans per stage and pixel, byte
+// and allocation counters, kept per thread (spans in a ring buffer) and
+// exported as Chrome trace JSON or Prometheus text. Build with
+// -DRESIZE_TRACE to enable it; otherwise every macro below expands to
+// nothing and the arguments are not even evaluated.
+
+// Stages a span can measure
+typedef enum {
+    TRACE_STAGE_DECODE,         // stb_image decode
+    TRACE_STAGE_COPY,           // decoded pixels into an Image
+    TRACE_STAGE_PLAN,           // coordinate tables
+    TRACE_STAGE_RESIZE,         // resampling kernels
+    TRACE_STAGE_CONVERT,        // interleaved <-> planar
+    TRACE_STAGE_PNG_FILTER,     // PNG per-row filter selection
+    TRACE_STAGE_DEFLATE,        // zlib compression and chunk CRCs
+    TRACE_STAGE_WRITE,          // file write
+    TRACE_STAGE_COUNT
+} TraceStage;
+
+// Monotonically increasing counters
+typedef enum {
+    TRACE_PIXELS_IN,            // source pixels resampled
+    TRACE_PIXELS_OUT,           // destination pixels produced
+    TRACE_BYTES_DECODED,        // decoded sample bytes
+    TRACE_BYTES_WRITTEN,        // encoded file bytes
+    TRACE_ALLOCATIONS,          // image buffers allocated
+    TRACE_ALLOCATED_BYTES,
+    TRACE_COUNTER_COUNT
+} TraceCounter;
+
+#ifdef RESIZE_TRACE
+
+typedef struct {
+    TraceStage stage;
+    uint64_t start_ns;
+} TraceSpan;
+
+uint64_t trace_now_ns(void);
+void trace_span_end(const TraceSpan* span);
+void trace_count(TraceCounter counter, uint64_t amount);
+
+// Export everything recorded so far by every thread. Meant to be called
+// while no resize is running; returns 1 on success.
+int trace_write_chrome_json(FILE* out);
+int trace_write_prometheus(FILE* out);
+void trace_reset(void);
+
+#define TRACE_SPAN_BEGIN(span, stage) TraceSpan span = { (stage), trace_now_ns() }
+#define TRACE_SPAN_END(span) trace_span_end(&(span))
+#define TRACE_COUNT(counter, amount) trace_count((counter), (uint64_t)(amount))
+
+#else
+
+#define TRACE_SPAN_BEGIN(span, stage) ((void)0)
+#define TRACE_SPAN_END(span) ((void)0)
+#define TRACE_COUNT(counter, amount) ((void)0)
+
+#endif // RESIZE_TRACE
+
+#endif // RESIZE_TRACE_H
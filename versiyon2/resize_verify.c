@@ -0,0 +1,493 @@
+#include "image_resize.h"
+#include "resize_internal.h"
+#include "resize_job.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bit-exactness self-check. Every SIMD, banded and threaded way of running
+// the resize kernels must produce the same bytes as the portable scalar code
+// running the whole image in one call; any difference is reported with the
+// first pixel that differs.
+
+// Source images of the corpus: the demo's gradient pattern, seeded noise and
+// hard edges (steps, one-pixel lines, checkerboard, varying alpha)
+typedef enum {
+    PATTERN_GRADIENT,
+    PATTERN_NOISE,
+    PATTERN_EDGES,
+    PATTERN_COUNT
+} CorpusPattern;
+
+static const char* const pattern_names[PATTERN_COUNT] = { "gradient", "noise", "edges" };
+
+static const struct {
+    int width;
+    int height;
+} corpus_sizes[] = {
+    {1, 1}, {1, 9}, {9, 1}, {3, 5}, {17, 13}, {64, 48}, {203, 151}
+};
+
+// main.c's demo ratios plus integer and non-dyadic ones
+static const struct {
+    int num;
+    int denom;
+} corpus_scales[] = {
+    {1, 2}, {1, 4}, {3, 4}, {2, 1}, {3, 1}, {1, 3}, {5, 7}, {7, 5}
+};
+
+static const ResizeIsa isa_levels[] = { RESIZE_ISA_SCALAR, RESIZE_ISA_SSE2, RESIZE_ISA_SSSE3, RESIZE_ISA_AVX2, RESIZE_ISA_NATIVE };
+static const char* const isa_names[] = { "scalar", "sse2", "ssse3", "avx2", "native" };
+static const int thread_counts[] = { 1, 2, 3 };
+static const int band_rows[] = { 1, 5, 32 };
+
+static uint32_t noise_next(uint32_t* state) {
+    // xorshift32: fixed sequence for a given seed on every platform
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static Image* make_corpus_image(CorpusPattern pattern, int width, int height, int channels) {
+    if (pattern == PATTERN_GRADIENT) {
+        return create_test_pattern(width, height, channels);
+    }
+
+    Image* img = create_image(width, height, channels);
+    if (!img) return NULL;
+
+    uint8_t* data = (uint8_t*)img->data;
+    uint32_t state = 0x9e3779b9u ^ (uint32_t)(width * 131 + height * 7 + channels);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* p = data + ((size_t)y * width + x) * channels;
+            for (int c = 0; c < channels; c++) {
+                if (pattern == PATTERN_NOISE) {
+                    p[c] = (uint8_t)(noise_next(&state) >> 24);
+                } else if (x < width / 4) {
+                    p[c] = ((x + y) & 1) ? 255 : 0;          // checkerboard
+                } else if (x == width / 2 || y % 8 == 3) {
+                    p[c] = (uint8_t)(255 - c * 40);          // one-pixel lines
+                } else {
+                    p[c] = x < (3 * width) / 4 ? 0 : 255;    // hard step
+                }
+            }
+            // Alpha jumps between opaque, transparent and partial
+            if (pattern == PATTERN_EDGES && (channels == 2 || channels == 4)) {
+                p[channels - 1] = (uint8_t)((y % 3) * 127 + (x & 1));
+            }
+        }
+    }
+    return img;
+}
+
+// Widen an 8-bit image to 16 bits per sample, spreading values over the full range
+static Image16* widen_image(const Image* img) {
+    Image16* wide = create_image16(img->width, img->height, img->channels);
+    if (!wide) return NULL;
+    size_t count = (size_t)img->width * img->height * img->channels;
+    const uint8_t* src = (const uint8_t*)img->data;
+    uint16_t* dst = (uint16_t*)wide->data;
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (uint16_t)(src[i] * 257 + (i % 251));
+    }
+    return wide;
+}
+
+// Compare two buffers of samples; print the first differing pixel and return 1 on mismatch
+static int compare_samples(const char* what, const void* expected, const void* actual, int width, int height,
+                           int channels, int sample_size) {
+    size_t count = (size_t)width * height * channels;
+    if (memcmp(expected, actual, count * sample_size) == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        unsigned e = sample_size == 2 ? ((const uint16_t*)expected)[i] : ((const uint8_t*)expected)[i];
+        unsigned a = sample_size == 2 ? ((const uint16_t*)actual)[i] : ((const uint8_t*)actual)[i];
+        if (e != a) {
+            size_t pixel = i / channels;
+            printf("MISMATCH %s: first difference at pixel (%d, %d) channel %d: expected %u, got %u\n",
+                   what, (int)(pixel % width), (int)(pixel / width), (int)(i % channels), e, a);
+            return 1;
+        }
+    }
+    return 1;
+}
+
+// Compare two whole images (NULL on either side counts as a mismatch unless both are NULL)
+static int compare_images(const char* what, const Image* expected, const Image* actual) {
+    if (!expected || !actual) {
+        if (expected == actual) return 0;
+        printf("MISMATCH %s: one variant failed to produce an image\n", what);
+        return 1;
+    }
+    if (expected->width != actual->width || expected->height != actual->height ||
+        expected->channels != actual->channels) {
+        printf("MISMATCH %s: size %dx%dx%d, expected %dx%dx%d\n", what, actual->width, actual->height,
+               actual->channels, expected->width, expected->height, expected->channels);
+        return 1;
+    }
+    return compare_samples(what, expected->data, actual->data, expected->width, expected->height,
+                           expected->channels, 1);
+}
+
+// Banded kernel run: output rows are cut into bands of band_rows rows and
+// handed out to worker threads through a shared counter, the way a threaded
+// or streaming caller drives the row-range kernels
+typedef struct {
+    ResizeRowsFn kernel;
+    const void* src;
+    void* dst;
+    const ResizePlan* plan;
+    int band_rows;
+    atomic_int next_band;
+} BandJob;
+
+static void* band_worker(void* arg) {
+    BandJob* job = (BandJob*)arg;
+    int bands = (job->plan->out_height + job->band_rows - 1) / job->band_rows;
+    for (;;) {
+        int band = atomic_fetch_add(&job->next_band, 1);
+        if (band >= bands) break;
+        int y_begin = band * job->band_rows;
+        int y_end = y_begin + job->band_rows;
+        if (y_end > job->plan->out_height) y_end = job->plan->out_height;
+        job->kernel(job->src, job->dst, job->plan, y_begin, y_end);
+    }
+    return NULL;
+}
+
+static void run_banded(ResizeRowsFn kernel, const void* src, void* dst, const ResizePlan* plan,
+                       int band_rows, int threads) {
+    BandJob job = { kernel, src, dst, plan, band_rows, 0 };
+    pthread_t workers[4];
+    int started = 0;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&workers[started], NULL, band_worker, &job) == 0) started++;
+    }
+    band_worker(&job);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+}
+
+// Dispatch-table kernels: every ISA level x thread count x band height
+// against the scalar kernel run over the whole image in one call
+static int check_kernels(const void* src, int in_width, int in_height, int out_width, int out_height,
+                         int channels, PixelType type, const char* name, int* variants) {
+    int sample_size = type == PIXEL_U16 ? 2 : 1;
+    size_t out_bytes = (size_t)out_width * out_height * channels * sample_size;
+    uint8_t* expected = (uint8_t*)malloc(out_bytes);
+    uint8_t* actual = (uint8_t*)malloc(out_bytes);
+    int failures = 0;
+
+    for (int f = 0; f < KERNEL_FILTER_COUNT && expected && actual; f++) {
+        ResizePlan plan;
+        if (!resize_plan_init(&plan, in_width, in_height, out_width, out_height, channels, (KernelFilter)f)) {
+            failures++;
+            break;
+        }
+
+        resize_set_isa_limit(RESIZE_ISA_SCALAR);
+        resize_kernel_lookup(type, channels, (KernelFilter)f)(src, expected, &plan, 0, out_height);
+
+        for (size_t i = 0; i < sizeof(isa_levels) / sizeof(isa_levels[0]); i++) {
+            resize_set_isa_limit(isa_levels[i]);
+            ResizeRowsFn kernel = resize_kernel_lookup(type, channels, (KernelFilter)f);
+            for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+                for (size_t b = 0; b <= sizeof(band_rows) / sizeof(band_rows[0]); b++) {
+                    int rows = b < sizeof(band_rows) / sizeof(band_rows[0]) ? band_rows[b] : out_height;
+                    char what[160];
+                    snprintf(what, sizeof(what), "%s %s %s threads=%d band=%d", name,
+                             f == KERNEL_BILINEAR ? "bilinear" : "nearest", isa_names[isa_levels[i]],
+                             thread_counts[t], rows);
+
+                    memset(actual, 0xA5, out_bytes);
+                    run_banded(kernel, src, actual, &plan, rows, thread_counts[t]);
+                    failures += compare_samples(what, expected, actual, out_width, out_height, channels, sample_size);
+                    (*variants)++;
+                }
+            }
+        }
+        resize_plan_free(&plan);
+    }
+
+    resize_set_isa_limit(RESIZE_ISA_NATIVE);
+    free(expected);
+    free(actual);
+    return failures;
+}
+
+// Public entry points: each ISA level against the same call at scalar level
+typedef Image* (*ResizeFn)(const Image*, int32_t, int32_t);
+
+static Image* resize_lanczos3(const Image* input, int32_t num, int32_t denom) {
+    return resize_image_filter(input, num, denom, FILTER_LANCZOS3);
+}
+
+static const struct {
+    const char* name;
+    ResizeFn resize;
+} public_paths[] = {
+    {"resize_image_fixed", resize_image_fixed},
+    {"resize_image_nearest", resize_image_nearest},
+    {"resize_image_premultiplied", resize_image_premultiplied},
+    {"resize_image_linear", resize_image_linear},
+    {"resize_image_planar", resize_image_planar},
+    {"resize_image_filter(lanczos3)", resize_lanczos3}
+};
+
+static int check_public_paths(const Image* input, int num, int denom, const char* name, int* variants) {
+    int failures = 0;
+    for (size_t p = 0; p < sizeof(public_paths) / sizeof(public_paths[0]); p++) {
+        resize_set_isa_limit(RESIZE_ISA_SCALAR);
+        Image* expected = public_paths[p].resize(input, num, denom);
+
+        for (size_t i = 0; i < sizeof(isa_levels) / sizeof(isa_levels[0]); i++) {
+            char what[160];
+            snprintf(what, sizeof(what), "%s %s %s", name, public_paths[p].name, isa_names[isa_levels[i]]);
+
+            resize_set_isa_limit(isa_levels[i]);
+            Image* actual = public_paths[p].resize(input, num, denom);
+            failures += compare_images(what, expected, actual);
+            (*variants)++;
+            if (actual) free_image(actual);
+        }
+        if (expected) free_image(expected);
+    }
+
+    // Paths that promise to equal the generic kernel: the planar kernels for
+    // gray and RGBA-style layouts (RGB keeps its own expanded formula), and
+    // the integer-ratio upscale path for every layout
+    resize_set_isa_limit(RESIZE_ISA_NATIVE);
+    int upscale = 0;
+    Image* planar = resize_image_planar(input, num, denom);
+    Image* fixed = resize_image_fixed(input, num, denom);
+    Image* generic = fixed ? create_image(fixed->width, fixed->height, fixed->channels) : NULL;
+    if (generic && resize_with_kernel(input->data, input->width, input->height, generic->data,
+                                      generic->width, generic->height, generic->channels,
+                                      PIXEL_U8, KERNEL_BILINEAR)) {
+        char what[160];
+        if (planar && input->channels != 3) {
+            snprintf(what, sizeof(what), "%s resize_image_planar vs generic kernel", name);
+            failures += compare_images(what, generic, planar);
+            (*variants)++;
+        }
+        if (integer_scale_factor(input->width, input->height, generic->width, generic->height, &upscale) &&
+            upscale) {
+            snprintf(what, sizeof(what), "%s integer upscale vs generic kernel", name);
+            failures += compare_images(what, generic, fixed);
+            (*variants)++;
+        }
+    }
+    if (generic) free_image(generic);
+    if (planar) free_image(planar);
+    if (fixed) free_image(fixed);
+
+    return failures;
+}
+
+// Jobs on the library's pool (resize_job.h): the waiting side of a check
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int ended;                      // jobs that called done
+    int held;                       // workers parked in hold_worker
+    int release;
+    ResizeJobStatus status;         // of the job under test
+    Image* output;
+} JobCheck;
+
+static void job_check_init(JobCheck* check) {
+    memset(check, 0, sizeof(*check));
+    pthread_mutex_init(&check->lock, NULL);
+    pthread_cond_init(&check->changed, NULL);
+}
+
+// Wait until ended jobs called back, then tear the check down
+static void job_check_finish(JobCheck* check, int ended) {
+    pthread_mutex_lock(&check->lock);
+    while (check->ended < ended) pthread_cond_wait(&check->changed, &check->lock);
+    pthread_mutex_unlock(&check->lock);
+    pthread_cond_destroy(&check->changed);
+    pthread_mutex_destroy(&check->lock);
+}
+
+static void job_ended(void* user, ResizeJobStatus status, Image* output) {
+    JobCheck* check = (JobCheck*)user;
+    pthread_mutex_lock(&check->lock);
+    check->status = status;
+    check->output = output;
+    check->ended++;
+    pthread_cond_broadcast(&check->changed);
+    pthread_mutex_unlock(&check->lock);
+}
+
+static void holder_ended(void* user, ResizeJobStatus status, Image* output) {
+    JobCheck* check = (JobCheck*)user;
+    (void)status;
+    if (output) free_image(output);
+    pthread_mutex_lock(&check->lock);
+    check->ended++;
+    pthread_cond_broadcast(&check->changed);
+    pthread_mutex_unlock(&check->lock);
+}
+
+// Progress callback that parks its worker until released, which a real
+// caller must never do: here it keeps the whole pool busy so that a job
+// submitted meanwhile cannot start
+static void hold_worker(void* user, int bands_done, int band_count) {
+    JobCheck* check = (JobCheck*)user;
+    (void)bands_done;
+    (void)band_count;
+    pthread_mutex_lock(&check->lock);
+    check->held++;
+    pthread_cond_broadcast(&check->changed);
+    while (!check->release) pthread_cond_wait(&check->changed, &check->lock);
+    pthread_mutex_unlock(&check->lock);
+}
+
+// A job must deliver resize_image_to's bytes
+static int check_job(const Image* input, int out_width, int out_height, const char* name, int* variants) {
+    char what[160];
+    snprintf(what, sizeof(what), "%s resize_job_submit", name);
+    resize_set_isa_limit(RESIZE_ISA_NATIVE);
+    Image* expected = resize_image_to(input, out_width, out_height);
+
+    JobCheck check;
+    job_check_init(&check);
+    ResizeJob* job = resize_job_submit(input, out_width, out_height, job_ended, NULL, &check);
+    job_check_finish(&check, job ? 1 : 0);
+    if (job) {
+        resize_job_release(job);
+    } else {
+        check.status = RESIZE_JOB_FAILED;
+    }
+
+    int failures = 0;
+    if (check.status != RESIZE_JOB_DONE) {
+        printf("MISMATCH %s: job ended with status %d\n", what, (int)check.status);
+        failures = 1;
+    } else {
+        failures = compare_images(what, expected, check.output);
+    }
+    (*variants)++;
+    if (check.output) free_image(check.output);
+    if (expected) free_image(expected);
+    return failures;
+}
+
+// A job cancelled before any worker reaches it must end as cancelled with
+// no image. Every worker is parked in a holding job's progress callback
+// while the job under test is submitted and cancelled.
+static int check_cancelled_job(const Image* input) {
+    // Beyond RESIZE_JOB_MAX_RUNNING a job waits for a place, not a worker
+    int workers = resize_job_workers();
+    if (workers > RESIZE_JOB_MAX_RUNNING) workers = RESIZE_JOB_MAX_RUNNING;
+    JobCheck holders;
+    job_check_init(&holders);
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        ResizeJob* holder = resize_job_submit(input, 1, 1, holder_ended, hold_worker, &holders);
+        if (!holder) break;
+        resize_job_release(holder);
+        started++;
+    }
+    pthread_mutex_lock(&holders.lock);
+    while (holders.held < started) pthread_cond_wait(&holders.changed, &holders.lock);
+    pthread_mutex_unlock(&holders.lock);
+
+    JobCheck check;
+    job_check_init(&check);
+    ResizeJob* job = workers > 0 && started == workers
+                         ? resize_job_submit(input, input->width, input->height, job_ended, NULL, &check)
+                         : NULL;
+    if (job) resize_job_cancel(job);
+
+    pthread_mutex_lock(&holders.lock);
+    holders.release = 1;
+    pthread_cond_broadcast(&holders.changed);
+    pthread_mutex_unlock(&holders.lock);
+    job_check_finish(&holders, started);
+
+    job_check_finish(&check, job ? 1 : 0);
+    if (!job) {
+        printf("MISMATCH cancelled job: could not occupy the job pool\n");
+        return 1;
+    }
+    resize_job_release(job);
+    if (check.status != RESIZE_JOB_CANCELLED || check.output) {
+        printf("MISMATCH cancelled job: status %d, %s image\n", (int)check.status, check.output ? "an" : "no");
+        if (check.output) free_image(check.output);
+        return 1;
+    }
+    return 0;
+}
+
+int resize_self_check(int verbose) {
+    ResizeIsa saved = resize_get_isa_limit();
+    int cases = 0;
+    int variants = 0;
+    int failures = 0;
+
+    for (int pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+        for (size_t s = 0; s < sizeof(corpus_sizes) / sizeof(corpus_sizes[0]); s++) {
+            for (int channels = 1; channels <= 4; channels++) {
+                int width = corpus_sizes[s].width;
+                int height = corpus_sizes[s].height;
+                Image* input = make_corpus_image((CorpusPattern)pattern, width, height, channels);
+                Image16* wide = input ? widen_image(input) : NULL;
+                if (!input || !wide) {
+                    printf("self-check: out of memory\n");
+                    if (input) free_image(input);
+                    resize_set_isa_limit(saved);
+                    return failures + 1;
+                }
+
+                for (size_t r = 0; r < sizeof(corpus_scales) / sizeof(corpus_scales[0]); r++) {
+                    int num = corpus_scales[r].num;
+                    int denom = corpus_scales[r].denom;
+                    int out_width = width * num / denom;
+                    int out_height = height * num / denom;
+                    if (out_width < 1) out_width = 1;
+                    if (out_height < 1) out_height = 1;
+
+                    char name[96];
+                    snprintf(name, sizeof(name), "%s %dx%dx%d %d/%d", pattern_names[pattern], width, height,
+                             channels, num, denom);
+                    int before = failures;
+
+                    failures += check_kernels(input->data, width, height, out_width, out_height, channels,
+                                              PIXEL_U8, name, &variants);
+                    failures += check_kernels(wide->data, width, height, out_width, out_height, channels,
+                                              PIXEL_U16, name, &variants);
+                    failures += check_public_paths(input, num, denom, name, &variants);
+                    failures += check_job(input, out_width, out_height, name, &variants);
+                    cases++;
+
+                    if (verbose) {
+                        printf("%-36s %s\n", name, failures == before ? "ok" : "FAILED");
+                    }
+                }
+
+                free_image16(wide);
+                free_image(input);
+            }
+        }
+    }
+
+    Image* cancel_input = make_corpus_image(PATTERN_NOISE, 64, 48, 4);
+    failures += cancel_input ? check_cancelled_job(cancel_input) : 1;
+    variants++;
+    if (cancel_input) free_image(cancel_input);
+
+    resize_set_isa_limit(saved);
+    printf("Self-check: %d cases, %d variants, %d mismatches\n", cases, variants, failures);
+    return failures;
+}